@@ -50,6 +50,7 @@ namespace cmudb {
         std::lock_guard<std::mutex> lock(latch_);
         Page *page = nullptr;
         if (page_table_->Find(page_id, page)) {
+            NoteRecLSN(page);
             page->pin_count_++;
             replacer_->Erase(page);
             return page;
@@ -66,7 +67,8 @@ namespace cmudb {
                      * before page is written to disk, flush the log record
                      * up to the page LSN
                      */
-                    if (log_manager_->GetPersistentLSN() <= page->GetLSN()) {
+                    if (log_manager_ != nullptr &&
+                        log_manager_->GetPersistentLSN() <= page->GetLSN()) {
                         log_manager_->flushLogToDisk(true);
                     }
                     disk_manager_->WritePage(page->page_id_, page->GetData());
@@ -77,6 +79,8 @@ namespace cmudb {
         page->page_id_ = page_id;
         page->pin_count_++;
         page->is_dirty_ = false;
+        page->rec_lsn_ = INVALID_LSN;
+        NoteRecLSN(page);
         page_table_->Insert(page_id, page);
         disk_manager_->ReadPage(page_id, page->GetData());
         return page;
@@ -86,7 +90,8 @@ namespace cmudb {
  * Implementation of unpin page
  * if pin_count>0, decrement it and if it becomes zero, put it back to
  * replacer if pin_count<=0 before this call, return false. is_dirty: set the
- * dirty flag of this page
+ * dirty flag of this page. A clean unpin never clears the flag, otherwise a
+ * reader unpinning after a writer would lose the writer's modification
  */
     bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
         std::lock_guard<std::mutex> lock(latch_);
@@ -94,9 +99,14 @@ namespace cmudb {
         if (!(page_table_->Find(page_id, page) && page->pin_count_ > 0))
             return false;
         page->pin_count_--;
-        page->is_dirty_ = is_dirty;
-        if (page->pin_count_ == 0)
+        if (is_dirty)
+            page->is_dirty_ = true;
+        if (page->pin_count_ == 0) {
+            // nobody modified the page, next pin starts a new recLSN
+            if (!page->is_dirty_)
+                page->rec_lsn_ = INVALID_LSN;
             replacer_->Insert(page);
+        }
         return true;
     }
 
@@ -114,11 +124,16 @@ namespace cmudb {
              * before page is written to disk, flush the log record
              * up to the page LSN
              */
-            if (log_manager_->GetPersistentLSN() <= page->GetLSN()) {
+            if (log_manager_ != nullptr &&
+                log_manager_->GetPersistentLSN() <= page->GetLSN()) {
                 log_manager_->flushLogToDisk(true);
             }
             disk_manager_->WritePage(page_id, page->GetData());
             page->is_dirty_ = false;
+            // current pinners may still modify the page after the write
+            page->rec_lsn_ = INVALID_LSN;
+            if (page->pin_count_ > 0)
+                NoteRecLSN(page);
             return true;
         }
         return false;
@@ -136,18 +151,9 @@ namespace cmudb {
         std::lock_guard<std::mutex> lock(latch_);
         Page *page = nullptr;
         if (page_table_->Find(page_id, page) && page->pin_count_ == 0) {
-            if (page->is_dirty_) {
-                /*
-                 * before page is written to disk, flush the log record
-                 * up to the page LSN
-                 */
-                if( log_manager_->GetPersistentLSN() <= page->GetLSN() ) {
-                    log_manager_->flushLogToDisk(true);
-                }
-                disk_manager_->WritePage(page->page_id_, page->GetData());
-                disk_manager_->WritePage(page_id, page->GetData());
-            }
+            // content of a deleted page is discarded, no need to write back
             page->is_dirty_ = false;
+            page->rec_lsn_ = INVALID_LSN;
             page->page_id_ = INVALID_PAGE_ID;
             replacer_->Erase(page);
             page_table_->Remove(page_id);
@@ -182,9 +188,39 @@ namespace cmudb {
         page_id = disk_manager_->AllocatePage();
         page->page_id_ = page_id;
         page->is_dirty_ = false;
+        page->rec_lsn_ = INVALID_LSN;
+        NoteRecLSN(page);
         page->pin_count_ = 1;
         page->ResetMemory();
         page_table_->Insert(page_id, page);
         return page;
     }
+
+/*
+ * Snapshot of the dirty page table for a fuzzy checkpoint, pages are not
+ * latched. A pinned page may already be modified without being marked dirty
+ * yet, so it is reported as well
+ */
+    std::unordered_map<page_id_t, lsn_t> BufferPoolManager::GetDirtyPageTable() {
+        std::lock_guard<std::mutex> lock(latch_);
+        std::unordered_map<page_id_t, lsn_t> dirty_pages;
+        for (size_t i = 0; i < pool_size_; i++) {
+            Page *page = &pages_[i];
+            if (page->page_id_ != INVALID_PAGE_ID &&
+                (page->is_dirty_ || page->pin_count_ > 0) &&
+                page->rec_lsn_ != INVALID_LSN)
+                dirty_pages[page->page_id_] = page->rec_lsn_;
+        }
+        return dirty_pages;
+    }
+
+/*
+ * A page is modified only while pinned and its log record is appended during
+ * that time, so the next lsn when a clean page gets pinned is a lower bound
+ * of the first record that dirties it (recLSN). Caller must hold latch_
+ */
+    void BufferPoolManager::NoteRecLSN(Page *page) {
+        if (log_manager_ != nullptr && page->rec_lsn_ == INVALID_LSN)
+            page->rec_lsn_ = log_manager_->GetNextLSN();
+    }
 } // namespace cmudb
@@ -27,7 +27,8 @@ namespace cmudb {
             pages_pointer_.erase(pos->second);
         }
         pages_pointer_.push_front(value);
-        page_list_directory_.insert({value, pages_pointer_.begin()});
+        // 已存在时insert不会覆盖旧的iterator
+        page_list_directory_[value] = pages_pointer_.begin();
     }
 
 /* If LRU is non-empty, pop the tail member from LRU to argument "value", and
@@ -55,8 +56,8 @@ namespace cmudb {
         if (page_list_directory_.find(value) == page_list_directory_.end())
             return false;
         auto pos = page_list_directory_.find(value);
-        page_list_directory_.erase(pos);
         pages_pointer_.erase(pos->second);
+        page_list_directory_.erase(pos);
         return true;
     }
 
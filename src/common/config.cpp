@@ -4,5 +4,14 @@ namespace cmudb {
 
   std::atomic<bool> ENABLE_LOGGING(false);  // for virtual table
   std::chrono::duration<long long int> LOG_TIMEOUT = std::chrono::seconds(1);
+  std::chrono::microseconds GROUP_COMMIT_LATENCY_SLO =
+      std::chrono::milliseconds(10);
+  int64_t LOG_SEGMENT_FILE_SIZE = 16 * 1024 * 1024;
+  std::chrono::milliseconds LOCK_WAIT_TIMEOUT(0);
+  std::chrono::milliseconds DEADLOCK_DETECTION_INTERVAL(50);
+  size_t LOCK_ESCALATION_PAGE_THRESHOLD = 8;
+  size_t LOCK_ESCALATION_TABLE_THRESHOLD = 1024;
+  std::chrono::milliseconds VERSION_GC_INTERVAL(100);
+  std::chrono::milliseconds CHECKPOINT_INTERVAL = std::chrono::seconds(30);
 
 }
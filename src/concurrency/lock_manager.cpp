@@ -2,10 +2,266 @@
  * lock_manager.cpp
  */
 #include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
 #include "concurrency/lock_manager.h"
 
 namespace cmudb {
 
+    static_assert((LOCK_TABLE_PARTITIONS & (LOCK_TABLE_PARTITIONS - 1)) == 0,
+                  "number of lock table partitions must be a power of two");
+    static_assert((LOCK_TABLE_PARTITION_BUCKETS & (LOCK_TABLE_PARTITION_BUCKETS - 1)) == 0,
+                  "number of lock table buckets must be a power of two");
+
+    namespace {
+        // Request nodes freed by a thread, reused by its next requests
+        struct RequestPool {
+            ~RequestPool() {
+                while (head_ != nullptr) {
+                    Request *next = head_->next_;
+                    delete head_;
+                    head_ = next;
+                }
+            }
+
+            Request *head_ = nullptr;
+            size_t size_ = 0;
+        };
+
+        thread_local RequestPool request_pool;
+    }
+
+    Parker &Parker::Current() {
+        static thread_local Parker parker;
+        return parker;
+    }
+
+    Request *Request::Allocate(txn_id_t tid, LockMode mode, bool granted,
+                               bool converting) {
+        Request *request = request_pool.head_;
+        if (request != nullptr) {
+            request_pool.head_ = request->next_;
+            request_pool.size_--;
+        } else {
+            request = new Request();
+        }
+        request->tid_ = tid;
+        request->mode_ = mode;
+        request->is_granted_ = granted;
+        request->converting_ = converting;
+        request->is_aborted_ = false;
+        request->rank_ = 0;
+        request->parker_ = &Parker::Current();
+        request->prev_ = request->next_ = nullptr;
+        return request;
+    }
+
+    void Request::Free(Request *request) {
+        if (request_pool.size_ >= LOCK_REQUEST_POOL_SIZE) {
+            delete request;
+            return;
+        }
+        request->next_ = request_pool.head_;
+        request_pool.head_ = request;
+        request_pool.size_++;
+    }
+
+    LockTable::LockTable() : buckets_(LOCK_TABLE_PARTITION_BUCKETS, nullptr) {}
+
+    LockTable::~LockTable() {
+        for (RequestQueue *queue : buckets_) {
+            while (queue != nullptr) {
+                RequestQueue *next = queue->next_;
+                delete queue;
+                queue = next;
+            }
+        }
+        while (free_ != nullptr) {
+            RequestQueue *next = free_->next_;
+            delete free_;
+            free_ = next;
+        }
+    }
+
+/*
+ * 与GetPartition使用同一个hash的不同位：partition取32位以上的低位，bucket取最高位
+ */
+    RequestQueue *&LockTable::Bucket(const RID &rid) {
+        uint64_t hash = std::hash<RID>()(rid) * 0x9E3779B97F4A7C15ULL;
+        return buckets_[(hash >> 38) & (buckets_.size() - 1)];
+    }
+
+    RequestQueue &LockTable::operator[](const RID &rid) {
+        for (RequestQueue *queue = Bucket(rid); queue != nullptr; queue = queue->next_) {
+            if (queue->rid_ == rid)
+                return *queue;
+        }
+        if (size_ >= buckets_.size() * 2)
+            Grow();
+        RequestQueue *queue = free_;
+        if (queue != nullptr) {
+            free_ = queue->next_;
+            num_free_--;
+        } else {
+            queue = new RequestQueue();
+        }
+        queue->rid_ = rid;
+        queue->has_upgrading = false;
+        queue->contention_ = LockContention();
+        RequestQueue *&bucket = Bucket(rid);
+        queue->next_ = bucket;
+        bucket = queue;
+        size_++;
+        return *queue;
+    }
+
+    RequestQueue *LockTable::find(const RID &rid) {
+        RequestQueue *queue = Bucket(rid);
+        while (queue != nullptr && !(queue->rid_ == rid))
+            queue = queue->next_;
+        return queue;
+    }
+
+    void LockTable::erase(const RID &rid) {
+        RequestQueue **link = &Bucket(rid);
+        while (!((*link)->rid_ == rid))
+            link = &(*link)->next_;
+        RequestQueue *queue = *link;
+        assert(queue->req_queue_.empty());
+        *link = queue->next_;
+        size_--;
+        // 只保留有过等待的rid的统计，lock table不会因为冷数据而增长
+        if (queue->contention_.num_waits != 0)
+            history_[rid].Merge(queue->contention_);
+        if (num_free_ >= LOCK_QUEUE_POOL_SIZE) {
+            delete queue;
+            return;
+        }
+        queue->next_ = free_;
+        free_ = queue;
+        num_free_++;
+    }
+
+    void LockTable::Grow() {
+        std::vector<RequestQueue *> buckets(buckets_.size() * 2, nullptr);
+        buckets_.swap(buckets);
+        for (RequestQueue *queue : buckets) {
+            while (queue != nullptr) {
+                RequestQueue *next = queue->next_;
+                RequestQueue *&bucket = Bucket(queue->rid_);
+                queue->next_ = bucket;
+                bucket = queue;
+                queue = next;
+            }
+        }
+    }
+
+    LockManager::LockManager(bool strict_2PL, DeadlockPolicy policy,
+                             std::chrono::milliseconds wait_timeout,
+                             GrantPolicy grant_policy)
+            : strict_2PL_(strict_2PL), policy_(policy),
+              wait_timeout_(wait_timeout), grant_policy_(grant_policy),
+              num_wounded_pending_(0),
+              num_died_(0), num_wounded_(0), num_deadlock_victims_(0),
+              num_timeouts_(0), num_escalations_(0) {
+        // operator new ignores over-alignment before C++17
+        void *memory = nullptr;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE,
+                           sizeof(LockTablePartition) * LOCK_TABLE_PARTITIONS) != 0)
+            throw std::bad_alloc();
+        partitions_ = static_cast<LockTablePartition *>(memory);
+        for (int i = 0; i < LOCK_TABLE_PARTITIONS; i++)
+            new(&partitions_[i]) LockTablePartition();
+        if (policy_ == DeadlockPolicy::DETECTION)
+            detection_thread_ = std::thread(&LockManager::DetectionLoop, this);
+    }
+
+    LockManager::~LockManager() {
+        if (detection_thread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(detection_latch_);
+                stop_detection_ = true;
+            }
+            detection_cv_.notify_one();
+            detection_thread_.join();
+        }
+        for (int i = 0; i < LOCK_TABLE_PARTITIONS; i++)
+            partitions_[i].~LockTablePartition();
+        free(partitions_);
+    }
+
+/*
+ * rid的page id在高32位、slot在低32位，乘以黄金分割常数后取高位，
+ * 同一page的row以及不同page的同一slot都会分散到不同partition
+ */
+    LockTablePartition &LockManager::GetPartition(const RID &rid) {
+        uint64_t hash = std::hash<RID>()(rid) * 0x9E3779B97F4A7C15ULL;
+        return partitions_[(hash >> 32) & (LOCK_TABLE_PARTITIONS - 1)];
+    }
+
+    size_t LockManager::GetLockTableSize() {
+        size_t size = 0;
+        for (int i = 0; i < LOCK_TABLE_PARTITIONS; i++) {
+            std::lock_guard<std::mutex> latch(partitions_[i].mutex_);
+            size += partitions_[i].lock_table_.size();
+        }
+        return size;
+    }
+
+    LockContention LockManager::GetContention(const RID &rid) {
+        LockTablePartition &partition = GetPartition(rid);
+        std::lock_guard<std::mutex> table_latch(partition.mutex_);
+        LockContention contention;
+        auto &history = partition.lock_table_.GetHistory();
+        auto it = history.find(rid);
+        if (it != history.end())
+            contention = it->second;
+        RequestQueue *queue = partition.lock_table_.find(rid);
+        if (queue != nullptr) {
+            std::lock_guard<std::mutex> item_latch(queue->mutex_);
+            contention.Merge(queue->contention_);
+        }
+        return contention;
+    }
+
+    std::vector<std::pair<RID, LockContention>> LockManager::GetHottestRids(size_t n) {
+        std::unordered_map<RID, LockContention> contended;
+        for (int i = 0; i < LOCK_TABLE_PARTITIONS; i++) {
+            std::lock_guard<std::mutex> table_latch(partitions_[i].mutex_);
+            for (auto &entry : partitions_[i].lock_table_.GetHistory())
+                contended[entry.first].Merge(entry.second);
+            partitions_[i].lock_table_.ForEach([&contended](RequestQueue &queue) {
+                std::lock_guard<std::mutex> item_latch(queue.mutex_);
+                if (queue.contention_.num_waits != 0)
+                    contended[queue.rid_].Merge(queue.contention_);
+            });
+        }
+        std::vector<std::pair<RID, LockContention>> hottest(contended.begin(), contended.end());
+        auto hotter = [](const std::pair<RID, LockContention> &a,
+                         const std::pair<RID, LockContention> &b) {
+            return a.second.total_wait_us > b.second.total_wait_us;
+        };
+        if (hottest.size() > n) {
+            std::partial_sort(hottest.begin(), hottest.begin() + n, hottest.end(), hotter);
+            hottest.resize(n);
+        } else {
+            std::sort(hottest.begin(), hottest.end(), hotter);
+        }
+        return hottest;
+    }
+
+    LockAbortMetrics LockManager::GetAbortMetrics() {
+        LockAbortMetrics metrics;
+        metrics.num_died = num_died_;
+        metrics.num_wounded = num_wounded_;
+        metrics.num_deadlock_victims = num_deadlock_victims_;
+        metrics.num_timeouts = num_timeouts_;
+        return metrics;
+    }
+
     bool LockManager::LockShared(Transaction *txn, const RID &rid) {
         return LockTemplate(txn, rid, LockMode::SHARED);
     }
@@ -19,7 +275,8 @@ namespace cmudb {
     }
 
 
-    bool LockManager::LockTemplate(Transaction *txn, const RID &rid, LockMode lockMode) {
+    bool LockManager::LockTemplate(Transaction *txn, const RID &rid, LockMode lockMode,
+                                   bool wait) {
         /*
          * 验证两阶段提交：判断事务是否处于GROWING阶段
          * 若不满足2PL约束，则该事务应Abort
@@ -28,46 +285,450 @@ namespace cmudb {
             txn->SetState(TransactionState::ABORTED);
             return false;
         }
+        // 持有锁时被wound的事务在下一次加锁时abort
+        if (TakeWound(txn->GetTransactionId())) {
+            txn->SetState(TransactionState::ABORTED);
+            return false;
+        }
 
-        std::unique_lock<std::mutex> table_latch(mutex_);
-        RequestQueue &requestQueue = lock_table_[rid];
+        LockTablePartition &partition = GetPartition(rid);
+        std::unique_lock<std::mutex> table_latch(partition.mutex_);
+        RequestQueue &requestQueue = partition.lock_table_[rid];
         std::unique_lock<std::mutex> item_latch(requestQueue.mutex_);
         table_latch.unlock();
 
-        if (lockMode == LockMode::UPGRADING) {
+        requestQueue.note_request();
+        txn_id_t tid = txn->GetTransactionId();
+        auto held = std::find_if(requestQueue.req_queue_.begin(), requestQueue.req_queue_.end(),
+                                 [tid](const Request &req) { return tid == req.tid_; });
+        if (lockMode == LockMode::UPGRADING &&
+            (held == requestQueue.req_queue_.end() || held->mode_ != LockMode::SHARED)) {
+            // 只能upgrade持有的shared lock
+            txn->SetState(TransactionState::ABORTED);
+            return false;
+        }
+
+        if (held != requestQueue.req_queue_.end()) {
             /*
-             * 等待队列中不能有其他请求是Upgrading状态
-             * 如果该事务之前以LOCKMODE::SHARED加入请求队列，则从队列中删除
-             * 找到处于shared状态的请求，从队列中删除，并在最后重新以Upgrade状态重新加入队列中
+             * 已经持有锁时转换为覆盖两者的mode。与其他事务持有的锁兼容时直接转换，
+             * 否则转换请求排在所有等待请求之前，等待期间仍然持有原来的锁
              */
-            if (requestQueue.has_upgrading) {
+            LockMode held_mode = held->mode_;
+            if (lockMode != LockMode::UPGRADING && LockModeCovers(held_mode, lockMode))
+                return true;
+            LockMode mode = LockModeSupremum(held_mode, lockMode);
+            if (requestQueue.compatible(tid, mode)) {
+                held->mode_ = mode;
+                GetLockSet(txn, held_mode)->erase(rid);
+                GetLockSet(txn, mode)->insert(rid);
+                return true;
+            }
+            if (!wait)
+                return false;
+            // 两个事务同时等待转换必然死锁，例如都持有shared lock并upgrade
+            if (requestQueue.has_upgrading || !CheckWait(txn, requestQueue)) {
                 txn->SetState(TransactionState::ABORTED);
                 return false;
             }
-            auto it = std::find_if(requestQueue.req_queue_.begin(), requestQueue.req_queue_.end(),
-                                   [txn](const Request &req) { return txn->GetTransactionId() == req.tid_; });
-            if (it == requestQueue.req_queue_.end() || it->mode_ != LockMode::SHARED || !it->is_granted_) {
+            auto waiting = std::find_if(requestQueue.req_queue_.begin(), requestQueue.req_queue_.end(),
+                                        [](const Request &req) { return !req.is_granted_; });
+            Request &request = *requestQueue.req_queue_.emplace(waiting, tid, mode, false, true);
+            requestQueue.has_upgrading = true;
+            requestQueue.contention_.num_waits++;
+            item_latch.unlock();
+            if (!WaitForGrant(txn, rid, partition, requestQueue, request)) {
                 txn->SetState(TransactionState::ABORTED);
                 return false;
             }
-
-            requestQueue.req_queue_.erase(it);
-            txn->GetSharedLockSet()->erase(rid);
+            GetLockSet(txn, held_mode)->erase(rid);
+            GetLockSet(txn, mode)->insert(rid);
+            return true;
         }
 
         bool can_granted = requestQueue.canGranted(lockMode);
-        requestQueue.insert_into_queue(txn, rid, lockMode, can_granted, &item_latch);
+        if (!can_granted && !wait)
+            return false;
+        if (!can_granted && !CheckWait(txn, requestQueue)) {
+            txn->SetState(TransactionState::ABORTED);
+            return false;
+        }
+        if (can_granted) {
+            requestQueue.req_queue_.emplace_back(tid, lockMode, true);
+        } else {
+            // 等待的请求按grant policy排序，grant_waiting按队列顺序授予
+            int64_t rank = GrantRank(txn);
+            Request &request = *requestQueue.req_queue_.emplace(
+                    requestQueue.waiting_position(rank), tid, lockMode, false);
+            request.rank_ = rank;
+            requestQueue.contention_.num_waits++;
+            item_latch.unlock();
+            if (!WaitForGrant(txn, rid, partition, requestQueue, request)) {
+                txn->SetState(TransactionState::ABORTED);
+                return false;
+            }
+        }
+        GetLockSet(txn, lockMode)->insert(rid);
+        CountLock(txn, rid, 1);
         return true;
 
     }
 
+    bool LockManager::LockTable(Transaction *txn, page_id_t table_id, LockMode lockMode) {
+        return LockTemplate(txn, TableLockId(table_id), lockMode);
+    }
+
+    bool LockManager::LockPage(Transaction *txn, page_id_t page_id, LockMode lockMode) {
+        return LockTemplate(txn, PageLockId(page_id), lockMode);
+    }
+
+/*
+ * 自上而下加锁：先table后page。持有的table/page锁已经覆盖tuple锁时不需要再加锁
+ */
+    bool LockManager::LockIntention(Transaction *txn, page_id_t table_id, page_id_t page_id,
+                                    LockMode lockMode, bool &covered) {
+        RID table = TableLockId(table_id), page = PageLockId(page_id);
+        covered = HoldsLock(txn, table, lockMode) || HoldsLock(txn, page, lockMode);
+        if (covered)
+            return true;
+        LockMode intention = lockMode == LockMode::SHARED ? LockMode::INTENTION_SHARED
+                                                          : LockMode::INTENTION_EXCLUSIVE;
+        if (!HoldsLock(txn, table, intention) && !LockTemplate(txn, table, intention))
+            return false;
+
+        /*
+         * 锁的数量达到阈值时升级为table/page锁。其他事务持有冲突的锁时不升级，
+         * 继续加tuple锁，下一次加锁时再尝试
+         */
+        auto counts = txn->GetLockCounts();
+        auto reached = [&counts](const RID &item, size_t threshold) {
+            auto count = counts->find(item);
+            return threshold != 0 && count != counts->end() && count->second >= threshold;
+        };
+        bool exclusive = lockMode != LockMode::SHARED;
+        if (reached(table, LOCK_ESCALATION_TABLE_THRESHOLD) &&
+            Escalate(txn, table, exclusive || HoldsLock(txn, table, LockMode::INTENTION_EXCLUSIVE))) {
+            covered = true;
+            return true;
+        }
+        // the page counts towards its table from now on
+        txn->GetLockedPages()->emplace(page_id, table_id);
+        if (!HoldsLock(txn, page, intention) && !LockTemplate(txn, page, intention))
+            return false;
+        if (reached(page, LOCK_ESCALATION_PAGE_THRESHOLD))
+            covered = Escalate(txn, page, exclusive || HoldsLock(txn, page, LockMode::INTENTION_EXCLUSIVE));
+        // a wounded transaction aborts on the escalation attempt
+        return txn->GetState() != TransactionState::ABORTED;
+    }
+
+/*
+ * tuple锁和page锁都已经被table/page锁覆盖，直接释放。
+ * IS/IX page锁在table升级后也不再需要
+ */
+    bool LockManager::Escalate(Transaction *txn, const RID &item, bool exclusive) {
+        if (!LockTemplate(txn, item, exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED, false))
+            return false;
+        num_escalations_++;
+        bool is_table = item.GetSlotNum() == TABLE_LOCK_SLOT;
+        auto pages = txn->GetLockedPages();
+        auto below = [&](const RID &rid) {
+            if (rid.GetSlotNum() == TABLE_LOCK_SLOT)
+                return false;
+            if (!is_table)
+                return rid.GetSlotNum() != PAGE_LOCK_SLOT && rid.GetPageId() == item.GetPageId();
+            auto page = pages->find(rid.GetPageId());
+            return page != pages->end() && page->second == item.GetPageId();
+        };
+        std::vector<RID> released;
+        for (auto lock_set : {txn->GetSharedLockSet(), txn->GetExclusiveLockSet(),
+                              txn->GetIntentionSharedLockSet(),
+                              txn->GetIntentionExclusiveLockSet(),
+                              txn->GetSharedIntentionExclusiveLockSet()}) {
+            for (const RID &rid : *lock_set) {
+                if (below(rid))
+                    released.push_back(rid);
+            }
+        }
+        for (const RID &rid : released)
+            Release(txn, rid);
+        return true;
+    }
+
+    void LockManager::CountLock(Transaction *txn, const RID &rid, int delta) {
+        // only pages locked through LockIntention can be escalated
+        auto pages = txn->GetLockedPages();
+        auto page = pages->find(rid.GetPageId());
+        if (rid.GetSlotNum() == TABLE_LOCK_SLOT || page == pages->end())
+            return;
+        auto counts = txn->GetLockCounts();
+        auto count = [&counts, delta](const RID &item) {
+            if (delta > 0) {
+                (*counts)[item]++;
+            } else {
+                auto it = counts->find(item);
+                if (it != counts->end() && --it->second == 0)
+                    counts->erase(it);
+            }
+        };
+        if (rid.GetSlotNum() != PAGE_LOCK_SLOT)
+            count(PageLockId(rid.GetPageId()));
+        count(TableLockId(page->second));
+    }
+
+    bool LockManager::HoldsLock(Transaction *txn, const RID &item, LockMode lockMode) {
+        static const LockMode modes[] = {
+                LockMode::EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE,
+                LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE,
+                LockMode::INTENTION_SHARED};
+        for (LockMode mode : modes) {
+            if (LockModeCovers(mode, lockMode) && GetLockSet(txn, mode)->count(item) != 0)
+                return true;
+        }
+        return false;
+    }
+
+    int64_t LockManager::GrantRank(Transaction *txn) {
+        switch (grant_policy_) {
+            case GrantPolicy::AGE:
+                return txn->GetTransactionId();
+            case GrantPolicy::LOCKS_HELD:
+                return -static_cast<int64_t>(
+                        txn->GetSharedLockSet()->size() + txn->GetExclusiveLockSet()->size() +
+                        txn->GetIntentionSharedLockSet()->size() +
+                        txn->GetIntentionExclusiveLockSet()->size() +
+                        txn->GetSharedIntentionExclusiveLockSet()->size());
+            case GrantPolicy::PRIORITY:
+                return -static_cast<int64_t>(txn->GetPriority());
+            default:
+                // every waiter ranks the same, waiting_position appends
+                return 0;
+        }
+    }
+
+    std::shared_ptr<std::unordered_set<RID>> LockManager::GetLockSet(
+            Transaction *txn, LockMode lockMode) {
+        switch (lockMode) {
+            case LockMode::SHARED:
+                return txn->GetSharedLockSet();
+            case LockMode::INTENTION_SHARED:
+                return txn->GetIntentionSharedLockSet();
+            case LockMode::INTENTION_EXCLUSIVE:
+                return txn->GetIntentionExclusiveLockSet();
+            case LockMode::SHARED_INTENTION_EXCLUSIVE:
+                return txn->GetSharedIntentionExclusiveLockSet();
+            default:
+                return txn->GetExclusiveLockSet();
+        }
+    }
+
+/*
+ * 请求者按FIFO顺序等待队列中所有在它之前的请求
+ */
+    bool LockManager::CheckWait(Transaction *txn, RequestQueue &queue) {
+        txn_id_t tid = txn->GetTransactionId();
+        if (policy_ == DeadlockPolicy::WAIT_DIE) {
+            // 只有比所有等待对象都年老时才等待
+            for (const Request &request : queue.req_queue_) {
+                if (request.tid_ < tid) {
+                    num_died_++;
+                    return false;
+                }
+            }
+        } else if (policy_ == DeadlockPolicy::WOUND_WAIT) {
+            for (const Request &request : queue.req_queue_) {
+                if (request.tid_ > tid)
+                    Wound(request.tid_);
+            }
+        }
+        return true;
+    }
+
+    void LockManager::Wound(txn_id_t tid) {
+        std::lock_guard<std::mutex> lock(waits_latch_);
+        auto it = waiting_.find(tid);
+        if (it != waiting_.end()) {
+            if (!it->second->is_aborted_) {
+                it->second->abort();
+                num_wounded_++;
+            }
+        } else if (wounded_.insert(tid).second) {
+            num_wounded_pending_++;
+            num_wounded_++;
+        }
+    }
+
+    bool LockManager::TakeWound(txn_id_t tid) {
+        if (num_wounded_pending_ == 0)
+            return false;
+        std::lock_guard<std::mutex> lock(waits_latch_);
+        if (wounded_.erase(tid) == 0)
+            return false;
+        num_wounded_pending_--;
+        return true;
+    }
+
+/*
+ * A request aborted while it was being granted still gives up the lock, the
+ * wound or deadlock victim choice must not get lost
+ */
+    bool LockManager::WaitForGrant(Transaction *txn, const RID &rid,
+                                   LockTablePartition &partition,
+                                   RequestQueue &queue, Request &request) {
+        txn_id_t tid = txn->GetTransactionId();
+        bool wounded = false;
+        {
+            std::lock_guard<std::mutex> lock(waits_latch_);
+            if (wounded_.erase(tid) != 0) {
+                num_wounded_pending_--;
+                wounded = true;
+            } else {
+                waiting_[tid] = &request;
+            }
+        }
+        bool granted = false, aborted = wounded;
+        auto start = std::chrono::steady_clock::now();
+        if (!wounded) {
+            granted = request.wait(wait_timeout_);
+            std::lock_guard<std::mutex> lock(waits_latch_);
+            waiting_.erase(tid);
+            aborted = request.is_aborted_;
+        }
+        uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if (granted && !aborted) {
+            std::lock_guard<std::mutex> item_latch(queue.mutex_);
+            queue.note_wait(wait_us);
+            return true;
+        }
+        if (!aborted)
+            num_timeouts_++;
+
+        // 放弃请求，它可能在此期间已经被授予
+        std::unique_lock<std::mutex> table_latch(partition.mutex_);
+        std::unique_lock<std::mutex> item_latch(queue.mutex_);
+        queue.note_wait(wait_us);
+        auto it = std::find_if(queue.req_queue_.begin(), queue.req_queue_.end(),
+                               [&request](const Request &req) { return &req == &request; });
+        if (it->converting_) {
+            queue.has_upgrading = false;
+            // 已授予的转换取代了原来的请求，保留它，事务abort时释放
+            if (it->is_granted_) {
+                for (auto lock_set : {txn->GetSharedLockSet(), txn->GetExclusiveLockSet(),
+                                      txn->GetIntentionSharedLockSet(),
+                                      txn->GetIntentionExclusiveLockSet(),
+                                      txn->GetSharedIntentionExclusiveLockSet()})
+                    lock_set->erase(rid);
+                GetLockSet(txn, it->mode_)->insert(rid);
+                return false;
+            }
+        }
+        queue.req_queue_.erase(it);
+        if (queue.req_queue_.empty()) {
+            item_latch.unlock();
+            partition.lock_table_.erase(rid);
+        } else {
+            queue.grant_waiting();
+        }
+        return false;
+    }
+
+    bool LockManager::AbortWaiting(txn_id_t tid) {
+        std::lock_guard<std::mutex> lock(waits_latch_);
+        auto it = waiting_.find(tid);
+        if (it == waiting_.end() || it->second->is_aborted_)
+            return false;
+        it->second->abort();
+        return true;
+    }
+
+    void LockManager::DetectionLoop() {
+        std::unique_lock<std::mutex> lock(detection_latch_);
+        while (!detection_cv_.wait_for(lock, DEADLOCK_DETECTION_INTERVAL,
+                                       [this] { return stop_detection_; })) {
+            lock.unlock();
+            DetectDeadlocks();
+            lock.lock();
+        }
+    }
+
+/*
+ * 一个等待的请求等待队列中所有在它之前的其他事务的请求。
+ * partition是依次扫描的，graph不是一个一致的快照；已经不再等待的victim不会被abort
+ */
+    void LockManager::DetectDeadlocks() {
+        {
+            std::lock_guard<std::mutex> lock(waits_latch_);
+            // 一个环至少需要两个等待的事务
+            if (waiting_.size() < 2)
+                return;
+        }
+        std::map<txn_id_t, std::vector<txn_id_t>> waits_for;
+        for (int i = 0; i < LOCK_TABLE_PARTITIONS; i++) {
+            std::lock_guard<std::mutex> table_latch(partitions_[i].mutex_);
+            partitions_[i].lock_table_.ForEach([&waits_for](RequestQueue &queue) {
+                std::lock_guard<std::mutex> item_latch(queue.mutex_);
+                for (auto it = queue.req_queue_.begin(); it != queue.req_queue_.end(); ++it) {
+                    if (it->is_granted_)
+                        continue;
+                    for (auto ahead = queue.req_queue_.begin(); ahead != it; ++ahead) {
+                        if (ahead->tid_ != it->tid_)
+                            waits_for[it->tid_].push_back(ahead->tid_);
+                    }
+                }
+            });
+        }
+
+        txn_id_t victim;
+        while ((victim = FindCycleVictim(waits_for)) != INVALID_TXN_ID) {
+            if (AbortWaiting(victim))
+                num_deadlock_victims_++;
+            waits_for.erase(victim);
+        }
+    }
+
+    txn_id_t LockManager::FindCycleVictim(
+            const std::map<txn_id_t, std::vector<txn_id_t>> &waits_for) {
+        // 0: not visited, 1: on the dfs path, 2: no cycle through it
+        std::unordered_map<txn_id_t, int> state;
+        std::vector<txn_id_t> path;
+        std::function<txn_id_t(txn_id_t)> visit = [&](txn_id_t tid) {
+            state[tid] = 1;
+            path.push_back(tid);
+            auto edges = waits_for.find(tid);
+            if (edges != waits_for.end()) {
+                for (txn_id_t next : edges->second) {
+                    if (state[next] == 1)
+                        return *std::max_element(
+                                std::find(path.begin(), path.end(), next), path.end());
+                    if (state[next] == 0) {
+                        txn_id_t victim = visit(next);
+                        if (victim != INVALID_TXN_ID)
+                            return victim;
+                    }
+                }
+            }
+            state[tid] = 2;
+            path.pop_back();
+            return static_cast<txn_id_t>(INVALID_TXN_ID);
+        };
+        for (auto &entry : waits_for) {
+            if (state[entry.first] != 0)
+                continue;
+            txn_id_t victim = visit(entry.first);
+            if (victim != INVALID_TXN_ID)
+                return victim;
+        }
+        return INVALID_TXN_ID;
+    }
+
 
     bool LockManager::Unlock(Transaction *txn, const RID &rid) {
         //std::cout<<"Unlock request by trasaction: "<<txn->GetTransactionId()<<std::endl;
 
         if( strict_2PL_ ){
             //当txn对rid持有互斥锁的时候，事务只有在COMMIT或ABORT状态，unlock()操作成功;其余情况皆操作成功
-            if( txn->GetExclusiveLockSet()->count( rid ) != 0 ){
+            if( txn->GetExclusiveLockSet()->count( rid ) != 0
+                    || txn->GetIntentionExclusiveLockSet()->count( rid ) != 0
+                    || txn->GetSharedIntentionExclusiveLockSet()->count( rid ) != 0 ){
                 if( txn->GetState() != TransactionState::COMMITTED
                         && txn->GetState() != TransactionState::ABORTED ) {
                     return false;
@@ -77,9 +738,17 @@ namespace cmudb {
 
         if( txn->GetState() == TransactionState::GROWING )
             txn->SetState( TransactionState::SHRINKING );
+        // 释放锁的事务不会再等待，不再需要它的wound
+        TakeWound(txn->GetTransactionId());
 
-        std::unique_lock<std::mutex> table_latch(mutex_);
-        auto &request_queue = lock_table_[rid];
+        Release(txn, rid);
+        return true;
+    }
+
+    void LockManager::Release(Transaction *txn, const RID &rid) {
+        LockTablePartition &partition = GetPartition(rid);
+        std::unique_lock<std::mutex> table_latch(partition.mutex_);
+        auto &request_queue = partition.lock_table_[rid];
         std::unique_lock<std::mutex> item_latch(request_queue.mutex_);
 
         auto it = std::find_if(request_queue.req_queue_.begin(), request_queue.req_queue_.end(),
@@ -87,37 +756,18 @@ namespace cmudb {
         //断言： 发出unlock message的事务必须在data item所在的请求队列中
         assert(it != request_queue.req_queue_.end());
 
-        auto lockSet = (it->mode_ == LockMode::SHARED) ? txn->GetSharedLockSet() : txn->GetExclusiveLockSet();
-        lockSet->erase(rid);
+        GetLockSet(txn, it->mode_)->erase(rid);
+        CountLock(txn, rid, -1);
         request_queue.req_queue_.erase(it);
         //如果当前RID对应的请求队列为空，则从locktable中删除
+        //其他事务只有在持有partition latch时才会等待item latch，先释放它再删除
         if (request_queue.req_queue_.empty()) {
-            lock_table_.erase(rid);
-            return true;
+            item_latch.unlock();
+            partition.lock_table_.erase(rid);
+            return;
         }
         table_latch.unlock();
 
-        auto &first_req = request_queue.req_queue_.front();
-
-        /* 从队列头开始遍历，如果已是获取状态，则说明是SHARED模式，break循坏
-         * 如果未获取，且获取到的状态是EXCLUSIVE 则break循坏
-         * 如果未获取，且获取是SHARED, 则遍历直到某个request不是SHARED mode
-         */
-        if ( !first_req.is_granted_ && first_req.mode_ == LockMode::EXCLUSIVE )
-            first_req.granted();
-        else if ( !first_req.is_granted_ ) {
-            for ( Request &ele : request_queue.req_queue_ ) {
-                if ( ele.mode_ == LockMode::UPGRADING ) {
-                    request_queue.has_upgrading = false;
-                    ele.mode_ = LockMode::EXCLUSIVE;
-                }
-                if ( ele.mode_ == LockMode::EXCLUSIVE ) {
-                    ele.granted();
-                    break;
-                }
-                ele.granted();
-            }
-        }
-        return true;
+        request_queue.grant_waiting();
     }
-} // namespace cmudb
\ No newline at end of file
+} // namespace cmudb
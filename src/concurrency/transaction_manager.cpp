@@ -9,25 +9,64 @@
 
 namespace cmudb {
 
-    Transaction *TransactionManager::Begin() {
-        Transaction *txn = new Transaction(next_txn_id_++);
+    /*
+     * BEGIN log record is not written here: LogManager writes it together with
+     * the first log record of the transaction, so a transaction that writes
+     * nothing never touches the log
+     */
+    Transaction *TransactionManager::Begin(bool read_only) {
+        Transaction *txn = new Transaction(next_txn_id_++, read_only);
+        if (version_manager_ != nullptr)
+            version_manager_->Begin(txn);
+        std::lock_guard<std::mutex> lock(active_txn_latch_);
+        active_txns_[txn->GetTransactionId()] = txn;
+        return txn;
+    }
 
-        if (ENABLE_LOGGING) {
-            // TODO: write log and update transaction's prev_lsn here
-            LogRecord logRecord( txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN );
-            lsn_t current_lsn = log_manager_->AppendLogRecord( logRecord );
-            txn->SetPrevLSN( current_lsn );
+    void TransactionManager::Commit(Transaction *txn) {
+        // 只读事务没有写log，不需要等待flush
+        if (PrepareCommit(txn)) {
+            /*
+             * whenever you call Commit or Abort method,
+             * you need to make sure your log records are
+             * permanently stored on disk file before release the locks.
+             * But instead of forcing flush, you need to wait for LOG_TIMEOUT or
+             * other operations to implicitly trigger the flush operations.
+             */
+            log_manager_->flushLogToDisk( false );
         }
 
-        return txn;
+        FinishCommit(txn);
     }
 
-    void TransactionManager::Commit(Transaction *txn) {
+    void TransactionManager::CommitAsync(
+            Transaction *txn, std::function<void(Transaction *)> callback) {
+        if (!PrepareCommit(txn)) {
+            FinishCommit(txn);
+            callback(txn);
+            return;
+        }
+        // 锁在commit log record持久化之后才释放
+        log_manager_->RegisterFlushCallback(
+                txn->GetPrevLSN(), [this, txn, callback] {
+                    FinishCommit(txn);
+                    callback(txn);
+                });
+    }
 
+    std::future<void> TransactionManager::CommitAsync(Transaction *txn) {
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> future = promise->get_future();
+        CommitAsync(txn, [promise](Transaction *) { promise->set_value(); });
+        return future;
+    }
+
+    bool TransactionManager::PrepareCommit(Transaction *txn) {
         txn->SetState(TransactionState::COMMITTED);
-        // truly delete before commit
+        // truly delete before commit, tables with a version manager keep the
+        // deleted tuples for older snapshots
         auto write_set = txn->GetWriteSet();
-        while (!write_set->empty()) {
+        while (write_set != nullptr && !write_set->empty()) {
             auto &item = write_set->back();
             auto table = item.table_;
             if (item.wtype_ == WType::DELETE) {
@@ -36,40 +75,24 @@ namespace cmudb {
             }
             write_set->pop_back();
         }
-        write_set->clear();
 
-        if (ENABLE_LOGGING) {
+        if (ENABLE_LOGGING && txn->GetPrevLSN() != INVALID_LSN) {
             // TODO: write log and update transaction's prev_lsn here
             LogRecord logRecord( txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT );
             lsn_t current_lsn = log_manager_->AppendLogRecord( logRecord );
             txn->SetPrevLSN( current_lsn );
-            /*
-             * whenever you call Commit or Abort method,
-             * you need to make sure your log records are
-             * permanently stored on disk file before release the locks.
-             * But instead of forcing flush, you need to wait for LOG_TIMEOUT or
-             * other operations to implicitly trigger the flush operations.
-             */
-            log_manager_->flushLogToDisk( false );
-        }
-
-        // release all the lock
-        std::unordered_set<RID> lock_set;
-        for (auto item : *txn->GetSharedLockSet())
-            lock_set.emplace(item);
-        for (auto item : *txn->GetExclusiveLockSet())
-            lock_set.emplace(item);
-        // release all the lock
-        for (auto locked_rid : lock_set) {
-            lock_manager_->Unlock(txn, locked_rid);
+            RemoveActiveTransaction(txn);
+            return true;
         }
+        RemoveActiveTransaction(txn);
+        return false;
     }
 
     void TransactionManager::Abort(Transaction *txn) {
         txn->SetState(TransactionState::ABORTED);
         // rollback before releasing lock
         auto write_set = txn->GetWriteSet();
-        while (!write_set->empty()) {
+        while (write_set != nullptr && !write_set->empty()) {
             auto &item = write_set->back();
             auto table = item.table_;
             if (item.wtype_ == WType::DELETE) {
@@ -84,9 +107,8 @@ namespace cmudb {
             }
             write_set->pop_back();
         }
-        write_set->clear();
 
-        if (ENABLE_LOGGING) {
+        if (ENABLE_LOGGING && txn->GetPrevLSN() != INVALID_LSN) {
             // TODO: write log and update transaction's prev_lsn here
             LogRecord logRecord( txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT );
             lsn_t current_lsn = log_manager_->AppendLogRecord( logRecord );
@@ -100,7 +122,46 @@ namespace cmudb {
              */
             log_manager_->flushLogToDisk( false );
         }
+        RemoveActiveTransaction(txn);
+        if (version_manager_ != nullptr)
+            version_manager_->Abort(txn);
+
+        ReleaseLocks(txn);
+    }
 
+    /*
+     * transaction whose COMMIT/ABORT record is appended no longer needs undo
+     */
+    void TransactionManager::RemoveActiveTransaction(Transaction *txn) {
+        std::lock_guard<std::mutex> lock(active_txn_latch_);
+        active_txns_.erase(txn->GetTransactionId());
+    }
+
+    std::vector<std::tuple<txn_id_t, lsn_t, lsn_t>>
+    TransactionManager::GetActiveTransactionTable() {
+        std::lock_guard<std::mutex> lock(active_txn_latch_);
+        std::vector<std::tuple<txn_id_t, lsn_t, lsn_t>> active_txns;
+        for (auto &entry : active_txns_) {
+            Transaction *txn = entry.second;
+            lsn_t last_lsn = txn->GetPrevLSN();
+            if (last_lsn != INVALID_LSN)
+                active_txns.emplace_back(entry.first, last_lsn,
+                                         txn->GetFirstLSN());
+        }
+        return active_txns;
+    }
+
+    /*
+     * snapshots see the commit only once it is durable, and before the locks
+     * are released, so the next writer of a tuple sees its commit timestamp
+     */
+    void TransactionManager::FinishCommit(Transaction *txn) {
+        if (version_manager_ != nullptr)
+            version_manager_->Commit(txn);
+        ReleaseLocks(txn);
+    }
+
+    void TransactionManager::ReleaseLocks(Transaction *txn) {
         // release all the lock
         std::unordered_set<RID> lock_set;
         for (auto item : *txn->GetSharedLockSet())
@@ -111,5 +172,16 @@ namespace cmudb {
         for (auto locked_rid : lock_set) {
             lock_manager_->Unlock(txn, locked_rid);
         }
+        // intention locks on tables and pages go after the locks below them
+        lock_set.clear();
+        for (auto item : *txn->GetSharedIntentionExclusiveLockSet())
+            lock_set.emplace(item);
+        for (auto item : *txn->GetIntentionExclusiveLockSet())
+            lock_set.emplace(item);
+        for (auto item : *txn->GetIntentionSharedLockSet())
+            lock_set.emplace(item);
+        for (auto locked_rid : lock_set) {
+            lock_manager_->Unlock(txn, locked_rid);
+        }
     }
 } // namespace cmudb
@@ -0,0 +1,271 @@
+/**
+ * version_manager.cpp
+ */
+
+#include <cassert>
+
+#include "concurrency/version_manager.h"
+#include "page/table_page.h"
+
+namespace cmudb {
+
+    void VersionManager::Begin(Transaction *txn) {
+        // 与GetWatermark互斥，GC不会丢弃新snapshot还能看到的版本
+        std::lock_guard<std::mutex> lock(snapshot_latch_);
+        timestamp_t read_ts = last_commit_ts_;
+        txn->SetReadTimestamp(read_ts);
+        snapshots_.insert(read_ts);
+    }
+
+    void VersionManager::Commit(Transaction *txn) {
+        auto version_set = txn->GetVersionSet();
+        if (version_set != nullptr && !version_set->empty()) {
+            txn_id_t tid = txn->GetTransactionId();
+            std::lock_guard<std::mutex> commit_lock(commit_latch_);
+            timestamp_t commit_ts = last_commit_ts_ + 1;
+            for (auto &rid : *version_set) {
+                VersionPartition &partition = GetPartition(rid);
+                std::lock_guard<std::mutex> latch(partition.mutex_);
+                auto chain = partition.chains_.find(rid);
+                if (chain == partition.chains_.end())
+                    continue;
+                // every uncommitted version of txn, wherever it is in the
+                // chain. Stamped rids are skipped
+                auto &versions = chain->second;
+                for (size_t i = 0; i < versions.size(); i++) {
+                    if (versions[i].begin_ts_ != MAX_TIMESTAMP ||
+                        versions[i].writer_ != tid)
+                        continue;
+                    versions[i].begin_ts_ = commit_ts;
+                    if (i > 0)
+                        versions[i - 1].end_ts_ = commit_ts;
+                }
+            }
+            version_set->clear();
+            // snapshots taken from now on see the commit
+            last_commit_ts_ = commit_ts;
+        }
+        ReleaseSnapshot(txn);
+    }
+
+    void VersionManager::Abort(Transaction *txn) {
+        ReleaseSnapshot(txn);
+    }
+
+    void VersionManager::ReleaseSnapshot(Transaction *txn) {
+        timestamp_t read_ts = txn->GetReadTimestamp();
+        if (read_ts == INVALID_TIMESTAMP)
+            return;
+        std::lock_guard<std::mutex> lock(snapshot_latch_);
+        snapshots_.erase(snapshots_.find(read_ts));
+        txn->SetReadTimestamp(INVALID_TIMESTAMP);
+    }
+
+    void VersionManager::InsertVersion(const RID &rid, Transaction *txn) {
+        PushVersion(rid, nullptr, false, txn);
+    }
+
+    void VersionManager::UpdateVersion(const RID &rid, const Tuple &old_tuple,
+                                       Transaction *txn) {
+        PushVersion(rid, &old_tuple, false, txn);
+    }
+
+    void VersionManager::DeleteVersion(const RID &rid, const Tuple &old_tuple,
+                                       Transaction *txn) {
+        PushVersion(rid, &old_tuple, true, txn);
+    }
+
+    void VersionManager::PushVersion(const RID &rid, const Tuple *old_tuple,
+                                     bool deleted, Transaction *txn) {
+        VersionPartition &partition = GetPartition(rid);
+        std::lock_guard<std::mutex> latch(partition.mutex_);
+        auto &versions = partition.chains_[rid];
+        if (old_tuple != nullptr) {
+            if (versions.empty()) {
+                // without a chain the replaced tuple is older than every snapshot
+                versions.push_back(TupleVersion{0, MAX_TIMESTAMP, INVALID_TXN_ID,
+                                                false, *old_tuple});
+                num_versions_++;
+            } else {
+                // the replaced version moves off the page
+                versions.back().tuple_ = *old_tuple;
+            }
+        }
+        versions.push_back(TupleVersion{MAX_TIMESTAMP, MAX_TIMESTAMP,
+                                        txn->GetTransactionId(), deleted, Tuple()});
+        num_versions_++;
+        txn->GetVersionSet()->push_back(rid);
+    }
+
+    void VersionManager::RollbackVersion(const RID &rid, Transaction *txn) {
+        VersionPartition &partition = GetPartition(rid);
+        std::lock_guard<std::mutex> latch(partition.mutex_);
+        auto chain = partition.chains_.find(rid);
+        if (chain == partition.chains_.end())
+            return;
+        auto &versions = chain->second;
+        assert(versions.back().begin_ts_ == MAX_TIMESTAMP &&
+               versions.back().writer_ == txn->GetTransactionId());
+        versions.pop_back();
+        num_versions_--;
+        if (versions.empty()) {
+            partition.chains_.erase(chain);
+        } else {
+            // newest again, its image is back on the page
+            versions.back().tuple_ = Tuple();
+        }
+    }
+
+    bool VersionManager::CheckWrite(const RID &rid, Transaction *txn) {
+        timestamp_t read_ts = txn->GetReadTimestamp();
+        if (read_ts == INVALID_TIMESTAMP)
+            return true;
+        VersionPartition &partition = GetPartition(rid);
+        std::lock_guard<std::mutex> latch(partition.mutex_);
+        auto chain = partition.chains_.find(rid);
+        if (chain == partition.chains_.end())
+            return true;
+        const TupleVersion &newest = chain->second.back();
+        if (newest.begin_ts_ == MAX_TIMESTAMP)
+            return newest.writer_ == txn->GetTransactionId();
+        return newest.begin_ts_ <= read_ts;
+    }
+
+/*
+ * 从最新版本往前找第一个可见的版本：自己未提交的版本，或者在snapshot之前提交的版本
+ */
+    bool VersionManager::GetVisibleVersion(const RID &rid, Transaction *txn,
+                                           Tuple &tuple, bool &on_page) {
+        txn_id_t tid = txn->GetTransactionId();
+        timestamp_t read_ts = txn->GetReadTimestamp();
+        VersionPartition &partition = GetPartition(rid);
+        std::lock_guard<std::mutex> latch(partition.mutex_);
+        auto chain = partition.chains_.find(rid);
+        if (chain == partition.chains_.end()) {
+            // the page holds the only version, every snapshot sees it
+            on_page = true;
+            return true;
+        }
+        auto &versions = chain->second;
+        for (size_t i = versions.size(); i-- > 0;) {
+            const TupleVersion &version = versions[i];
+            bool visible = version.begin_ts_ == MAX_TIMESTAMP
+                           ? version.writer_ == tid
+                           : version.begin_ts_ <= read_ts;
+            if (!visible)
+                continue;
+            if (version.deleted_)
+                return false;
+            on_page = i + 1 == versions.size();
+            if (!on_page)
+                tuple = version.tuple_;
+            return true;
+        }
+        // inserted after the snapshot
+        return false;
+    }
+
+    size_t VersionManager::GarbageCollect() {
+        timestamp_t watermark = GetWatermark();
+        size_t dropped = 0;
+        // slots of committed deletes no snapshot sees, and the ones the last
+        // collection could not free
+        std::vector<RID> deleted;
+        {
+            std::lock_guard<std::mutex> lock(free_latch_);
+            deleted.swap(unfreed_slots_);
+        }
+        for (auto &partition : partitions_) {
+            std::lock_guard<std::mutex> latch(partition.mutex_);
+            for (auto chain = partition.chains_.begin();
+                 chain != partition.chains_.end();) {
+                auto &versions = chain->second;
+                // replaced before the watermark, no snapshot sees them
+                size_t count = 0;
+                while (count < versions.size() && versions[count].end_ts_ <= watermark)
+                    count++;
+                versions.erase(versions.begin(), versions.begin() + count);
+                dropped += count;
+                // the newest version is seen by every snapshot, on the page or
+                // as an empty slot
+                if (versions.size() == 1 && versions.front().begin_ts_ <= watermark) {
+                    if (versions.front().deleted_)
+                        deleted.push_back(chain->first);
+                    dropped++;
+                    chain = partition.chains_.erase(chain);
+                } else {
+                    ++chain;
+                }
+            }
+        }
+        num_versions_ -= dropped;
+        // outside of the partition latches, writers latch the page first
+        FreeSlots(deleted);
+        return dropped;
+    }
+
+/*
+ * 删除已提交且没有snapshot能看到的tuple。chain已经丢弃，slot仍标记为删除，
+ * 在释放之前读写都看不到它，插入也不会复用它
+ */
+    void VersionManager::FreeSlots(const std::vector<RID> &rids) {
+        std::vector<RID> unfreed;
+        for (auto &rid : rids) {
+            auto page = static_cast<TablePage *>(
+                    buffer_pool_manager_->FetchPage(rid.GetPageId()));
+            if (page == nullptr) {
+                unfreed.push_back(rid);
+                continue;
+            }
+            page->WLatch();
+            // no transaction: the log record is redone, never undone
+            page->ApplyDelete(rid, nullptr, log_manager_);
+            page->WUnlatch();
+            buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+        }
+        if (!unfreed.empty()) {
+            std::lock_guard<std::mutex> lock(free_latch_);
+            unfreed_slots_.insert(unfreed_slots_.end(), unfreed.begin(),
+                                  unfreed.end());
+        }
+    }
+
+    timestamp_t VersionManager::GetWatermark() {
+        std::lock_guard<std::mutex> lock(snapshot_latch_);
+        return snapshots_.empty() ? last_commit_ts_.load() : *snapshots_.begin();
+    }
+
+    void VersionManager::RunGCThread() {
+        std::lock_guard<std::mutex> lock(gc_latch_);
+        if (gc_thread_.joinable())
+            return;
+        stop_gc_ = false;
+        gc_thread_ = std::thread(&VersionManager::GCLoop, this);
+    }
+
+    void VersionManager::StopGCThread() {
+        {
+            std::lock_guard<std::mutex> lock(gc_latch_);
+            stop_gc_ = true;
+        }
+        gc_cv_.notify_one();
+        if (gc_thread_.joinable())
+            gc_thread_.join();
+    }
+
+    void VersionManager::GCLoop() {
+        std::unique_lock<std::mutex> lock(gc_latch_);
+        while (!gc_cv_.wait_for(lock, VERSION_GC_INTERVAL,
+                                [this] { return stop_gc_; })) {
+            lock.unlock();
+            GarbageCollect();
+            lock.lock();
+        }
+    }
+
+    VersionManager::VersionPartition &VersionManager::GetPartition(const RID &rid) {
+        uint64_t hash = std::hash<RID>()(rid) * 0x9E3779B97F4A7C15ULL;
+        return partitions_[(hash >> 32) & (VERSION_STORE_PARTITIONS - 1)];
+    }
+
+} // namespace cmudb
@@ -1,11 +1,17 @@
 /**
  * disk_manager.cpp
  */
+#include <algorithm>
 #include <assert.h>
+#include <cstdio>
 #include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
 #include <iostream>
 #include <sys/stat.h>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "common/logger.h"
 #include "disk/disk_manager.h"
@@ -13,14 +19,22 @@
 namespace cmudb {
 
     static char *buffer_used = nullptr;
+    // | size(4) | LSN(8) | txnID(4) | prevLSN(8) | type(4) | of a log record
+    static const int LOG_RECORD_HEADER_SIZE = 28;
 
 /**
  * Constructor: open/create a single database file & log file
  * @input db_file: database file name
  */
     DiskManager::DiskManager(const std::string &db_file)
-            : file_name_(db_file), next_page_id_(0), num_flushes_(0), flush_log_(false),
+            : log_fd_(-1), log_write_segment_(-1), log_dirty_(false),
+              log_read_segment_(-1), log_prealloc_segment_(-1),
+              log_segment_size_(LOG_SEGMENT_FILE_SIZE), log_start_offset_(0),
+              log_end_offset_(0), file_name_(db_file), next_page_id_(0),
+              num_flushes_(0), num_reads_(0), flush_log_(false),
               flush_log_f_(nullptr) {
+        // 新的日志文件重新开始检查buffer交替，避免复用前一个实例释放掉的buffer地址
+        buffer_used = nullptr;
         std::string::size_type n = file_name_.find(".");
         if (n == std::string::npos) {
             LOG_DEBUG("wrong file format");
@@ -28,19 +42,22 @@ namespace cmudb {
         }
         log_name_ = file_name_.substr(0, n) + ".log";
 
-        log_io_.open(log_name_,
-                     std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-        // directory or file does not exist
-        if (!log_io_.is_open()) {
-            log_io_.clear();
-            // create a new file
-            log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app |
-                                    std::ios::out);
-            log_io_.close();
-            // reopen with original mode
-            log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app |
-                                    std::ios::out);
+        /*
+         * anchor file记录第一个有效segment的起始offset以及segment大小；
+         * 没有anchor说明是一个新的log，之前残留的segment文件都是无效的
+         */
+        std::ifstream anchor(log_name_, std::ios::binary);
+        int64_t header[2];
+        if (anchor.read(reinterpret_cast<char *>(header), sizeof(header))) {
+            log_start_offset_ = header[0];
+            log_segment_size_ = header[1];
+        } else {
+            RemoveLogSegments();
+            WriteLogAnchor();
         }
+        anchor.close();
+        // segment文件都是预分配的，文件大小不能说明log写到了哪里
+        log_end_offset_ = FindLogEnd();
 
         db_io_.open(db_file,
                     std::ios::binary | std::ios::in | std::ios::out | std::ios::out);
@@ -53,11 +70,19 @@ namespace cmudb {
             // reopen with original mode
             db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
         }
+        // 已有的db file中的page不能再分配
+        next_page_id_ = std::max(GetFileSize(db_file), 0) / PAGE_SIZE;
     }
 
     DiskManager::~DiskManager() {
+        if (log_prealloc_f_.valid())
+            log_prealloc_f_.wait();
         db_io_.close();
-        log_io_.close();
+        if (log_fd_ >= 0) {
+            SyncLog();
+            close(log_fd_);
+        }
+        log_read_io_.close();
     }
 
 /**
@@ -81,6 +106,7 @@ namespace cmudb {
  * Read the contents of the specified page into the given memory area
  */
     void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
+        num_reads_++;
         int offset = page_id * PAGE_SIZE;
         // check if read beyond file length
         if (offset > GetFileSize(file_name_)) {
@@ -96,6 +122,8 @@ namespace cmudb {
             if (read_count < PAGE_SIZE) {
                 LOG_DEBUG("Read less than a page");
                 // std::cerr << "Read less than a page" << std::endl;
+                // eof让流进入fail状态，之后的读写都会被忽略
+                db_io_.clear();
                 memset(page_data + read_count, 0, PAGE_SIZE - read_count);
             }
         }
@@ -103,14 +131,15 @@ namespace cmudb {
 
 /**
  * Write the contents of the log into disk file
- * Only return when sync is done, and only perform sequence write
+ * Only perform sequence write, the data is durable once SyncLog returns
+ * A write crossing a segment boundary continues in the next segment file
  */
     void DiskManager::WriteLog(char *log_data, int size) {
         // enforce swap log buffer
         assert(log_data != buffer_used);
         buffer_used = log_data;
 
-        if (size == 0) // no effect on num_flushes_ if log buffer is empty
+        if (size == 0)
             return;
 
         flush_log_ = true;
@@ -120,49 +149,383 @@ namespace cmudb {
             assert(flush_log_f_->wait_for(std::chrono::seconds(10)) ==
                    std::future_status::ready);
 
-        num_flushes_ += 1;
-        // sequence write
-        log_io_.write(log_data, size);
+        std::lock_guard<std::mutex> lock(log_latch_);
+        int written = 0;
+        while (written < size) {
+            int64_t segment = log_end_offset_ / log_segment_size_;
+            int64_t segment_offset = log_end_offset_ % log_segment_size_;
+            if (segment != log_write_segment_)
+                OpenLogSegment(segment);
+            int count = static_cast<int>(std::min<int64_t>(
+                    size - written, log_segment_size_ - segment_offset));
+            // sequence write into allocated blocks, the file size stays
+            ssize_t ret = pwrite(log_fd_, log_data + written, count,
+                                 segment_offset);
+            // check for I/O error
+            if (ret < 0) {
+                LOG_DEBUG("I/O error while writing log");
+                return;
+            }
+            log_dirty_ = true;
+            log_end_offset_ += ret;
+            written += ret;
+        }
+        // 当前segment写过阈值后在后台准备下一个segment，换segment时不用等zero-fill
+        int64_t next = log_write_segment_ + 1;
+        if (log_prealloc_segment_ < next &&
+            log_end_offset_ - log_write_segment_ * log_segment_size_ >=
+            log_segment_size_ * LOG_PREALLOCATE_PERCENT / 100)
+            PrepareLogSegmentAsync(next, log_segment_size_);
+        flush_log_ = false;
+    }
 
-        // check for I/O error
-        if (log_io_.bad()) {
-            LOG_DEBUG("I/O error while writing log");
+/**
+ * Zero-fill the segment the log ends in, in the background. Called when
+ * logging starts so that the first WriteLog does not wait for it either
+ */
+    void DiskManager::PrepareLog() {
+        std::lock_guard<std::mutex> lock(log_latch_);
+        int64_t segment = log_end_offset_ / log_segment_size_;
+        if (log_write_segment_ < 0 && log_prealloc_segment_ < segment)
+            PrepareLogSegmentAsync(segment, log_end_offset_ % log_segment_size_);
+    }
+
+/**
+ * Make the log written so far durable. The segment files never change size
+ * after they are zero-filled, so fdatasync skips the inode update and
+ * several WriteLog calls share one sync
+ */
+    void DiskManager::SyncLog() {
+        std::lock_guard<std::mutex> lock(log_latch_);
+        if (!log_dirty_)
             return;
+        num_flushes_ += 1;
+        if (fdatasync(log_fd_) != 0) {
+            LOG_DEBUG("I/O error while syncing log");
         }
-        // needs to flush to keep disk file in sync
-        log_io_.flush();
-        flush_log_ = false;
+        log_dirty_ = false;
     }
 
 /**
  * Read the contents of the log into the given memory area
- * Always read from the beginning and perform sequence read
- * @return: false means already reach the end
+ * Perform sequence read from offset, across segment files if needed
+ * @return: false means offset is before the truncated part or already reach
+ * the end
  */
-    bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-        if (offset >= GetFileSize(log_name_)) {
+    bool DiskManager::ReadLog(char *log_data, int size, int64_t offset) {
+        std::lock_guard<std::mutex> lock(log_latch_);
+        if (offset < log_start_offset_ || offset >= log_end_offset_) {
             // LOG_DEBUG("end of log file");
-            // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
             return false;
         }
-        log_io_.seekp(offset);
-        log_io_.read(log_data, size);
-        // if log file ends before reading "size"
-        int read_count = log_io_.gcount();
-        if (read_count < size) {
-            log_io_.clear();
+        int read_count = ReadLogSegments(
+                log_data,
+                static_cast<int>(std::min<int64_t>(size, log_end_offset_ - offset)),
+                offset);
+        // if log ends before reading "size"
+        if (read_count < size)
             memset(log_data + read_count, 0, size - read_count);
-        }
 
         return true;
     }
 
+/**
+ * read up to size bytes at offset from the segment files, caller holds
+ * log_latch_ and checks the log bounds
+ * @return: number of bytes read, less than size if a segment file ends early
+ */
+    int DiskManager::ReadLogSegments(char *log_data, int size, int64_t offset) {
+        int read_count = 0;
+        while (read_count < size) {
+            int64_t segment = offset / log_segment_size_;
+            int64_t segment_offset = offset % log_segment_size_;
+            // the segment may not have existed when it was opened last
+            if (segment != log_read_segment_ || !log_read_io_.is_open()) {
+                log_read_io_.close();
+                log_read_io_.clear();
+                log_read_io_.open(GetLogSegmentName(segment), std::ios::binary);
+                log_read_segment_ = segment;
+            }
+            int count = static_cast<int>(std::min<int64_t>(
+                    size - read_count, log_segment_size_ - segment_offset));
+            log_read_io_.seekg(segment_offset);
+            log_read_io_.read(log_data + read_count, count);
+            int got = log_read_io_.gcount();
+            log_read_io_.clear();
+            read_count += got;
+            offset += got;
+            if (got < count)
+                break;
+        }
+        return read_count;
+    }
+
+/**
+ * walk the records from the log start, the log ends before the first one
+ * whose LSN is not its offset or that runs past the last segment file.
+ * There are no checksums, a crash tearing a record behind its header goes
+ * unnoticed
+ */
+    int64_t DiskManager::FindLogEnd() {
+        std::vector<char> chunk(LOG_READ_BUFFER_SIZE);
+        int64_t offset = log_start_offset_;
+        int64_t chunk_offset = offset;
+        int chunk_size = 0;
+        while (true) {
+            if (offset + LOG_RECORD_HEADER_SIZE > chunk_offset + chunk_size) {
+                chunk_offset = offset;
+                chunk_size = ReadLogSegments(chunk.data(), chunk.size(), offset);
+                if (chunk_size < LOG_RECORD_HEADER_SIZE)
+                    break;
+            }
+            // | size(4) | LSN(8) | ...
+            const char *header = chunk.data() + (offset - chunk_offset);
+            int32_t size;
+            lsn_t lsn;
+            memcpy(&size, header, sizeof(int32_t));
+            memcpy(&lsn, header + sizeof(int32_t), sizeof(lsn_t));
+            if (size < LOG_RECORD_HEADER_SIZE || lsn != offset)
+                break;
+            char last;
+            if (offset + size > chunk_offset + chunk_size &&
+                ReadLogSegments(&last, 1, offset + size - 1) != 1)
+                break;
+            offset += size;
+        }
+        return offset;
+    }
+
+/**
+ * Log before offset is no longer needed by recovery. offset must be a record
+ * boundary, it becomes the log start and the segments lying entirely before
+ * it are dropped. The anchor moves first so a crash never leaves it pointing
+ * at a missing segment. Up to LOG_RECYCLED_SEGMENTS truncated files are
+ * renamed to become the next segments instead of being deleted, they keep
+ * their blocks and need no zero-fill.
+ */
+    void DiskManager::TruncateLog(int64_t offset) {
+        std::lock_guard<std::mutex> lock(log_latch_);
+        // the spare segments below must not be created behind its back
+        if (log_prealloc_f_.valid())
+            log_prealloc_f_.get();
+        offset = std::min(offset, log_end_offset_.load());
+        if (offset <= log_start_offset_)
+            return;
+        int64_t first = log_start_offset_ / log_segment_size_;
+        int64_t last = offset / log_segment_size_;
+        int64_t start_offset = log_start_offset_;
+        log_start_offset_ = offset;
+        // 新的anchor持久化之前不能动任何segment
+        if (!WriteLogAnchor()) {
+            log_start_offset_ = start_offset;
+            return;
+        }
+        if (last <= first)
+            return;
+        if (log_read_segment_ < last) {
+            log_read_io_.close();
+            log_read_segment_ = -1;
+        }
+
+        // 已经回收的空segment文件排在当前segment之后
+        int64_t spare = log_end_offset_ / log_segment_size_ + 1;
+        int recycled = 0;
+        while (GetFileSize(GetLogSegmentName(spare)) >= 0) {
+            spare++;
+            recycled++;
+        }
+        for (int64_t segment = first; segment < last; segment++) {
+            std::string name = GetLogSegmentName(segment);
+            if (recycled < LOG_RECYCLED_SEGMENTS) {
+                std::string spare_name = GetLogSegmentName(spare++);
+                if (std::rename(name.c_str(), spare_name.c_str()) == 0) {
+                    recycled++;
+                    continue;
+                }
+            }
+            std::remove(name.c_str());
+        }
+    }
+
+/**
+ * name of the file holding log segment "segment"
+ */
+    std::string DiskManager::GetLogSegmentName(int64_t segment) const {
+        return log_name_ + "." + std::to_string(segment);
+    }
+
+/**
+ * switch log_fd_ to the segment containing log_end_offset_, the previous one
+ * is synced first since SyncLog only covers log_fd_. The segment is normally
+ * prepared in the background already, otherwise it is prepared here: the
+ * first segment opened has the bytes behind the log end zeroed, they may hold
+ * an append torn by a crash, which must not turn into records once later
+ * appends line up with it.
+ */
+    void DiskManager::OpenLogSegment(int64_t segment) {
+        if (log_fd_ >= 0) {
+            if (log_dirty_ && fdatasync(log_fd_) != 0) {
+                LOG_DEBUG("I/O error while syncing log");
+            }
+            close(log_fd_);
+        }
+        log_dirty_ = false;
+        if (log_prealloc_f_.valid())
+            log_prealloc_f_.get();
+        if (segment > log_prealloc_segment_) {
+            PrepareLogSegment(segment, log_write_segment_ < 0
+                                       ? log_end_offset_ % log_segment_size_
+                                       : log_segment_size_);
+            log_prealloc_segment_ = segment;
+        }
+        log_fd_ = open(GetLogSegmentName(segment).c_str(), O_WRONLY | O_CREAT,
+                       0644);
+        log_write_segment_ = segment;
+        if (log_fd_ < 0) {
+            LOG_DEBUG("can't open log segment");
+        }
+    }
+
+/**
+ * start PrepareLogSegment in the background, caller holds log_latch_ and
+ * waits for it before using or truncating the segment files
+ */
+    void DiskManager::PrepareLogSegmentAsync(int64_t segment, int64_t from) {
+        if (log_prealloc_f_.valid())
+            log_prealloc_f_.get();
+        log_prealloc_segment_ = segment;
+        log_prealloc_f_ = std::async(std::launch::async,
+                                     &DiskManager::PrepareLogSegment, this,
+                                     segment, from);
+    }
+
+/**
+ * Zero-fill segment file "segment" from offset "from" (at most from its
+ * current size) to the segment size and sync it, so appends never extend
+ * the file. Recycled files are used as they are, no old record has its
+ * offset as LSN.
+ */
+    void DiskManager::PrepareLogSegment(int64_t segment, int64_t from) {
+        std::string name = GetLogSegmentName(segment);
+        int size = GetFileSize(name);
+        from = std::min<int64_t>(from, std::max(size, 0));
+        if (from >= log_segment_size_)
+            return;
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            LOG_DEBUG("can't open log segment");
+            return;
+        }
+        ZeroFillLogSegment(fd, from);
+        close(fd);
+        if (size < 0) {
+            // the new directory entry has to survive a crash as well
+            int dir_fd = open(GetLogDirectory().c_str(), O_RDONLY);
+            if (dir_fd >= 0) {
+                fsync(dir_fd);
+                close(dir_fd);
+            }
+        }
+    }
+
+/**
+ * write zeros over [from, segment size) of fd and sync, the blocks are
+ * allocated before any append reaches them
+ */
+    void DiskManager::ZeroFillLogSegment(int fd, int64_t from) {
+        std::vector<char> zeros(
+                static_cast<size_t>(std::min<int64_t>(1 << 20, log_segment_size_)));
+        while (from < log_segment_size_) {
+            ssize_t ret = pwrite(fd, zeros.data(),
+                                 std::min<int64_t>(zeros.size(),
+                                                   log_segment_size_ - from),
+                                 from);
+            if (ret <= 0) {
+                LOG_DEBUG("I/O error while preallocating log");
+                return;
+            }
+            from += ret;
+        }
+        if (fdatasync(fd) != 0) {
+            LOG_DEBUG("I/O error while syncing log");
+        }
+    }
+
+/**
+ * directory holding the log files, with a trailing '/'
+ */
+    std::string DiskManager::GetLogDirectory() const {
+        std::string::size_type n = log_name_.rfind('/');
+        return n == std::string::npos ? "./" : log_name_.substr(0, n + 1);
+    }
+
+/**
+ * persist log start offset and segment size, write a temporary file and
+ * rename it so the anchor is replaced atomically. The temporary file is
+ * synced before the rename and the log directory after it, so once this
+ * returns a crash finds the new anchor
+ * @return: false if the anchor could not be made durable
+ */
+    bool DiskManager::WriteLogAnchor() {
+        std::string tmp_name = log_name_ + ".tmp";
+        int fd = open(tmp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            LOG_DEBUG("can not create log anchor");
+            return false;
+        }
+        int64_t header[2] = {log_start_offset_.load(), log_segment_size_};
+        bool synced =
+                write(fd, header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) &&
+                fsync(fd) == 0;
+        close(fd);
+        if (!synced || std::rename(tmp_name.c_str(), log_name_.c_str()) != 0) {
+            LOG_DEBUG("can not write log anchor");
+            return false;
+        }
+
+        // the rename is durable only once the directory entry is
+        int dir_fd = open(GetLogDirectory().c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd < 0)
+            return false;
+        synced = fsync(dir_fd) == 0;
+        close(dir_fd);
+        return synced;
+    }
+
+/**
+ * remove all segment files of log_name_, they belong to a discarded log
+ */
+    void DiskManager::RemoveLogSegments() {
+        std::string::size_type n = log_name_.rfind('/');
+        std::string dir = GetLogDirectory();
+        std::string prefix = (n == std::string::npos ? log_name_
+                                                      : log_name_.substr(n + 1)) + ".";
+        DIR *dirp = opendir(dir.c_str());
+        if (dirp == nullptr)
+            return;
+        struct dirent *entry;
+        while ((entry = readdir(dirp)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) == 0 &&
+                name.find_first_not_of("0123456789", prefix.size()) ==
+                std::string::npos)
+                std::remove((n == std::string::npos ? name : dir + name).c_str());
+        }
+        closedir(dirp);
+    }
+
 /**
  * Allocate new page (operations like create index/table)
  * For now just keep an increasing counter
  */
     page_id_t DiskManager::AllocatePage() { return next_page_id_++; }
 
+    void DiskManager::MarkAllocated(page_id_t page_id) {
+        page_id_t next = next_page_id_;
+        while (next <= page_id &&
+               !next_page_id_.compare_exchange_weak(next, page_id + 1));
+    }
+
 /**
  * Deallocate page (operations like drop index/table)
  * Need bitmap in header page for tracking pages
@@ -172,10 +535,15 @@ namespace cmudb {
     }
 
 /**
- * Returns number of flushes made so far
+ * Returns number of log syncs made so far
  */
     int DiskManager::GetNumFlushes() const { return num_flushes_; }
 
+/**
+ * Returns number of page reads made so far
+ */
+    int DiskManager::GetNumReads() const { return num_reads_; }
+
 /**
  * Returns true if the log is currently being flushed
  */
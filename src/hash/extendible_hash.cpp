@@ -1,5 +1,8 @@
 #include <list>
 #include <functional>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 #include "hash/extendible_hash.h"
 #include "page/page.h"
 
@@ -11,7 +14,8 @@ namespace cmudb {
  */
     template<typename K, typename V>
     ExtendibleHash<K, V>::ExtendibleHash(size_t size):global_depth_(0), bucket_size_(size) {
-        address_table_.emplace_back(new Bucket(0));
+        // 多预留一个slot: 插入后记录数超过bucket_size_才执行split
+        address_table_.emplace_back(new Bucket(0, bucket_size_ + 1));
         bucket_count_ = 1;
     }
 
@@ -29,8 +33,10 @@ namespace cmudb {
  */
     template<typename K, typename V>
     int ExtendibleHash<K, V>::GetGlobalDepth() const {
-
-        return global_depth_;
+        directory_latch_.RLock();
+        int depth = global_depth_;
+        directory_latch_.RUnlock();
+        return depth;
     }
 
 /*
@@ -39,9 +45,12 @@ namespace cmudb {
  */
     template<typename K, typename V>
     int ExtendibleHash<K, V>::GetLocalDepth(int bucket_id) const {
+        int depth = -1;
+        directory_latch_.RLock();
         if (address_table_[bucket_id])
-            return address_table_[bucket_id]->local_depth;
-        return -1;
+            depth = address_table_[bucket_id]->local_depth;
+        directory_latch_.RUnlock();
+        return depth;
     }
 
 /*
@@ -49,7 +58,10 @@ namespace cmudb {
  */
     template<typename K, typename V>
     int ExtendibleHash<K, V>::GetNumBuckets() const {
-        return bucket_count_;
+        directory_latch_.RLock();
+        int count = bucket_count_;
+        directory_latch_.RUnlock();
+        return count;
     }
 
 /*
@@ -57,39 +69,116 @@ namespace cmudb {
  */
     template<typename K, typename V>
     bool ExtendibleHash<K, V>::Find(const K &key, V &value) {
-        //int global_depth = GetGlobalDepth();
-        std::lock_guard<std::mutex> lock(mutex_);
+        bool found = false;
+        directory_latch_.RLock();
         size_t slot = key_index(key, global_depth_);
-        auto bucket = address_table_[slot];
+        auto &bucket = address_table_[slot];
         if (bucket) {
-            if (bucket->records.find(key) != bucket->records.end()) {
-                value = bucket->records[key];
-                return true;
+            std::lock_guard<std::mutex> bucket_lock(bucket->latch);
+            int rec = probe(*bucket, key);
+            if (rec >= 0) {
+                value = bucket->slots[rec].second;
+                found = true;
             }
         }
-        return false;
+        directory_latch_.RUnlock();
+        return found;
     }
 
 /*
  * delete <key,value> entry in hash table
- * Shrink & Combination is not required for this project
+ * Merge the bucket with its buddy & halve the directory when the bucket
+ * becomes sparse
  */
     template<typename K, typename V>
     bool ExtendibleHash<K, V>::Remove(const K &key) {
-        //int global_depth = GetGlobalDepth();
-        std::lock_guard<std::mutex> lock(mutex_);
+        bool removed = false;
+        bool need_merge = false;
+        directory_latch_.RLock();
         size_t slot = key_index(key, global_depth_);
 
-        auto bucket = address_table_[slot];
+        auto &bucket = address_table_[slot];
 
         if (bucket) {
-            auto rec = bucket->records.find(key);
-            if (rec == bucket->records.end())
-                return false;
-            bucket->records.erase(rec);
-            return true;
+            /*
+             * 判断key是否存在同erase必须在同一把桶锁内完成
+             */
+            std::lock_guard<std::mutex> bucket_lock(bucket->latch);
+            int rec = probe(*bucket, key);
+            if (rec >= 0) {
+                erase(*bucket, rec);
+                removed = true;
+                need_merge = bucket->local_depth > 0 && bucket->size <= merge_threshold();
+            }
+        }
+        directory_latch_.RUnlock();
+
+        /*
+         * 同split一样，合并桶以及收缩目录需要持有目录写锁
+         */
+        if (need_merge) {
+            directory_latch_.WLock();
+            merge(key_index(key, global_depth_));
+            directory_latch_.WUnlock();
+        }
+        return removed;
+    }
+
+/*
+ * merge the bucket at directory slot with its buddy, caller must hold
+ * directory_latch_ in write mode
+ * buddy是local_depth相同、哈希值只在第local_depth位不同的桶；两者记录数之和
+ * 不超过merge_threshold()才合并，合并后的桶至少还要再插入bucket_size_/2条记录
+ * 才会重新split，避免在split和merge之间来回震荡
+ * 合并可以逐层向上进行，最后当所有桶的local_depth都小于global_depth时目录减半
+ */
+    template<typename K, typename V>
+    void ExtendibleHash<K, V>::merge(size_t slot) {
+        auto bucket = address_table_[slot];
+        while (bucket && bucket->local_depth > 0) {
+            int depth = bucket->local_depth;
+            size_t buddy_index = slot ^ (1 << (depth - 1));
+            auto buddy = address_table_[buddy_index];
+            /*
+             * 目录扩容后可能留下空slot，空slot相当于local_depth == global_depth的空桶
+             */
+            if (!buddy) {
+                if (depth != global_depth_)
+                    break;
+            } else if (buddy == bucket || buddy->local_depth != depth ||
+                       bucket->size + buddy->size > merge_threshold()) {
+                break;
+            } else {
+                // buddy的记录全部搬进bucket，merge_threshold() < capacity保证不会越界
+                for (size_t i = 0; i < buddy->size; i++) {
+                    bucket->fingerprints[bucket->size] = buddy->fingerprints[i];
+                    bucket->slots[bucket->size] = std::move(buddy->slots[i]);
+                    bucket->size++;
+                }
+                --bucket_count_;
+            }
+            bucket->local_depth--;
+            // 原来指向buddy的slot全部改为指向bucket
+            int stride = 1 << bucket->local_depth;
+            for (size_t i = slot & (stride - 1); i < address_table_.size(); i += stride) {
+                address_table_[i] = bucket;
+            }
+        }
+
+        /*
+         * 前一半目录与后一半目录逐项指向相同的桶，说明所有桶的local_depth < global_depth
+         */
+        while (global_depth_ > 0) {
+            size_t half = address_table_.size() / 2;
+            size_t i = 0;
+            while (i < half && address_table_[i] == address_table_[i + half])
+                i++;
+            if (i < half)
+                break;
+            address_table_.resize(half);
+            address_table_.shrink_to_fit();
+            global_depth_--;
         }
-        return false;
     }
 
 /*
@@ -101,6 +190,79 @@ namespace cmudb {
         return HashKey(key) & ((1 << local_depth) - 1);
     }
 
+/*
+ * 1-byte digest of the hash value stored next to each record
+ * 低位哈希已用于寻址(同一个桶内低local_depth位相同)，所以乘法散列后取最高字节
+ */
+    template<typename K, typename V>
+    uint8_t ExtendibleHash<K, V>::fingerprint(size_t hash) {
+        return static_cast<uint8_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> 56);
+    }
+
+/*
+ * return the slot of key inside bucket, -1 if not found
+ * 每次比较PROBE_WIDTH个fingerprint，得到命中位图后再逐个比较key
+ */
+    template<typename K, typename V>
+    int ExtendibleHash<K, V>::probe(const Bucket &bucket, const K &key) {
+        const uint8_t fp = fingerprint(HashKey(key));
+        const uint8_t *fps = bucket.fingerprints.data();
+        for (size_t base = 0; base < bucket.size; base += PROBE_WIDTH) {
+            uint32_t mask;
+#if defined(__AVX2__)
+            __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fps + base));
+            mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(group, _mm256_set1_epi8(static_cast<char>(fp)))));
+#elif defined(__SSE2__)
+            __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(fps + base));
+            mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(fp)))));
+#else
+            mask = 0;
+            for (int i = 0; i < PROBE_WIDTH; i++) {
+                if (fps[base + i] == fp)
+                    mask |= 1u << i;
+            }
+#endif
+            // 屏蔽[size, base + PROBE_WIDTH)之间的空slot
+            size_t remain = bucket.size - base;
+            if (remain < PROBE_WIDTH)
+                mask &= (1u << remain) - 1;
+            while (mask) {
+                int i = __builtin_ctz(mask);
+                if (bucket.slots[base + i].first == key)
+                    return static_cast<int>(base + i);
+                mask &= mask - 1;
+            }
+        }
+        return -1;
+    }
+
+/*
+ * append <key,value> at the end of bucket, caller guarantees size < capacity
+ */
+    template<typename K, typename V>
+    void ExtendibleHash<K, V>::append(Bucket &bucket, const K &key, const V &value) {
+        bucket.fingerprints[bucket.size] = fingerprint(HashKey(key));
+        bucket.slots[bucket.size].first = key;
+        bucket.slots[bucket.size].second = value;
+        bucket.size++;
+    }
+
+/*
+ * remove slot from bucket, 用最后一条记录填补空洞，保持记录紧凑
+ */
+    template<typename K, typename V>
+    void ExtendibleHash<K, V>::erase(Bucket &bucket, int slot) {
+        size_t last = bucket.size - 1;
+        if (static_cast<size_t>(slot) != last) {
+            bucket.fingerprints[slot] = bucket.fingerprints[last];
+            bucket.slots[slot] = std::move(bucket.slots[last]);
+        }
+        bucket.fingerprints[last] = 0;
+        bucket.size--;
+    }
+
 /*
  * split bucket
  */
@@ -108,25 +270,30 @@ namespace cmudb {
     std::shared_ptr<typename ExtendibleHash<K, V>::Bucket>
     ExtendibleHash<K, V>::split(std::shared_ptr<Bucket> &bucket) {
         int depth = bucket->local_depth;
-        auto new_bucket = std::make_shared<Bucket>(depth);
-        while (new_bucket->records.empty()) {
+        auto new_bucket = std::make_shared<Bucket>(depth, bucket_size_ + 1);
+        while (new_bucket->size == 0) {
 
             bucket->local_depth++;
             new_bucket->local_depth++;
-            for (auto it = bucket->records.begin(); it != bucket->records.end();) {
-                K key = it->first;
+            for (size_t i = 0; i < bucket->size;) {
+                const K &key = bucket->slots[i].first;
                 /*注意 此处bucket->local_depth长度已经增加，比如如果原来长度为0，
                  * 现在为1，表明将bucket中元素按照hash值最后1bit是0还是1重新分配
                  * 注意判断bit是0还是1是 & ( 1<< (bucket->local_depth - 1) )
+                 * erase会把最后一条记录移到slot i，所以移走后不递增i
                  */
                 if (HashKey(key) & (1 << (bucket->local_depth - 1))) {
-                    new_bucket->records.insert(*it);
-                    it = bucket->records.erase(it);
+                    new_bucket->fingerprints[new_bucket->size] = bucket->fingerprints[i];
+                    new_bucket->slots[new_bucket->size] = std::move(bucket->slots[i]);
+                    new_bucket->size++;
+                    erase(*bucket, i);
                 } else
-                    it++;
+                    i++;
             }
-            if (bucket->records.empty()) {
-                std::swap(bucket->records, new_bucket->records);
+            if (bucket->size == 0) {
+                std::swap(bucket->fingerprints, new_bucket->fingerprints);
+                std::swap(bucket->slots, new_bucket->slots);
+                std::swap(bucket->size, new_bucket->size);
             }
         }
         ++bucket_count_;
@@ -140,24 +307,59 @@ namespace cmudb {
  */
     template<typename K, typename V>
     void ExtendibleHash<K, V>::Insert(const K &key, const V &value) {
-        std::lock_guard<std::mutex> lock(mutex_);
+        /*
+         * 快速路径：持有目录读锁和桶锁，key已存在或者桶未满时直接写入桶内
+         * 否则释放读锁，重新以写锁进入，执行split
+         */
+        directory_latch_.RLock();
+        size_t slot = key_index(key, global_depth_);
+        auto &bucket = address_table_[slot];
+        if (bucket) {
+            std::unique_lock<std::mutex> bucket_lock(bucket->latch);
+            int rec = probe(*bucket, key);
+            if (rec >= 0) {
+                bucket->slots[rec].second = value;
+                bucket_lock.unlock();
+                directory_latch_.RUnlock();
+                return;
+            }
+            if (bucket->size < bucket_size_) {
+                append(*bucket, key, value);
+                bucket_lock.unlock();
+                directory_latch_.RUnlock();
+                return;
+            }
+        }
+        directory_latch_.RUnlock();
+
+        directory_latch_.WLock();
+        insert_exclusive(key, value);
+        directory_latch_.WUnlock();
+    }
 
+/*
+ * slow path of Insert, caller must hold directory_latch_ in write mode
+ * 读锁释放到写锁获取之间目录可能已经改变，所以重新计算slot
+ */
+    template<typename K, typename V>
+    void ExtendibleHash<K, V>::insert_exclusive(const K &key, const V &value) {
         size_t slot = key_index(key, global_depth_);
 
         if (!address_table_[slot]) {
-            address_table_[slot] = std::make_shared<Bucket>(global_depth_);
+            address_table_[slot] = std::make_shared<Bucket>(global_depth_, bucket_size_ + 1);
             bucket_count_++;
         }
         auto bucket = address_table_[slot];
-        if (bucket->records.find(key) != bucket->records.end()) {
-            bucket->records[key] = value;
+        int rec = probe(*bucket, key);
+        if (rec >= 0) {
+            bucket->slots[rec].second = value;
             return;
         }
-        bucket->records.insert({key, value});
+        append(*bucket, key, value);
         /*
-         * 桶的records容量超过桶的限制 执行split 并redistribute bucket的分布
+         * 桶的记录数超过桶的限制 执行split 并redistribute bucket的分布
          */
-        if (bucket->records.size() > bucket_size_) {
+        if (bucket->size > bucket_size_) {
             int old_depth = bucket->local_depth;
             std::shared_ptr<Bucket> new_bucket = split(bucket);
             /*
@@ -166,8 +368,8 @@ namespace cmudb {
             */
             int local_depth = bucket->local_depth;
 
-            K bucket_key = bucket->records.begin()->first;
-            K newbucket_key = new_bucket->records.begin()->first;
+            K bucket_key = bucket->slots[0].first;
+            K newbucket_key = new_bucket->slots[0].first;
             size_t bucket_index = key_index(bucket_key, local_depth);
             size_t newbucket_index = key_index(newbucket_key, local_depth);
 
@@ -236,7 +438,7 @@ namespace cmudb {
                 }
 
             }// end if (local_depth <= global_depth) {} else {}
-        }//end if (bucket->records.size() > bucket_size_)
+        }//end if (bucket->size > bucket_size_)
     }
 
 /*
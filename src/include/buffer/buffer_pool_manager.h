@@ -9,6 +9,7 @@
 #pragma once
 #include <list>
 #include <mutex>
+#include <unordered_map>
 
 #include "buffer/lru_replacer.h"
 #include "disk/disk_manager.h"
@@ -34,7 +35,15 @@ public:
 
   bool DeletePage(page_id_t page_id);
 
+  inline size_t GetPoolSize() { return pool_size_; }
+
+  // dirty page table for checkpoint, page id -> recLSN of every dirty page
+  std::unordered_map<page_id_t, lsn_t> GetDirtyPageTable();
+
 private:
+  // remember the earliest lsn that may modify a page about to be pinned
+  void NoteRecLSN(Page *page);
+
   size_t pool_size_; // number of pages in buffer pool
   Page *pages_;      // array of pages
   DiskManager *disk_manager_;
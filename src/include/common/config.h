@@ -8,26 +8,70 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 
 namespace cmudb {
 
 extern std::chrono::duration<long long int> LOG_TIMEOUT;
 
+// target latency of a group commit, the flush thread never delays a waiting
+// commit longer than this (bounded by LOG_TIMEOUT)
+extern std::chrono::microseconds GROUP_COMMIT_LATENCY_SLO;
+
 extern std::atomic<bool> ENABLE_LOGGING;
 
+// size of one log segment file in byte, the log is split into files of this
+// size so that segments before the last checkpoint can be dropped
+extern int64_t LOG_SEGMENT_FILE_SIZE;
+
+// lock waits longer than this abort the waiting transaction, zero waits
+// until the lock is granted or a deadlock is broken
+extern std::chrono::milliseconds LOCK_WAIT_TIMEOUT;
+
+// period of the waits-for graph deadlock detector
+extern std::chrono::milliseconds DEADLOCK_DETECTION_INTERVAL;
+
+// a transaction holding this many tuple locks on one page, or this many locks
+// in one table, has them escalated to a single page or table lock. Zero never
+// escalates
+extern size_t LOCK_ESCALATION_PAGE_THRESHOLD;
+extern size_t LOCK_ESCALATION_TABLE_THRESHOLD;
+
+// period of the mvcc garbage collector, it drops versions no snapshot sees
+extern std::chrono::milliseconds VERSION_GC_INTERVAL;
+
+// period of the checkpoint thread, a checkpoint bounds recovery time and lets
+// the log before it be truncated
+extern std::chrono::milliseconds CHECKPOINT_INTERVAL;
+
 #define INVALID_PAGE_ID -1 // representing an invalid page id
 #define INVALID_TXN_ID -1  // representing an invalid txn id
 #define INVALID_LSN -1     // representing an invalid lsn
+#define INVALID_TIMESTAMP -1 // representing an invalid mvcc timestamp
+#define MAX_TIMESTAMP INT64_MAX // timestamp of versions not yet committed
 #define HEADER_PAGE_ID 0   // the header page id
 #define PAGE_SIZE 512     // size of a data page in byte
 #define LOG_BUFFER_SIZE                                                            \
   ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE) // size of a log buffer in byte
+#define LOG_BUFFER_SEGMENTS 4          // number of log buffers in the ring
+#define LOG_RECYCLED_SEGMENTS 2        // truncated log files kept for reuse
+#define LOG_PREALLOCATE_PERCENT 50     // fill of a log file preparing the next
+#define LOG_READ_BUFFER_SIZE (1 << 20) // size of a recovery read ahead buffer
+#define RECOVERY_REDO_THREADS 4        // worker threads applying redo records
+#define RECOVERY_PREFETCH_DEPTH 64     // pages prefetched ahead of redo
+#define LOCK_TABLE_PARTITIONS 64       // independently latched lock table parts
+#define LOCK_TABLE_PARTITION_BUCKETS 64 // hash buckets reserved per partition
+#define LOCK_REQUEST_POOL_SIZE 256     // free lock requests kept per thread
+#define LOCK_QUEUE_POOL_SIZE 64        // empty request queues kept per partition
+#define VERSION_STORE_PARTITIONS 16    // independently latched version chains
+#define CACHE_LINE_SIZE 64             // alignment of data latched separately
 #define BUCKET_SIZE 50                 // size of extendible hash Bucket
 #define BUFFER_POOL_SIZE 10            // size of buffer pool
 
 typedef int32_t page_id_t; // page id type
 typedef int32_t txn_id_t;  // transaction id type
-typedef int32_t lsn_t;     // log sequence number type
+typedef int64_t lsn_t;     // log sequence number type, byte offset in log
+typedef int64_t timestamp_t; // mvcc commit and snapshot timestamp type
 
 } // namespace cmudb
\ No newline at end of file
@@ -1,91 +1,463 @@
 /**
  * lock_manager.h
  *
- * Tuple level lock manager, use wait-die to prevent deadlocks
+ * Multi-granularity lock manager for tables, pages and tuples. Deadlocks are
+ * prevented by wait-die or wound-wait, or detected on a waits-for graph, see
+ * DeadlockPolicy
  */
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <condition_variable>
-#include <list>
+#include <cstddef>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "common/rid.h"
 #include "concurrency/transaction.h"
 
 namespace cmudb {
+    /*
+     * UPGRADING只用于请求把持有的SHARED转换为EXCLUSIVE。
+     * IS/IX加在table和page上，表示事务会在其下层加S/X锁，SIX = S + IX
+     */
     enum class LockMode {
-        SHARED = 0, UPGRADING, EXCLUSIVE
+        SHARED = 0, UPGRADING, EXCLUSIVE,
+        INTENTION_SHARED, INTENTION_EXCLUSIVE, SHARED_INTENTION_EXCLUSIVE
     };
 
+    /*
+     * whether two transactions may hold a and b on the same item
+     *          IS   IX   S    SIX  X
+     *     IS   y    y    y    y    n
+     *     IX   y    y    n    n    n
+     *     S    y    n    y    n    n
+     *     SIX  y    n    n    n    n
+     *     X    n    n    n    n    n
+     */
+    inline bool LockModeCompatible(LockMode a, LockMode b) {
+        auto bit = [](LockMode mode) { return 1 << static_cast<int>(mode); };
+        int compatible = 0;
+        switch (a) {
+            case LockMode::INTENTION_SHARED:
+                compatible = bit(LockMode::INTENTION_SHARED) |
+                             bit(LockMode::INTENTION_EXCLUSIVE) |
+                             bit(LockMode::SHARED) |
+                             bit(LockMode::SHARED_INTENTION_EXCLUSIVE);
+                break;
+            case LockMode::INTENTION_EXCLUSIVE:
+                compatible = bit(LockMode::INTENTION_SHARED) |
+                             bit(LockMode::INTENTION_EXCLUSIVE);
+                break;
+            case LockMode::SHARED:
+                compatible = bit(LockMode::INTENTION_SHARED) | bit(LockMode::SHARED);
+                break;
+            case LockMode::SHARED_INTENTION_EXCLUSIVE:
+                compatible = bit(LockMode::INTENTION_SHARED);
+                break;
+            default:
+                break;
+        }
+        return (compatible & bit(b)) != 0;
+    }
+
+    // whether holding held already grants everything wanted would
+    inline bool LockModeCovers(LockMode held, LockMode wanted) {
+        if (held == wanted || held == LockMode::EXCLUSIVE)
+            return true;
+        switch (held) {
+            case LockMode::SHARED_INTENTION_EXCLUSIVE:
+                return wanted != LockMode::EXCLUSIVE && wanted != LockMode::UPGRADING;
+            case LockMode::SHARED:
+            case LockMode::INTENTION_EXCLUSIVE:
+                return wanted == LockMode::INTENTION_SHARED;
+            default:
+                return false;
+        }
+    }
+
+    // weakest mode covering both, what a lock held in a and requested in b
+    // is converted to
+    inline LockMode LockModeSupremum(LockMode a, LockMode b) {
+        if (b == LockMode::UPGRADING)
+            b = LockMode::EXCLUSIVE;
+        if (LockModeCovers(a, b))
+            return a;
+        if (LockModeCovers(b, a))
+            return b;
+        // S and IX
+        return LockMode::SHARED_INTENTION_EXCLUSIVE;
+    }
+
+    /*
+     * transaction id is the timestamp, a smaller id is an older transaction
+     * WAIT_DIE: 比等待对象年轻的请求者直接abort，年老的等待
+     * WOUND_WAIT: 年老的请求者abort(wound)比它年轻的持有者和等待者，年轻的等待
+     * DETECTION: 总是等待，后台线程周期性地在waits-for graph中找环并abort环中最年轻的事务
+     */
+    enum class DeadlockPolicy {
+        WAIT_DIE = 0, WOUND_WAIT, DETECTION
+    };
+
+    /*
+     * order in which waiting requests are granted, conversions always first
+     * FIFO: arrival order
+     * AGE: oldest transaction first (VATS), it has waited longest overall
+     * LOCKS_HELD: transaction holding most locks first, it blocks most others
+     * PRIORITY: highest Transaction::GetPriority() first
+     * ties are broken by arrival order
+     */
+    enum class GrantPolicy {
+        FIFO = 0, AGE, LOCKS_HELD, PRIORITY
+    };
+
+    // contention on one rid, from LockManager::GetContention
+    struct LockContention {
+        void Merge(const LockContention &other) {
+            num_requests += other.num_requests;
+            num_waits += other.num_waits;
+            total_wait_us += other.total_wait_us;
+            max_wait_us = std::max(max_wait_us, other.max_wait_us);
+            max_queue_length = std::max(max_queue_length, other.max_queue_length);
+        }
+
+        uint64_t num_requests = 0;
+        // requests that could not be granted at once
+        uint64_t num_waits = 0;
+        uint64_t total_wait_us = 0;
+        uint64_t max_wait_us = 0;
+        size_t max_queue_length = 0;
+    };
+
+    // lock manager aborts by cause, snapshot from LockManager::GetAbortMetrics
+    struct LockAbortMetrics {
+        // wait-die: requests that died instead of waiting for an older txn
+        uint64_t num_died = 0;
+        // wound-wait: younger transactions wounded by an older requester
+        uint64_t num_wounded = 0;
+        // waits-for cycles broken by aborting their youngest transaction
+        uint64_t num_deadlock_victims = 0;
+        // waits longer than the lock wait timeout
+        uint64_t num_timeouts = 0;
+    };
+
+    /*
+     * one per thread, a blocked lock request parks its thread on it. Waiting
+     * needs no condition variable per request
+     */
+    struct Parker {
+        // parker of the calling thread
+        static Parker &Current();
+
+        std::mutex latch_;
+        std::condition_variable cv_;
+    };
+
+    /*
+     * lock request, a node of the intrusive list of its RequestQueue. Nodes
+     * are recycled through a free list of the thread releasing them, so a
+     * lock does no heap allocation once the pools are warm
+     */
     struct Request {
 
-        //Request(Request &) = delete;
+        Request(const Request &) = delete;
+
+        Request &operator=(const Request &) = delete;
+
+        // from the free list of the calling thread, new if it is empty
+        static Request *Allocate(txn_id_t tid, LockMode mode, bool granted,
+                                 bool converting = false);
 
-        Request(txn_id_t tid, LockMode mode, bool granted) : tid_(tid),
-                                                             mode_(mode), is_granted_(granted) { ; }
+        // back to the free list of the calling thread
+        static void Free(Request *request);
 
-        void wait() {
-            std::unique_lock<std::mutex> lk(cv_m);
-            cv_.wait(lk, [this] { return this->is_granted_; });
+        /*
+         * block until granted, aborted or timeout (no timeout if zero)
+         * @return: whether the request is granted
+         */
+        bool wait(std::chrono::milliseconds timeout) {
+            std::unique_lock<std::mutex> lk(parker_->latch_);
+            auto ready = [this] { return this->is_granted_ || this->is_aborted_; };
+            if (timeout.count() > 0)
+                parker_->cv_.wait_for(lk, timeout, ready);
+            else
+                parker_->cv_.wait(lk, ready);
+            return is_granted_;
         }
 
         void granted() {
-            std::unique_lock<std::mutex> lk(cv_m);
+            std::unique_lock<std::mutex> lk(parker_->latch_);
             this->is_granted_ = true;
-            cv_.notify_one();
+            parker_->cv_.notify_one();
+        }
+
+        // wake the waiting transaction, it gives up the request
+        void abort() {
+            std::unique_lock<std::mutex> lk(parker_->latch_);
+            this->is_aborted_ = true;
+            parker_->cv_.notify_one();
         }
 
         txn_id_t tid_;
         LockMode mode_;
         bool is_granted_;
-        std::condition_variable cv_;
-        std::mutex cv_m;
+        // converts the granted request of the same txn, which it replaces
+        // once granted
+        bool converting_;
+        bool is_aborted_;
+        // position among the waiting requests under the grant policy, lower
+        // is granted first
+        int64_t rank_;
+        // parker of the requesting thread, set when the request is created
+        // waiting so granting never races with the start of the wait
+        Parker *parker_;
+        Request *prev_;
+        Request *next_;
 
+    private:
+        Request() = default;
+    };
+
+    // intrusive doubly linked list of pooled Request nodes
+    class RequestList {
+    public:
+        class iterator {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef Request value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef Request *pointer;
+            typedef Request &reference;
+
+            explicit iterator(Request *node = nullptr) : node_(node) {}
+
+            Request &operator*() const { return *node_; }
+
+            Request *operator->() const { return node_; }
+
+            iterator &operator++() {
+                node_ = node_->next_;
+                return *this;
+            }
+
+            bool operator==(const iterator &other) const { return node_ == other.node_; }
+
+            bool operator!=(const iterator &other) const { return node_ != other.node_; }
+
+        private:
+            friend class RequestList;
+            Request *node_;
+        };
+
+        RequestList() = default;
+
+        RequestList(const RequestList &) = delete;
+
+        ~RequestList() { clear(); }
+
+        iterator begin() const { return iterator(head_); }
+
+        iterator end() const { return iterator(); }
+
+        bool empty() const { return head_ == nullptr; }
+
+        size_t size() const { return size_; }
+
+        Request &back() const { return *tail_; }
+
+        // link a new request before pos
+        template <typename... Args>
+        iterator emplace(iterator pos, Args &&... args) {
+            Request *node = Request::Allocate(std::forward<Args>(args)...);
+            Request *next = pos.node_;
+            Request *prev = next == nullptr ? tail_ : next->prev_;
+            node->prev_ = prev;
+            node->next_ = next;
+            (prev == nullptr ? head_ : prev->next_) = node;
+            (next == nullptr ? tail_ : next->prev_) = node;
+            size_++;
+            return iterator(node);
+        }
+
+        template <typename... Args>
+        iterator emplace_back(Args &&... args) {
+            return emplace(end(), std::forward<Args>(args)...);
+        }
+
+        iterator erase(iterator pos) {
+            Request *node = pos.node_;
+            Request *next = node->next_;
+            (node->prev_ == nullptr ? head_ : node->prev_->next_) = next;
+            (next == nullptr ? tail_ : next->prev_) = node->prev_;
+            size_--;
+            Request::Free(node);
+            return iterator(next);
+        }
+
+        void clear() {
+            while (head_ != nullptr)
+                erase(begin());
+        }
+
+    private:
+        Request *head_ = nullptr;
+        Request *tail_ = nullptr;
+        size_t size_ = 0;
     };
 
     struct RequestQueue {
 
-        //RequestQueue(RequestQueue &) = delete;
+        RequestQueue() = default;
 
+        RequestQueue(const RequestQueue &) = delete;
+
+        // a new request is granted only if nobody waits and it is compatible
+        // with all granted requests
         bool canGranted(LockMode lockMode) {
-            /*
-            if ( req_queue_.empty() )
-                return true;
-            auto &last_request = req_queue_.back();
-            if (last_request.is_granted_)
-                return lockMode == LockMode::SHARED && last_request.mode_ == LockMode::SHARED;
-            return false;*/
-
-            if( req_queue_.empty() )
-                return true;
-            Request &request = req_queue_.back();
-            if( request.is_granted_ ){
-                return request.mode_ == LockMode::SHARED && lockMode == LockMode::SHARED;
+            for (Request &request : req_queue_) {
+                if (!request.is_granted_ || !LockModeCompatible(request.mode_, lockMode))
+                    return false;
             }
-            return false;
+            return true;
         }
 
-        void insert_into_queue(Transaction *txn, const RID &rid, LockMode lockMode, bool granted,
-                               std::unique_lock<std::mutex> *lock) {
+        // whether lockMode is compatible with the requests other transactions
+        // are granted
+        bool compatible(txn_id_t tid, LockMode lockMode) {
+            for (Request &request : req_queue_) {
+                if (request.is_granted_ && request.tid_ != tid &&
+                    !LockModeCompatible(request.mode_, lockMode))
+                    return false;
+            }
+            return true;
+        }
 
-            req_queue_.emplace_back(txn->GetTransactionId(), lockMode, granted );
-            Request &request = req_queue_.back();
-            if (!request.is_granted_) {
-                lock->unlock();
-                request.wait();
+        /*
+         * FIFO顺序授予等待的请求，直到遇到与已授予的请求不兼容的请求。
+         * 转换请求排在等待请求的最前面，授予时删除同一事务原来的请求
+         */
+        void grant_waiting() {
+            for (auto it = req_queue_.begin(); it != req_queue_.end(); ++it) {
+                if (it->is_granted_)
+                    continue;
+                if (!compatible(it->tid_, it->mode_))
+                    break;
+                if (it->converting_) {
+                    txn_id_t tid = it->tid_;
+                    req_queue_.erase(std::find_if(
+                            req_queue_.begin(), it, [tid](const Request &req) {
+                                return req.tid_ == tid;
+                            }));
+                    has_upgrading = false;
+                }
+                it->granted();
             }
-            if (lockMode == LockMode::SHARED)
-                txn->GetSharedLockSet()->insert(rid);
-            else
-                txn->GetExclusiveLockSet()->insert(rid);
         }
 
-        bool has_upgrading;
-        std::list<Request> req_queue_;
+        /*
+         * link a waiting request of rank behind the granted requests, the
+         * conversion and the waiting requests of lower or equal rank
+         */
+        RequestList::iterator waiting_position(int64_t rank) {
+            auto it = req_queue_.begin();
+            while (it != req_queue_.end() &&
+                   (it->is_granted_ || it->converting_ || it->rank_ <= rank))
+                ++it;
+            return it;
+        }
+
+        void note_request() {
+            contention_.num_requests++;
+            contention_.max_queue_length =
+                    std::max(contention_.max_queue_length, req_queue_.size() + 1);
+        }
+
+        void note_wait(uint64_t wait_us) {
+            contention_.total_wait_us += wait_us;
+            contention_.max_wait_us = std::max(contention_.max_wait_us, wait_us);
+        }
+
+        // a conversion is waiting, at most one at a time
+        bool has_upgrading = false;
+        RequestList req_queue_;
+        // since the queue was created, folded into LockTable when erased
+        LockContention contention_;
+        std::mutex mutex_;
+        // the queue is an entry of the LockTable, chained in its bucket
+        RID rid_;
+        RequestQueue *next_ = nullptr;
+    };
+
+    /*
+     * hash table of request queues, chained through RequestQueue::next_.
+     * Queues erased when they become empty are kept for reuse, up to
+     * LOCK_QUEUE_POOL_SIZE, so locking a rid nobody holds allocates nothing
+     */
+    class LockTable {
+    public:
+        LockTable();
+
+        ~LockTable();
+
+        LockTable(const LockTable &) = delete;
+
+        // queue of rid, created empty if it does not exist
+        RequestQueue &operator[](const RID &rid);
+
+        // queue of rid, nullptr if it does not exist
+        RequestQueue *find(const RID &rid);
+
+        // remove the queue of rid, which must be empty
+        void erase(const RID &rid);
+
+        // contention of erased queues of rids that were waited for
+        inline std::unordered_map<RID, LockContention> &GetHistory() {
+            return history_;
+        }
+
+        inline size_t size() const { return size_; }
+
+        template <typename Function>
+        void ForEach(Function function) {
+            for (RequestQueue *queue : buckets_) {
+                for (; queue != nullptr; queue = queue->next_)
+                    function(*queue);
+            }
+        }
+
+    private:
+        RequestQueue *&Bucket(const RID &rid);
+
+        // double the buckets once the average chain is longer than two
+        void Grow();
+
+        // number of buckets is a power of two
+        std::vector<RequestQueue *> buckets_;
+        size_t size_ = 0;
+        RequestQueue *free_ = nullptr;
+        size_t num_free_ = 0;
+        std::unordered_map<RID, LockContention> history_;
+    };
+
+    /*
+     * lock table被分成LOCK_TABLE_PARTITIONS个partition，每个partition有自己的latch，
+     * 访问不同row的事务基本不会竞争同一个latch。partition按cache line对齐，
+     * 相邻partition的latch不会落在同一cache line上
+     */
+    struct alignas(CACHE_LINE_SIZE) LockTablePartition {
+        LockTable lock_table_;
         std::mutex mutex_;
     };
 
@@ -94,14 +466,24 @@ namespace cmudb {
     public:
         /*
          * Strict 2PL: 保证如果事务持有互斥锁，则直到事务提交才释放该锁
+         * a lock wait_timeout of zero waits until granted or aborted
          */
-        LockManager(bool strict_2PL) : strict_2PL_(strict_2PL) {};
+        LockManager(bool strict_2PL,
+                    DeadlockPolicy policy = DeadlockPolicy::DETECTION,
+                    std::chrono::milliseconds wait_timeout = LOCK_WAIT_TIMEOUT,
+                    GrantPolicy grant_policy = GrantPolicy::FIFO);
+
+        ~LockManager();
+
+        LockManager(const LockManager &) = delete;
+
+        LockManager &operator=(const LockManager &) = delete;
 
         /*** below are APIs need to implement ***/
         // lock:
         // return false if transaction is aborted
         // it should be blocked on waiting and should return true when granted
-        // note the behavior of trying to lock locked rids by same txn is undefined
+        // locking a rid the txn already holds converts the lock, see LockTable
         // it is transaction's job to keep track of its current locks
         bool LockShared(Transaction *txn, const RID &rid);
 
@@ -109,17 +491,157 @@ namespace cmudb {
 
         bool LockUpgrade(Transaction *txn, const RID &rid);
 
-        bool LockTemplate(Transaction *txn, const RID &rid, LockMode lockMode);
+        // with wait false a lock that cannot be granted at once is not
+        // requested, false is returned and the transaction is left as it is
+        bool LockTemplate(Transaction *txn, const RID &rid, LockMode lockMode,
+                          bool wait = true);
+
+        /*
+         * a table, named by its first page, and its pages are locked like
+         * tuples in any LockMode. Locking an item already held converts the
+         * lock to a mode covering both, e.g. S and IX to SIX
+         */
+        bool LockTable(Transaction *txn, page_id_t table_id, LockMode lockMode);
+
+        bool LockPage(Transaction *txn, page_id_t page_id, LockMode lockMode);
+
+        /*
+         * intention locks needed before a SHARED or EXCLUSIVE tuple lock on
+         * page_id of table_id: IS or IX on the table and then on the page.
+         * Nothing is locked if the table or the page is already held in a mode
+         * covering the tuple lock, covered is set and the tuple lock itself
+         * must be skipped too.
+         * Past LOCK_ESCALATION_PAGE_THRESHOLD tuple locks on the page or
+         * LOCK_ESCALATION_TABLE_THRESHOLD locks in the table the transaction
+         * locks the whole page or table instead, if no other holder conflicts
+         * @return: false if transaction is aborted
+         */
+        bool LockIntention(Transaction *txn, page_id_t table_id, page_id_t page_id,
+                           LockMode lockMode, bool &covered);
+
+        // whether txn holds item in a mode covering lockMode, no latch taken
+        static bool HoldsLock(Transaction *txn, const RID &item, LockMode lockMode);
+
+        /*
+         * tables and pages share the lock table with tuples, keyed by a rid
+         * whose slot no tuple has
+         */
+        static inline RID TableLockId(page_id_t table_id) {
+            return RID(table_id, TABLE_LOCK_SLOT);
+        }
+
+        static inline RID PageLockId(page_id_t page_id) {
+            return RID(page_id, PAGE_LOCK_SLOT);
+        }
 
         // unlock:
         // release the lock hold by the txn
         bool Unlock(Transaction *txn, const RID &rid);
         /*** END OF APIs ***/
 
+        // number of rids with a request queue, expose for test purpose
+        size_t GetLockTableSize();
+
+        LockAbortMetrics GetAbortMetrics();
+
+        // contention on rid since the lock manager started
+        LockContention GetContention(const RID &rid);
+
+        // the n rids waited for longest in total, longest first
+        std::vector<std::pair<RID, LockContention>> GetHottestRids(size_t n);
+
+        // number of page and table lock escalations
+        inline uint64_t GetNumEscalations() { return num_escalations_; }
+
     private:
-        std::unordered_map< RID, RequestQueue > lock_table_;
-        std::mutex mutex_;
+        static const int32_t TABLE_LOCK_SLOT = INT32_MAX;
+        static const int32_t PAGE_LOCK_SLOT = INT32_MAX - 1;
+
+        LockTablePartition &GetPartition(const RID &rid);
+
+        // the lock set of txn recording items held in lockMode
+        static std::shared_ptr<std::unordered_set<RID>> GetLockSet(
+                Transaction *txn, LockMode lockMode);
+
+        // rank of the waiting requests of txn under grant_policy_
+        int64_t GrantRank(Transaction *txn);
+
+        // release a lock without the 2PL checks of Unlock
+        void Release(Transaction *txn, const RID &rid);
+
+        // keep the lock counts of txn for escalation, a lock on rid is
+        // taken (delta 1) or released (delta -1)
+        static void CountLock(Transaction *txn, const RID &rid, int delta);
+
+        /*
+         * lock item, a page or table lock id, in S or X and release the locks
+         * of txn below it. Never waits
+         * @return: false if another holder conflicts
+         */
+        bool Escalate(Transaction *txn, const RID &item, bool exclusive);
+
+        /*
+         * deadlock policy for a request about to wait in queue, caller holds
+         * the queue latch
+         * @return: false if the requester must abort instead of waiting
+         */
+        bool CheckWait(Transaction *txn, RequestQueue &queue);
+
+        // wound-wait: abort tid, now if it is waiting, else at its next wait
+        void Wound(txn_id_t tid);
+
+        // @return: true (and forget the wound) if tid was wounded
+        bool TakeWound(txn_id_t tid);
+
+        /*
+         * wait for request, registered so it can be aborted by a wound or the
+         * deadlock detector. On failure the request is removed from queue
+         * @return: whether the request is granted
+         */
+        bool WaitForGrant(Transaction *txn, const RID &rid,
+                          LockTablePartition &partition, RequestQueue &queue,
+                          Request &request);
+
+        // abort the wait of tid, @return: false if tid is not waiting
+        bool AbortWaiting(txn_id_t tid);
+
+        // deadlock detection thread
+        void DetectionLoop();
+
+        // build the waits-for graph and abort the youngest txn of each cycle
+        void DetectDeadlocks();
+
+        // youngest transaction on a waits-for cycle, INVALID_TXN_ID if none
+        static txn_id_t FindCycleVictim(
+                const std::map<txn_id_t, std::vector<txn_id_t>> &waits_for);
+
+        // LOCK_TABLE_PARTITIONS partitions, allocated cache line aligned
+        LockTablePartition *partitions_;
         bool strict_2PL_;
+        DeadlockPolicy policy_;
+        std::chrono::milliseconds wait_timeout_;
+        GrantPolicy grant_policy_;
+        /*
+         * waiting request of each blocked transaction and wounded transactions
+         * that hold locks but are not waiting, protected by waits_latch_.
+         * waits_latch_ is taken after queue latches and before parker latches
+         */
+        std::unordered_map<txn_id_t, Request *> waiting_;
+        std::unordered_set<txn_id_t> wounded_;
+        // size of wounded_, lets Unlock skip waits_latch_
+        std::atomic<size_t> num_wounded_pending_;
+        std::mutex waits_latch_;
+        // abort counters
+        std::atomic<uint64_t> num_died_;
+        std::atomic<uint64_t> num_wounded_;
+        std::atomic<uint64_t> num_deadlock_victims_;
+        std::atomic<uint64_t> num_timeouts_;
+        std::atomic<uint64_t> num_escalations_;
+        // deadlock detection thread, only with DeadlockPolicy::DETECTION
+        std::thread detection_thread_;
+        bool stop_detection_ = false;
+        std::mutex detection_latch_;
+        std::condition_variable detection_cv_;
     };
 
 } // namespace cmudb
@@ -8,7 +8,9 @@
 #include <deque>
 #include <memory>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "common/logger.h"
@@ -49,13 +51,23 @@ public:
 class Transaction {
 public:
   Transaction(Transaction const &) = delete;
-  Transaction(txn_id_t txn_id)
+  Transaction(txn_id_t txn_id, bool read_only = false)
       : state_(TransactionState::GROWING),
         thread_id_(std::this_thread::get_id()),
-        txn_id_(txn_id), prev_lsn_(INVALID_LSN), shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
-    // initialize sets
-    write_set_.reset(new std::deque<WriteRecord>);
+        txn_id_(txn_id), read_only_(read_only),
+        read_ts_(INVALID_TIMESTAMP), prev_lsn_(INVALID_LSN),
+        first_lsn_(INVALID_LSN), shared_lock_set_{new std::unordered_set<RID>},
+        exclusive_lock_set_{new std::unordered_set<RID>},
+        intention_shared_lock_set_{new std::unordered_set<RID>},
+        intention_exclusive_lock_set_{new std::unordered_set<RID>},
+        shared_intention_exclusive_lock_set_{new std::unordered_set<RID>},
+        lock_counts_{new std::unordered_map<RID, size_t>},
+        locked_pages_{new std::unordered_map<page_id_t, page_id_t>} {
+    // initialize sets, a read-only transaction never has a write set
+    if (!read_only_) {
+      write_set_.reset(new std::deque<WriteRecord>);
+      version_set_.reset(new std::vector<RID>);
+    }
     page_set_.reset(new std::deque<Page *>);
     deleted_page_set_.reset(new std::unordered_set<page_id_t>);
   }
@@ -69,10 +81,30 @@ public:
 
   inline txn_id_t GetTransactionId() const { return txn_id_; }
 
+  inline bool IsReadOnly() const { return read_only_; }
+
+  // lock waiters of higher priority go first under GrantPolicy::PRIORITY
+  inline int GetPriority() const { return priority_; }
+
+  inline void SetPriority(int priority) { priority_ = priority; }
+
   inline std::shared_ptr<std::deque<WriteRecord>> GetWriteSet() {
     return write_set_;
   }
 
+  /*
+   * snapshot of the transaction, INVALID_TIMESTAMP unless it was begun by a
+   * TransactionManager with a VersionManager. Reads see the versions
+   * committed at or before it and take no locks
+   */
+  inline timestamp_t GetReadTimestamp() const { return read_ts_; }
+
+  inline void SetReadTimestamp(timestamp_t read_ts) { read_ts_ = read_ts; }
+
+  inline std::shared_ptr<std::vector<RID>> GetVersionSet() {
+    return version_set_;
+  }
+
   inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return page_set_; }
 
   inline void AddIntoPageSet(Page *page) { page_set_->push_back(page); }
@@ -93,13 +125,43 @@ public:
     return exclusive_lock_set_;
   }
 
+  inline std::shared_ptr<std::unordered_set<RID>> GetIntentionSharedLockSet() {
+    return intention_shared_lock_set_;
+  }
+
+  inline std::shared_ptr<std::unordered_set<RID>>
+  GetIntentionExclusiveLockSet() {
+    return intention_exclusive_lock_set_;
+  }
+
+  inline std::shared_ptr<std::unordered_set<RID>>
+  GetSharedIntentionExclusiveLockSet() {
+    return shared_intention_exclusive_lock_set_;
+  }
+
+  inline std::shared_ptr<std::unordered_map<RID, size_t>> GetLockCounts() {
+    return lock_counts_;
+  }
+
+  inline std::shared_ptr<std::unordered_map<page_id_t, page_id_t>>
+  GetLockedPages() {
+    return locked_pages_;
+  }
+
   inline TransactionState GetState() { return state_; }
 
   inline void SetState(TransactionState state) { state_ = state; }
 
   inline lsn_t GetPrevLSN() { return prev_lsn_; }
 
-  inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
+  inline void SetPrevLSN(lsn_t prev_lsn) {
+    if (first_lsn_ == INVALID_LSN)
+      first_lsn_ = prev_lsn;
+    prev_lsn_ = prev_lsn;
+  }
+
+  // lsn of the first data log record, undo never goes further back
+  inline lsn_t GetFirstLSN() { return first_lsn_; }
 
 private:
   TransactionState state_;
@@ -108,10 +170,18 @@ private:
   std::thread::id thread_id_;
   // transaction id
   txn_id_t txn_id_;
+  // declared read-only at begin, write set is nullptr
+  bool read_only_;
+  int priority_ = 0;
+  timestamp_t read_ts_;
   // Below are used by transaction, undo set
   std::shared_ptr<std::deque<WriteRecord>> write_set_;
-  // prev lsn
-  lsn_t prev_lsn_;
+  // rids of the versions created by the transaction, stamped at commit
+  std::shared_ptr<std::vector<RID>> version_set_;
+  // prev lsn, INVALID_LSN until the transaction writes its first log record
+  // read by checkpoint from another thread
+  std::atomic<lsn_t> prev_lsn_;
+  std::atomic<lsn_t> first_lsn_;
 
   // Below are used by concurrent index
   // this deque contains page pointer that was latche during index operation
@@ -124,6 +194,16 @@ private:
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   // this set contains rid of exclusive-locked tuples by this transaction
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  // tables and pages locked in IS, IX and SIX mode, the shared and exclusive
+  // sets above also hold tables and pages locked in S and X mode
+  std::shared_ptr<std::unordered_set<RID>> intention_shared_lock_set_;
+  std::shared_ptr<std::unordered_set<RID>> intention_exclusive_lock_set_;
+  std::shared_ptr<std::unordered_set<RID>> shared_intention_exclusive_lock_set_;
+  // for lock escalation: number of tuple locks under each page lock id and
+  // of tuple and page locks under each table lock id
+  std::shared_ptr<std::unordered_map<RID, size_t>> lock_counts_;
+  // table of each page locked by LockManager::LockIntention
+  std::shared_ptr<std::unordered_map<page_id_t, page_id_t>> locked_pages_;
 };
 
 } // namespace cmudb
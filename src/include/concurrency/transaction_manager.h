@@ -6,31 +6,80 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
+#include "concurrency/version_manager.h"
 #include "logging/log_manager.h"
 
 namespace cmudb {
     class TransactionManager {
 
     public:
+        /*
+         * with a version manager every transaction begins with a snapshot
+         * and its writes become visible to snapshots once it commits
+         */
         TransactionManager(LockManager *lock_manager,
-                           LogManager *log_manager = nullptr)
+                           LogManager *log_manager = nullptr,
+                           VersionManager *version_manager = nullptr)
                 : next_txn_id_(0), lock_manager_(lock_manager),
-                  log_manager_(log_manager) {}
+                  log_manager_(log_manager), version_manager_(version_manager) {}
 
-        Transaction *Begin();
+        // read-only transactions skip write set allocation and reject writes
+        Transaction *Begin(bool read_only = false);
 
         void Commit(Transaction *txn);
 
+        /*
+         * Commit without waiting for the group flush. Returns as soon as the
+         * COMMIT record is appended; locks are released and callback fires
+         * once the record is on disk (on the log flush thread, so callback
+         * must not block)
+         */
+        void CommitAsync(Transaction *txn,
+                         std::function<void(Transaction *)> callback);
+
+        // future flavor of CommitAsync, ready once the commit is durable
+        std::future<void> CommitAsync(Transaction *txn);
+
         void Abort(Transaction *txn);
 
+        /*
+         * active transaction table for checkpoint: (txn id, last lsn, first
+         * lsn) of every running transaction that has written a log record
+         */
+        std::vector<std::tuple<txn_id_t, lsn_t, lsn_t>> GetActiveTransactionTable();
+
     private:
+        /*
+         * apply deferred deletes and append COMMIT record
+         * @return: false if the transaction never wrote a log record, then no
+         * COMMIT record is written and there is nothing to wait for
+         */
+        bool PrepareCommit(Transaction *txn);
+
+        // publish the versions of a committed transaction, then release locks
+        void FinishCommit(Transaction *txn);
+
+        void ReleaseLocks(Transaction *txn);
+
+        void RemoveActiveTransaction(Transaction *txn);
+
         std::atomic<txn_id_t> next_txn_id_;
         LockManager *lock_manager_;
         LogManager *log_manager_;
+        VersionManager *version_manager_;
+        // running transactions, protected by active_txn_latch_
+        std::unordered_map<txn_id_t, Transaction *> active_txns_;
+        std::mutex active_txn_latch_;
     };
 
 } // namespace cmudb
@@ -0,0 +1,168 @@
+/**
+ * version_manager.h
+ * Multi-version concurrency control for table heaps. The table page keeps the
+ * newest version of every tuple, the versions it replaced are kept in memory
+ * in a version chain per rid. A version is valid from the commit timestamp of
+ * its writer (begin_ts) to the commit timestamp of the next version (end_ts).
+ * A transaction begun by a TransactionManager with a VersionManager reads the
+ * versions valid at its read timestamp without taking locks. Writers still
+ * lock tuples exclusively and a snapshot writer aborts if the tuple was
+ * committed after its snapshot (first updater wins, snapshot isolation).
+ * A background thread drops versions no snapshot can see any more. A
+ * committed delete leaves its tuple on the page, marked deleted, until then:
+ * the garbage collector frees the slot.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/config.h"
+#include "common/rid.h"
+#include "concurrency/transaction.h"
+#include "logging/log_manager.h"
+#include "table/tuple.h"
+
+namespace cmudb {
+
+    struct TupleVersion {
+        // commit timestamp of the writer, MAX_TIMESTAMP until it commits
+        timestamp_t begin_ts_;
+        // begin_ts_ of the next version, MAX_TIMESTAMP while there is none
+        timestamp_t end_ts_;
+        txn_id_t writer_;
+        // the tuple does not exist in this version
+        bool deleted_;
+        // image of the tuple, empty for the newest version which is on the page
+        Tuple tuple_;
+    };
+
+    class VersionManager {
+    public:
+        // the garbage collector frees table page slots through
+        // buffer_pool_manager and logs it in log_manager
+        VersionManager(BufferPoolManager *buffer_pool_manager,
+                       LogManager *log_manager)
+                : buffer_pool_manager_(buffer_pool_manager),
+                  log_manager_(log_manager), last_commit_ts_(0),
+                  num_versions_(0) {}
+
+        ~VersionManager() { StopGCThread(); }
+
+        // take the snapshot of txn: its read timestamp
+        void Begin(Transaction *txn);
+
+        /*
+         * stamp the versions txn created with a new commit timestamp and make
+         * them visible to transactions begun afterwards. Commits are stamped
+         * one at a time, so a snapshot sees a transaction entirely or not at
+         * all
+         */
+        void Commit(Transaction *txn);
+
+        // release the snapshot of txn, its versions are already rolled back
+        void Abort(Transaction *txn);
+
+        /*
+         * version chain maintenance, called by TableHeap under the page write
+         * latch after the page was changed. old_tuple is the image the update
+         * or delete replaced
+         */
+        void InsertVersion(const RID &rid, Transaction *txn);
+
+        void UpdateVersion(const RID &rid, const Tuple &old_tuple, Transaction *txn);
+
+        void DeleteVersion(const RID &rid, const Tuple &old_tuple, Transaction *txn);
+
+        // drop the newest version of rid, created by txn which rolls it back
+        void RollbackVersion(const RID &rid, Transaction *txn);
+
+        /*
+         * @return: false if rid was committed after the snapshot of txn, txn
+         * must not overwrite it. Caller holds the exclusive lock of rid
+         */
+        bool CheckWrite(const RID &rid, Transaction *txn);
+
+        /*
+         * find the version of rid visible to the snapshot of txn, called under
+         * the page read latch
+         * @return: false if rid does not exist in the snapshot. on_page is set
+         * if it is the newest version, which the caller reads from the page,
+         * otherwise tuple is set to the older version
+         */
+        bool GetVisibleVersion(const RID &rid, Transaction *txn, Tuple &tuple,
+                               bool &on_page);
+
+        /*
+         * drop the versions every running and future snapshot has passed and
+         * free the slots of the committed deletes among them
+         * @return: number of versions dropped
+         */
+        size_t GarbageCollect();
+
+        // spawn a thread running GarbageCollect every VERSION_GC_INTERVAL
+        void RunGCThread();
+
+        void StopGCThread();
+
+        // oldest read timestamp any running or future snapshot can have
+        timestamp_t GetWatermark();
+
+        inline timestamp_t GetLastCommitTimestamp() { return last_commit_ts_; }
+
+        // versions kept in version chains
+        inline size_t GetNumVersions() { return num_versions_; }
+
+    private:
+        struct VersionPartition {
+            // rid -> versions, oldest first
+            std::unordered_map<RID, std::deque<TupleVersion>> chains_;
+            std::mutex mutex_;
+        };
+
+        VersionPartition &GetPartition(const RID &rid);
+
+        void ReleaseSnapshot(Transaction *txn);
+
+        // link a new newest version of rid written by txn
+        void PushVersion(const RID &rid, const Tuple *old_tuple, bool deleted,
+                         Transaction *txn);
+
+        void GCLoop();
+
+        /*
+         * remove the tuples of committed deletes from their pages. Slots whose
+         * page can not be fetched are kept for the next garbage collection
+         */
+        void FreeSlots(const std::vector<RID> &rids);
+
+        BufferPoolManager *buffer_pool_manager_;
+        LogManager *log_manager_;
+        // commit timestamp of the last stamped commit, snapshots read at it
+        std::atomic<timestamp_t> last_commit_ts_;
+        // one commit is stamped at a time
+        std::mutex commit_latch_;
+        // read timestamps of running snapshots, protected by snapshot_latch_
+        std::multiset<timestamp_t> snapshots_;
+        std::mutex snapshot_latch_;
+        VersionPartition partitions_[VERSION_STORE_PARTITIONS];
+        std::atomic<size_t> num_versions_;
+        // deleted slots FreeSlots could not free yet, protected by free_latch_
+        std::vector<RID> unfreed_slots_;
+        std::mutex free_latch_;
+        // garbage collector thread
+        std::thread gc_thread_;
+        bool stop_gc_ = false;
+        std::mutex gc_latch_;
+        std::condition_variable gc_cv_;
+    };
+
+} // namespace cmudb
@@ -5,12 +5,26 @@
  * database. It also performs read and write of pages to and from disk, and
  * provides a logical file layer within the context of a database management
  * system.
+ *
+ * The log is a sequence of bytes addressed by its offset, stored in segment
+ * files of LOG_SEGMENT_FILE_SIZE bytes named <log_name>.<segment number>.
+ * <log_name> itself is a small anchor file recording the offset of the first
+ * live log record and the segment size, removing it discards the whole log.
+ * Segment files are zero-filled to their full size before the first append,
+ * so appends never change the file size and a single fdatasync makes them
+ * durable. The zero-fill runs in the background: once the current segment is
+ * LOG_PREALLOCATE_PERCENT full, the next one is prepared, so switching
+ * segments does not stall the log flush. The log end is therefore not the file size, it is found by
+ * walking the records: each starts with | size(4) | LSN(8) | and its LSN is
+ * its own offset, which bytes past the end (zeros or records left in a
+ * recycled file) never match.
  */
 
 #pragma once
 #include <atomic>
 #include <fstream>
 #include <future>
+#include <mutex>
 #include <string>
 
 #include "common/config.h"
@@ -25,27 +39,67 @@ public:
   void WritePage(page_id_t page_id, const char *page_data);
   void ReadPage(page_id_t page_id, char *page_data);
 
+  // append to the log, durable only after the next SyncLog
   void WriteLog(char *log_data, int size);
-  bool ReadLog(char *log_data, int size, int offset);
+  // logging starts, prepare the segment the log ends in in the background
+  void PrepareLog();
+  // fdatasync the log written so far, one call per group flush
+  void SyncLog();
+  bool ReadLog(char *log_data, int size, int64_t offset);
+  // log before offset is not needed any more, drop the segments before it
+  void TruncateLog(int64_t offset);
+  // log lives in [start offset, end offset)
+  inline int64_t GetLogStartOffset() const { return log_start_offset_; }
+  inline int64_t GetLogEndOffset() const { return log_end_offset_; }
 
   page_id_t AllocatePage();
   void DeallocatePage(page_id_t page_id);
+  // page_id is in use (e.g. found in the log), never allocate it again
+  void MarkAllocated(page_id_t page_id);
 
   int GetNumFlushes() const;
+  int GetNumReads() const;
   bool GetFlushState() const;
   inline void SetFlushLogFuture(std::future<void> *f) { flush_log_f_ = f; }
   inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
 
 private:
   int GetFileSize(const std::string &name);
-  // stream to write log file
-  std::fstream log_io_;
+  std::string GetLogSegmentName(int64_t segment) const;
+  std::string GetLogDirectory() const;
+  void OpenLogSegment(int64_t segment);
+  void PrepareLogSegmentAsync(int64_t segment, int64_t from);
+  void PrepareLogSegment(int64_t segment, int64_t from);
+  void ZeroFillLogSegment(int fd, int64_t from);
+  // read the segment files without checking the log bounds
+  int ReadLogSegments(char *log_data, int size, int64_t offset);
+  int64_t FindLogEnd();
+  bool WriteLogAnchor();
+  void RemoveLogSegments();
+  // file descriptor of the log segment log_write_segment_
+  int log_fd_;
+  int64_t log_write_segment_;
+  // written to log_fd_ since the last fdatasync
+  bool log_dirty_;
+  // stream to read the log segment log_read_segment_
+  std::ifstream log_read_io_;
+  int64_t log_read_segment_;
+  // last segment prepared by PrepareLogSegment, log_prealloc_f_ is running
+  // or done with it
+  int64_t log_prealloc_segment_;
+  std::future<void> log_prealloc_f_;
   std::string log_name_;
+  int64_t log_segment_size_;
+  std::atomic<int64_t> log_start_offset_;
+  std::atomic<int64_t> log_end_offset_;
+  // serialize segment switches, reads and truncation
+  std::mutex log_latch_;
   // stream to write db file
   std::fstream db_io_;
   std::string file_name_;
   std::atomic<page_id_t> next_page_id_;
   int num_flushes_;
+  std::atomic<int> num_reads_;
   bool flush_log_;
   std::future<void> *flush_log_f_;
 };
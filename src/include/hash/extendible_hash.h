@@ -9,23 +9,42 @@
 
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <string>
-#include <map>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include "common/rwmutex.h"
 #include "hash/hash_table.h"
 
 namespace cmudb {
 
+    // number of fingerprints compared by one probe instruction
+#ifdef __AVX2__
+#define PROBE_WIDTH 32
+#else
+#define PROBE_WIDTH 16
+#endif
+
     template<typename K, typename V>
     class ExtendibleHash : public HashTable<K, V> {
+        /*
+         * 桶内记录存放在定长数组中，创建桶时一次性分配capacity个slot，之后插入不再分配内存
+         * fingerprints[i]是slots[i]中key哈希值的1字节摘要，查找时先用SIMD比较摘要，
+         * 摘要相同再比较key；记录始终紧凑存放在[0, size)内
+         */
         struct Bucket {
-            explicit Bucket(int depth): local_depth(depth){};
-            std::map<K, V> records; //通过records.size可知当前bucket内部大小
+            Bucket(int depth, size_t capacity)
+                    : fingerprints(PROBE_WIDTH * ((capacity + PROBE_WIDTH - 1) / PROBE_WIDTH), 0),
+                      slots(capacity), size(0), local_depth(depth) {};
+            std::vector<uint8_t> fingerprints; //长度按PROBE_WIDTH向上取整，保证SIMD load不越界
+            std::vector<std::pair<K, V>> slots;
+            size_t size; //当前bucket内部记录个数
             int local_depth; //hash(key) & (1 << local_depth -1)得hash table中对应该bucket
+            std::mutex latch; //桶级别的锁，持有目录读锁时才能获取
         };
     public:
         // constructor
@@ -52,11 +71,23 @@ namespace cmudb {
     private:
         // add your own member variables here
 
-        std::mutex mutex_;
+        /*
+         * 目录读写锁：Find/Remove以及不需要split的Insert只持有读锁(再加桶锁)，
+         * 只有split bucket或者directory doubling时才持有写锁
+         */
+        mutable RWMutex directory_latch_;
         int global_depth_; //用哈希值的后global_depth位做索引值，间接表明page table的大小
         int bucket_count_; //bucket的数量
         size_t bucket_size_; //每个bucket内部capacity
         size_t key_index(const K & key, int local_depth);
         std::shared_ptr<Bucket> split(std::shared_ptr<Bucket>& bucket);
+        void merge(size_t slot);
+        // buddy两桶记录数之和不超过该值时才合并，低于split阈值以留出滞后区间
+        inline size_t merge_threshold() const { return bucket_size_ / 2; }
+        void insert_exclusive(const K &key, const V &value);
+        static uint8_t fingerprint(size_t hash);
+        int probe(const Bucket &bucket, const K &key);
+        void append(Bucket &bucket, const K &key, const V &value);
+        void erase(Bucket &bucket, int slot);
     };
 } // namespace cmudb
@@ -7,6 +7,10 @@
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ * (5) With a log manager, every page change is write-ahead logged. Leaf
+ * inserts and deletes are logged with the index name so recovery can undo
+ * them logically, split, merge and redistribute are logged page by page as
+ * nested top actions that end with a BTREE_SMO_END record
  */
 #pragma once
 
@@ -15,6 +19,7 @@
 
 #include "concurrency/transaction.h"
 #include "index/index_iterator.h"
+#include "logging/log_manager.h"
 #include "page/b_plus_tree_internal_page.h"
 #include "page/b_plus_tree_leaf_page.h"
 
@@ -29,7 +34,8 @@ namespace cmudb {
         explicit BPlusTree(const std::string &name,
                            BufferPoolManager *buffer_pool_manager,
                            const KeyComparator &comparator,
-                           page_id_t root_page_id = INVALID_PAGE_ID);
+                           page_id_t root_page_id = INVALID_PAGE_ID,
+                           LogManager *log_manager = nullptr);
 
         // Returns true if this B+ tree has no keys and values.
         bool IsEmpty() const;
@@ -64,9 +70,23 @@ namespace cmudb {
         B_PLUS_TREE_LEAF_PAGE_TYPE *FindLeafPage(const KeyType &key, OpType opType,
                                                  bool leftMost , Transaction *transaction = nullptr);
 
+        /*
+         * logical undo of a logged leaf insert or delete, entry is the key &
+         * value pair of the log record. Registered with LogRecovery
+         */
+        void UndoEntry(const char *entry, bool inserted);
+
     private:
+        // entries and links of a page before a structure modification
+        struct PageSnapshot {
+            BPlusTreePage *node;
+            page_id_t parent_id;
+            page_id_t next_id;
+            std::vector<char> entries;
+        };
 
-        void StartNewTree(const KeyType &key, const ValueType &value);
+        void StartNewTree(const KeyType &key, const ValueType &value,
+                          Transaction *transaction = nullptr);
 
         bool InsertIntoLeaf(const KeyType &key, const ValueType &value,
                             Transaction *transaction = nullptr);
@@ -92,9 +112,40 @@ namespace cmudb {
         template<typename N>
         void Redistribute(N *neighbor_node, N *node, int index);
 
-        bool AdjustRoot(BPlusTreePage *node);
+        bool AdjustRoot(BPlusTreePage *node, Transaction *transaction = nullptr);
+
+        void UpdateRootPageId(int insert_record = false,
+                              Transaction *transaction = nullptr);
+
+        /*
+         * logging related, all of them do nothing unless IsLogging()
+         */
+        inline bool IsLogging() const {
+            return ENABLE_LOGGING && log_manager_ != nullptr;
+        }
+
+        static int EntrySize(BPlusTreePage *node);
+
+        lsn_t AppendLogRecord(LogRecordType type, page_id_t page_id, int index,
+                              int count, int entry_size, const char *data,
+                              bool logical, Transaction *transaction);
+
+        lsn_t AppendLogRecord(LogRecordType type, page_id_t page_id,
+                              page_id_t old_id, page_id_t new_id,
+                              Transaction *transaction);
+
+        void LogNewPage(BPlusTreePage *node, Transaction *transaction);
+
+        PageSnapshot TakeSnapshot(BPlusTreePage *node);
+
+        void LogSnapshotDiff(const PageSnapshot &snapshot, Transaction *transaction,
+                             page_id_t children_from = INVALID_PAGE_ID);
+
+        // structure modification bracket, BeginSMO returns the lsn the
+        // BTREE_SMO_END record points back to
+        lsn_t BeginSMO(Transaction *transaction);
 
-        void UpdateRootPageId(int insert_record = false);
+        void EndSMO(lsn_t smo_prev_lsn, Transaction *transaction);
 
         BPlusTreePage *LockCrabbingIter(page_id_t pageId, OpType opType,
                                         page_id_t parent, Transaction *transaction);
@@ -147,6 +198,7 @@ namespace cmudb {
         page_id_t root_page_id_; //可以用原子类型
         BufferPoolManager *buffer_pool_manager_;
         KeyComparator comparator_;
+        LogManager *log_manager_;
         RWMutex mutex_;
         static thread_local int rootLockedCnt;
 
@@ -0,0 +1,110 @@
+/**
+ * extendible_hash_table.h
+ *
+ * Implementation of disk-resident extendible hash table. A directory page and
+ * its slot pages map the low global_depth bits of a key's hash to bucket
+ * pages, and every page lives in the buffer pool, so a point lookup touches
+ * exactly the directory page, one slot page and one bucket page.
+ * (1) We only support unique key
+ * (2) support insert & remove & point lookup (no range scan)
+ * (3) Buckets split/merge and the directory grows/shrinks dynamically over up
+ *     to DIRECTORY_ARRAY_SIZE slot pages; only once the directory reaches
+ *     DIRECTORY_MAX_DEPTH, a full bucket chains overflow pages
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "common/rwmutex.h"
+#include "concurrency/transaction.h"
+#include "page/hash_table_bucket_page.h"
+#include "page/hash_table_directory_page.h"
+
+namespace cmudb {
+
+#define EXTENDIBLE_HASH_TABLE_TYPE                                             \
+  ExtendibleHashTable<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class ExtendibleHashTable {
+public:
+  explicit ExtendibleHashTable(const std::string &name,
+                               BufferPoolManager *buffer_pool_manager,
+                               const KeyComparator &comparator,
+                               page_id_t directory_page_id = INVALID_PAGE_ID);
+
+  // Returns true if the directory page has not been created yet
+  bool IsEmpty() const;
+
+  // Insert a key-value pair, return false if key already exists
+  bool Insert(const KeyType &key, const ValueType &value,
+              Transaction *transaction = nullptr);
+
+  // Remove a key and its value, return false if key does not exist
+  bool Remove(const KeyType &key, Transaction *transaction = nullptr);
+
+  // return the value associated with a given key
+  bool GetValue(const KeyType &key, std::vector<ValueType> &result,
+                Transaction *transaction = nullptr);
+
+  // expose for test purpose
+  uint32_t GetGlobalDepth();
+
+  inline page_id_t GetDirectoryPageId() const { return directory_page_id_; }
+
+private:
+  uint32_t Hash(const KeyType &key) const;
+
+  Page *NewBucketPage(page_id_t &page_id);
+
+  bool CreateDirectory();
+
+  Page *FetchSlotPage(HashTableDirectoryPage *directory, uint32_t bucket_idx);
+
+  bool FindBucket(uint32_t hash, page_id_t &bucket_page_id,
+                  uint32_t &local_depth);
+
+  bool SplitBucket(HashTableDirectoryPage *directory, HashTableSlotPage *slots,
+                   uint32_t bucket_idx);
+
+  bool GrowDirectory(HashTableDirectoryPage *directory);
+
+  bool SpreadDirectory(HashTableDirectoryPage *directory);
+
+  bool ShrinkDirectory(HashTableDirectoryPage *directory);
+
+  bool LookupInChain(HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+                     ValueType &value, bool &found);
+
+  bool InsertIntoChain(HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+                       const ValueType &value, bool &inserted);
+
+  bool RemoveFromChain(HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+                       bool &removed);
+
+  bool SplitInsert(const KeyType &key, const ValueType &value);
+
+  bool AppendOverflowPage(HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+                          const ValueType &value);
+
+  void Merge(const KeyType &key);
+
+  bool MergeBucket(HashTableDirectoryPage *directory, uint32_t hash);
+
+  void UpdateDirectoryPageId(bool insert_record = false);
+
+  // member variable
+  std::string index_name_;
+  page_id_t directory_page_id_;
+  BufferPoolManager *buffer_pool_manager_;
+  KeyComparator comparator_;
+  /*
+   * 表级读写锁：查找/删除以及不需要split的插入持有读锁(再加bucket page latch)，
+   * 创建目录、split、merge以及追加溢出页时持有写锁
+   */
+  RWMutex table_latch_;
+};
+
+} // namespace cmudb
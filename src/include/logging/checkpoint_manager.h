@@ -0,0 +1,67 @@
+/**
+ * checkpoint_manager.h
+ * Take fuzzy checkpoints: BEGIN_CHECKPOINT and END_CHECKPOINT records around
+ * a snapshot of the active transaction table and the dirty page table.
+ * Neither transactions nor page flushes are blocked while the tables are
+ * sampled, the analysis pass reconciles them with the records logged in
+ * between. Once the END_CHECKPOINT record is on disk the log before the
+ * minimum recovery lsn is truncated. A background thread takes a checkpoint
+ * every CHECKPOINT_INTERVAL unless nothing was logged since the last one.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "logging/log_manager.h"
+
+namespace cmudb {
+
+    class CheckpointManager {
+    public:
+        CheckpointManager(TransactionManager *transaction_manager,
+                          LogManager *log_manager,
+                          BufferPoolManager *buffer_pool_manager)
+                : transaction_manager_(transaction_manager),
+                  log_manager_(log_manager),
+                  buffer_pool_manager_(buffer_pool_manager) {}
+
+        ~CheckpointManager() { StopCheckpointThread(); }
+
+        /*
+         * take a fuzzy checkpoint, returns when END_CHECKPOINT is on disk
+         * @return: lsn of the BEGIN_CHECKPOINT record, INVALID_LSN if logging
+         * is not enabled
+         */
+        lsn_t Checkpoint();
+
+        // minimum recovery lsn of the last completed checkpoint
+        inline lsn_t GetMinRecoveryLSN() { return min_recovery_lsn_; }
+
+        // spawn a thread running Checkpoint every CHECKPOINT_INTERVAL
+        void RunCheckpointThread();
+
+        // must be stopped before the log flush thread
+        void StopCheckpointThread();
+
+    private:
+        void CheckpointLoop();
+
+        TransactionManager *transaction_manager_;
+        LogManager *log_manager_;
+        BufferPoolManager *buffer_pool_manager_;
+        lsn_t min_recovery_lsn_ = INVALID_LSN;
+        // one checkpoint at a time
+        std::mutex latch_;
+        // checkpoint thread
+        std::thread checkpoint_thread_;
+        bool stop_checkpoint_ = false;
+        std::mutex checkpoint_latch_;
+        std::condition_variable checkpoint_cv_;
+    };
+
+} // namespace cmudb
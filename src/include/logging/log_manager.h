@@ -1,40 +1,68 @@
 /**
  * log_manager.h
- * log manager maintain a separate thread that is awaken when the log buffer is
- * full or time out(every X second) to write log buffer's content into disk log
- * file.
+ * log manager maintain a separate thread that is awaken when a log buffer
+ * segment is full or time out(every X second) to write log buffer's content
+ * into disk log file.
  */
 
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <future>
+#include <map>
 #include <mutex>
+#include <thread>
 
 #include "disk/disk_manager.h"
 #include "logging/log_record.h"
 
 namespace cmudb {
 
+    // group commit statistics, snapshot from LogManager::GetGroupCommitMetrics
+    struct GroupCommitMetrics {
+        // group flushes that made at least one commit durable
+        uint64_t num_group_flushes = 0;
+        // commits made durable
+        uint64_t num_commits = 0;
+        // commits per group flush
+        double avg_batch_size = 0;
+        uint64_t max_batch_size = 0;
+        // from the commit asking for durability until it is durable
+        double avg_commit_latency_us = 0;
+        uint64_t max_commit_latency_us = 0;
+        // moving averages the adaptive wait is derived from
+        double flush_latency_us = 0;
+        double commit_interval_us = 0;
+        // how long the flush thread currently holds a commit for batching
+        double group_commit_window_us = 0;
+    };
+
     class LogManager {
     public:
         LogManager(DiskManager *disk_manager)
-                : next_lsn_(0), persistent_lsn_(INVALID_LSN),
-                  disk_manager_(disk_manager) {
-            // 一定初始化flushBufferSize、writePosition为具体的值
-            writePosition = 0;
-            flushBufferSize = 0;
+                : reserve_state_(0),
+                  persistent_lsn_(disk_manager->GetLogEndOffset() - 1),
+                  flush_index_(0), disk_manager_(disk_manager) {
             needFlush_ = false;
-            log_buffer_ = new char[LOG_BUFFER_SIZE];
-            flush_buffer_ = new char[LOG_BUFFER_SIZE];
+            for (auto &segment : segments_) {
+                segment.data = new char[LOG_BUFFER_SIZE];
+                segment.filled = 0;
+                segment.size = 0;
+                segment.base_lsn = INVALID_LSN;
+                segment.pending = false;
+            }
+            // lsn是log中的byte offset，新记录接在已有log之后
+            segments_[0].base_lsn = disk_manager->GetLogEndOffset();
         }
 
         ~LogManager() {
-            delete[] log_buffer_;
-            delete[] flush_buffer_;
-            log_buffer_ = nullptr;
-            flush_buffer_ = nullptr;
+            for (auto &segment : segments_) {
+                delete[] segment.data;
+                segment.data = nullptr;
+            }
         }
 
         // spawn a separate thread to wake up periodically to flush
@@ -48,37 +76,145 @@ namespace cmudb {
         // get/set helper functions
         inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
 
-        inline size_t GetWritePosition() { return writePosition; }
+        /*
+         * lsn the next appended log record will get, a lower bound for the
+         * lsn of every record appended after the call
+         */
+        lsn_t GetNextLSN();
+
+        // write offset within the segment appenders are currently filling
+        inline size_t GetWritePosition() {
+            return ReservedOffset(reserve_state_.load());
+        }
 
         inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
 
-        inline char *GetLogBuffer() { return log_buffer_; }
+        inline char *GetLogBuffer() {
+            return segments_[ReservedSegment(reserve_state_.load())].data;
+        }
 
         //控制log buffer
         void flushLogToDisk( bool force );
 
+        /*
+         * run callback once every record up to and including lsn is on disk,
+         * without blocking the calling thread. The callback runs on the
+         * calling thread if lsn is already persistent, otherwise on the flush
+         * thread, so it must not block
+         */
+        void RegisterFlushCallback(lsn_t lsn, std::function<void()> callback);
+
+        GroupCommitMetrics GetGroupCommitMetrics();
+
+        /*
+         * drop the log before lsn, called once a checkpoint no longer needs
+         * it for recovery. Never truncates past the persistent log
+         */
+        void TruncateLog(lsn_t lsn);
+
     private:
+        /*
+         * log buffer由LOG_BUFFER_SEGMENTS个大小为LOG_BUFFER_SIZE的segment组成环形缓冲区。
+         * appender只写active segment，写满后封存(pending)并切换到下一个空闲segment；
+         * flush thread按环形顺序把pending segment写入磁盘后再归还给appender，
+         * 所以只有当所有segment都在等待flush时append才会阻塞。
+         */
+        struct LogSegment {
+            char *data;
+            // bytes appenders have finished copying into data
+            std::atomic<size_t> filled;
+            // bytes reserved in data, valid once pending
+            size_t size;
+            // lsn (log offset) of the first byte of data, set before the
+            // segment becomes active
+            std::atomic<lsn_t> base_lsn;
+            // sealed and waiting for flush thread, protected by latch_
+            bool pending;
+        };
+
+        /*
+         * reserve_state_ packs a generation counter bumped whenever the
+         * active segment changes (high 32 bits), the index of the active
+         * segment (8 bits) and the write offset into it (low 24 bits). One
+         * CAS hands out the buffer region of a record, its lsn is the base
+         * lsn of the segment plus the offset, so lsn order always equals
+         * log order.
+         */
+        static_assert(LOG_BUFFER_SIZE < (1 << 24),
+                      "log segment offset must fit into 24 bits");
+        static_assert(LOG_BUFFER_SEGMENTS >= 2 && LOG_BUFFER_SEGMENTS <= 256,
+                      "log buffer needs 2 to 256 segments");
+
+        static inline uint64_t PackState(uint32_t generation, uint32_t segment,
+                                         uint32_t offset) {
+            return (static_cast<uint64_t>(generation) << 32) |
+                   (segment << 24) | offset;
+        }
+
+        static inline uint32_t ReservedGeneration(uint64_t state) {
+            return static_cast<uint32_t>(state >> 32);
+        }
+
+        static inline uint32_t ReservedSegment(uint64_t state) {
+            return static_cast<uint32_t>(state >> 24) & 0xFF;
+        }
+
+        static inline uint32_t ReservedOffset(uint64_t state) {
+            return static_cast<uint32_t>(state) & 0xFFFFFF;
+        }
+
+        // seal active segment and switch appenders to the next one
+        bool SealActiveSegment();
+
+        // write pending segments to disk in ring order, one log sync per batch
+        void FlushPendingSegments(std::unique_lock<std::mutex> &lock);
+
+        /*
+         * group commit related, caller must hold latch_
+         * a commit waiting for durability is noted so the flush thread can
+         * hold it for at most GroupCommitWindow() to batch later commits
+         */
+        void NoteCommitArrival(std::chrono::steady_clock::time_point now);
+
+        void NoteCommitDurable(std::chrono::steady_clock::time_point since);
+
+        std::chrono::microseconds GroupCommitWindow() const;
+
+        // serialize log record into dest, which holds log_record.GetSize() bytes
+        void SerializeLogRecord(LogRecord &log_record, char *dest);
+
+        // | name_size | name | of b+ tree log records
+        static void SerializeIndexName(const std::string &name, char *dest);
 
         // also remember to change constructor accordingly
-        //下一次写起始的位置
-        size_t writePosition;
+        // generation + active segment + 下一次写起始的位置
+        std::atomic<uint64_t> reserve_state_;
         std::atomic<bool> needFlush_; //条件变量中的状态变量
+        // notified whenever a segment is flushed (free segment or persistent
+        // lsn advanced)
         std::condition_variable notFull;
 
-        // atomic counter, record the next log sequence number
-        std::atomic<lsn_t> next_lsn_;
-        // log records before & include persistent_lsn_ have been written to disk
+        // log before & include the byte at persistent_lsn_ has been written
+        // to disk, so has every record whose lsn is not after it
         std::atomic<lsn_t> persistent_lsn_;
-        //log buffer中最后一条log record的lsn
-        std::atomic<lsn_t> last_lsn_;
         /* log buffer related
            log buffer环形缓冲区
-           当log buffer满的情况下，需要唤醒flush thread线程，将log buffer的内容持久化到硬盘中
+           当没有空闲segment时，需要唤醒flush thread线程，将pending segment的内容持久化到硬盘中
          */
-        char *log_buffer_;
-
-        size_t flushBufferSize;
-        char *flush_buffer_;
+        LogSegment segments_[LOG_BUFFER_SEGMENTS];
+        // next segment to be written by flush thread, protected by latch_
+        uint32_t flush_index_;
+        // callbacks waiting for their lsn to persist, protected by latch_
+        std::multimap<lsn_t, std::pair<std::chrono::steady_clock::time_point,
+                                       std::function<void()>>>
+                flush_callbacks_;
+        // commits noted since the last seal and arrival time of the first one
+        uint64_t waiting_commits_ = 0;
+        std::chrono::steady_clock::time_point first_commit_time_;
+        std::chrono::steady_clock::time_point last_commit_time_;
+        // statistics, protected by latch_
+        GroupCommitMetrics metrics_;
+        double commit_latency_total_us_ = 0;
         // latch to protect shared member variables
         std::mutex latch_;
         // flush thread
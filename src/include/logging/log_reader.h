@@ -0,0 +1,100 @@
+/**
+ * log_reader.h
+ * Read log records from the log file for recovery. Sequential scans go
+ * through two buffers of chunk_size bytes: while records are decoded from
+ * one, the next chunk is read into the other in the background, so a scan
+ * runs at sequential read bandwidth however large the log is. Records that
+ * span two chunks are assembled in a separate record buffer.
+ * Random access by log offset (undo) goes through its own cached window.
+ */
+
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "disk/disk_manager.h"
+#include "logging/log_record.h"
+
+namespace cmudb {
+
+    class LogReader {
+    public:
+        LogReader(DiskManager *disk_manager,
+                  int chunk_size = LOG_READ_BUFFER_SIZE);
+
+        ~LogReader();
+
+        // start a sequential scan at offset, which must be a record boundary
+        void Seek(int64_t offset);
+
+        /*
+         * next record of the sequential scan
+         * @return: false at the end of the log or at an incomplete record
+         */
+        bool Next(LogRecord &log_record);
+
+        // log offset of the record last returned by Next
+        inline int64_t GetRecordOffset() { return record_offset_; }
+
+        // log offset of the record Next will return
+        inline int64_t GetNextOffset() { return next_offset_; }
+
+        /*
+         * random access, read the record starting at offset. Does not move
+         * the sequential scan
+         */
+        bool ReadAt(int64_t offset, LogRecord &log_record);
+
+        /*
+         * deserialize the body of a log record whose header is already
+         * copied into log_record, data holds size_ - HEADER_SIZE bytes
+         */
+        static bool DeserializeLogRecord(const char *data, LogRecord &log_record);
+
+        // | name_size | name | of b+ tree log records
+        static void DeserializeIndexName(const char *data, std::string &name);
+
+    private:
+        // read [offset, offset + size) into buffer, size is cut at log end
+        int ReadChunk(char *buffer, int64_t offset);
+
+        // start reading the chunk following the current one into the other
+        // buffer
+        void StartReadAhead();
+
+        // make the read ahead chunk the current one
+        bool NextChunk();
+
+        // Next without waiting for the read ahead at the end of the scan
+        bool NextRecord(LogRecord &log_record);
+
+        // consume size bytes of the scan, assembled in record_buffer_ if they
+        // span chunks. Valid until the next call
+        const char *Consume(int size);
+
+        DiskManager *disk_manager_;
+        int chunk_size_;
+        // log end when the scan started, recovery reads a log nobody appends
+        int64_t log_end_ = 0;
+        // double buffer, buffers_[current_] is being decoded
+        char *buffers_[2];
+        int64_t buffer_offset_[2];
+        int buffer_size_[2];
+        int current_ = 0;
+        // read position in buffers_[current_]
+        int position_ = 0;
+        // pending read into buffers_[current_ ^ 1]
+        std::future<int> read_ahead_;
+        int64_t record_offset_ = 0;
+        int64_t next_offset_ = 0;
+        // records spanning chunks and random access reads
+        std::vector<char> record_buffer_;
+        // window of the log cached for ReadAt
+        char *random_buffer_;
+        int64_t random_offset_ = 0;
+        int random_size_ = 0;
+    };
+
+} // namespace cmudb
@@ -2,10 +2,12 @@
  * log_record.h
  * For every write opeartion on table page, you should write ahead a
  * corresponding log record.
- * For EACH log record, HEADER is like (5 fields in common, 20 bytes in totoal)
+ * For EACH log record, HEADER is like (5 fields in common, 28 bytes in totoal)
  *-------------------------------------------------------------
- * | size | LSN | transID | prevLSN | LogType |
+ * | size (4) | LSN (8) | transID (4) | prevLSN (8) | LogType (4) |
  *-------------------------------------------------------------
+ * LSN is the byte offset of the record in the log, so prevLSN locates the
+ * previous record of the transaction directly
  * For insert type log record
  *-------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
@@ -14,19 +16,56 @@
  *-------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | tuple_data(char[] array) |
  *-------------------------------------------------------------
- * For update type log record
+ * For update type log record, only the byte ranges that differ between the
+ * old and the new tuple are stored
  *------------------------------------------------------------------------------
- * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size |
- * | new_tuple_data |
+ * | HEADER | tuple_rid | old_tuple_size | new_tuple_size | delta_size |
+ * | delta |
+ *------------------------------------------------------------------------------
+ * delta is a sequence of ranges, offset is relative to the old tuple
+ *------------------------------------------------------------------------------
+ * | offset | old_len | new_len | old_data(old_len) | new_data(new_len) | ...
  *------------------------------------------------------------------------------
  * For new page type log record
  *-------------------------------------------------------------
  * | HEADER | prev_page_id | page_id
  *-------------------------------------------------------------
+ * For begin checkpoint type log record
+ *-------------------------------------------------------------
+ * | HEADER |
+ *-------------------------------------------------------------
+ * For end checkpoint type log record, active transaction table and dirty page
+ * table sampled after the begin checkpoint record
+ *------------------------------------------------------------------------------
+ * | HEADER | begin_checkpoint_lsn | txn_count | (txn_id, last_lsn) ... |
+ * | page_count | (page_id, rec_lsn) ... |
+ *------------------------------------------------------------------------------
+ * For b+ tree entry type log record (btree insert, btree delete, btree new
+ * page), count entries of entry_size bytes inserted into or removed from page
+ * at index. A new page stores its header image as the only entry. index_name
+ * is set for the leaf changes of a transaction, which are undone logically
+ *------------------------------------------------------------------------------
+ * | HEADER | page_id | index | count | entry_size | data | name_size | name |
+ *------------------------------------------------------------------------------
+ * For b+ tree link type log record (btree set parent, btree set next, btree
+ * root), a page id field of page changes from old_id to new_id. The root of
+ * index_name lives in the header page
+ *------------------------------------------------------------------------------
+ * | HEADER | page_id | old_id | new_id | name_size | name |
+ *------------------------------------------------------------------------------
+ * For b+ tree smo end type log record, its prevLSN skips the records of the
+ * structure modification that ends here
+ *-------------------------------------------------------------
+ * | HEADER |
+ *-------------------------------------------------------------
  */
 #pragma once
 
 #include <cassert>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "table/tuple.h"
@@ -45,6 +84,18 @@ namespace cmudb {
         ABORT,
         // when create a new page in heap table
         NEWPAGE,
+        // fuzzy checkpoint, not owned by any transaction
+        BEGIN_CHECKPOINT,
+        END_CHECKPOINT,
+        // b+ tree index pages
+        BTREE_INSERT,
+        BTREE_DELETE,
+        BTREE_NEWPAGE,
+        BTREE_SET_PARENT,
+        BTREE_SET_NEXT,
+        BTREE_ROOT,
+        // end of a structure modification (split, merge, redistribute)
+        BTREE_SMO_END,
     };
 
     class LogRecord {
@@ -52,6 +103,8 @@ namespace cmudb {
 
         friend class LogRecovery;
 
+        friend class LogReader;
+
     public:
         LogRecord()
                 : size_(0), lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID),
@@ -81,16 +134,18 @@ namespace cmudb {
             size_ = HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + tuple.GetLength();
         }
 
-        // constructor for UPDATE type
+        // constructor for UPDATE type, keeps only the delta of the two tuples
         LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
                   const RID &update_rid, const Tuple &old_tuple,
                   const Tuple &new_tuple)
                 : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
                   log_record_type_(log_record_type), update_rid_(update_rid),
-                  old_tuple_(old_tuple), new_tuple_(new_tuple) {
+                  old_tuple_size_(old_tuple.GetLength()),
+                  new_tuple_size_(new_tuple.GetLength()) {
+            EncodeUpdateDelta(old_tuple, new_tuple);
             // calculate log record size
-            size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() +
-                    new_tuple.GetLength() + 2 * sizeof(int32_t);
+            size_ = HEADER_SIZE + sizeof(RID) + 3 * sizeof(int32_t) +
+                    update_delta_.size();
         }
 
         // constructor for NEWPAGE type
@@ -103,6 +158,50 @@ namespace cmudb {
             size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
         }
 
+        // constructor for END_CHECKPOINT type
+        LogRecord(lsn_t begin_checkpoint_lsn,
+                  const std::vector<std::pair<txn_id_t, lsn_t>> &active_txns,
+                  const std::vector<std::pair<page_id_t, lsn_t>> &dirty_pages)
+                : lsn_(INVALID_LSN), txn_id_(INVALID_TXN_ID),
+                  prev_lsn_(INVALID_LSN),
+                  log_record_type_(LogRecordType::END_CHECKPOINT),
+                  begin_checkpoint_lsn_(begin_checkpoint_lsn),
+                  active_txns_(active_txns), dirty_pages_(dirty_pages) {
+            // calculate log record size
+            size_ = HEADER_SIZE + sizeof(lsn_t) + 2 * sizeof(int32_t) +
+                    active_txns.size() * (sizeof(txn_id_t) + sizeof(lsn_t)) +
+                    dirty_pages.size() * (sizeof(page_id_t) + sizeof(lsn_t));
+        }
+
+        // constructor for BTREE_INSERT/BTREE_DELETE/BTREE_NEWPAGE type
+        LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+                  page_id_t page_id, int32_t index, int32_t count,
+                  int32_t entry_size, const char *data,
+                  const std::string &index_name = "")
+                : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+                  log_record_type_(log_record_type), page_id_(page_id),
+                  btree_index_(index), btree_count_(count),
+                  btree_entry_size_(entry_size),
+                  btree_data_(data, data + count * entry_size),
+                  index_name_(index_name) {
+            // calculate log record size
+            size_ = HEADER_SIZE + sizeof(page_id_t) + 4 * sizeof(int32_t) +
+                    btree_data_.size() + index_name.size();
+        }
+
+        // constructor for BTREE_SET_PARENT/BTREE_SET_NEXT/BTREE_ROOT type
+        LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+                  page_id_t page_id, page_id_t old_id, page_id_t new_id,
+                  const std::string &index_name = "")
+                : lsn_(INVALID_LSN), txn_id_(txn_id), prev_lsn_(prev_lsn),
+                  log_record_type_(log_record_type), page_id_(page_id),
+                  btree_old_id_(old_id), btree_new_id_(new_id),
+                  index_name_(index_name) {
+            // calculate log record size
+            size_ = HEADER_SIZE + 3 * sizeof(page_id_t) + sizeof(int32_t) +
+                    index_name.size();
+        }
+
         ~LogRecord() {}
 
         inline RID &GetDeleteRID() { return delete_rid_; }
@@ -113,6 +212,18 @@ namespace cmudb {
 
         inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+        inline const std::string &GetIndexName() { return index_name_; }
+
+        inline RID &GetUpdateRID() { return update_rid_; }
+
+        /*
+         * rebuild the new tuple from the old one (undo = false, redo) or the
+         * old tuple from the new one (undo = true) of an UPDATE record
+         * @return: false if tuple is not the image the delta was taken from
+         */
+        bool ApplyUpdateDelta(const Tuple &tuple, Tuple &result,
+                              bool undo) const;
+
         inline int32_t GetSize() { return size_; }
 
         inline lsn_t GetLSN() { return lsn_; }
@@ -155,13 +266,49 @@ namespace cmudb {
 
         // case3: for update opeartion
         RID update_rid_;
-        Tuple old_tuple_;
-        Tuple new_tuple_;
+        int32_t old_tuple_size_ = 0;
+        int32_t new_tuple_size_ = 0;
+        std::vector<char> update_delta_;
 
-        // case4: for new page opeartion
+        // case4: for new page opeartion, page_id_ also for b+ tree opeartion
         page_id_t prev_page_id_ = INVALID_PAGE_ID;
         page_id_t page_id_;
-        const static int HEADER_SIZE = 20;
+
+        // case5: for end checkpoint
+        lsn_t begin_checkpoint_lsn_ = INVALID_LSN;
+        std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+        std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+
+        // case6: for b+ tree opeartion
+        int32_t btree_index_ = 0;
+        int32_t btree_count_ = 0;
+        int32_t btree_entry_size_ = 0;
+        std::vector<char> btree_data_;
+        page_id_t btree_old_id_ = INVALID_PAGE_ID;
+        page_id_t btree_new_id_ = INVALID_PAGE_ID;
+        std::string index_name_;
+        const static int HEADER_SIZE = 28;
+        // | offset | old_len | new_len | in front of every delta range
+        const static int DELTA_RANGE_HEADER_SIZE = 3 * sizeof(int32_t);
+
+        void EncodeUpdateDelta(const Tuple &old_tuple, const Tuple &new_tuple);
+
+        // header fields are written one by one, the struct has padding
+        inline void SerializeHeader(char *dest) const {
+            memcpy(dest, &size_, sizeof(int32_t));
+            memcpy(dest + 4, &lsn_, sizeof(lsn_t));
+            memcpy(dest + 12, &txn_id_, sizeof(txn_id_t));
+            memcpy(dest + 16, &prev_lsn_, sizeof(lsn_t));
+            memcpy(dest + 24, &log_record_type_, sizeof(int32_t));
+        }
+
+        inline void DeserializeHeader(const char *src) {
+            memcpy(&size_, src, sizeof(int32_t));
+            memcpy(&lsn_, src + 4, sizeof(lsn_t));
+            memcpy(&txn_id_, src + 12, sizeof(txn_id_t));
+            memcpy(&prev_lsn_, src + 16, sizeof(lsn_t));
+            memcpy(&log_record_type_, src + 24, sizeof(int32_t));
+        }
     }; // namespace cmudb
 
 } // namespace cmudb
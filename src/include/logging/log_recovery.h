@@ -6,11 +6,19 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
+#include "logging/log_reader.h"
 #include "logging/log_record.h"
 
 namespace cmudb {
@@ -18,36 +26,113 @@ namespace cmudb {
     class LogRecovery {
     public:
         LogRecovery(DiskManager *disk_manager,
-                    BufferPoolManager *buffer_pool_manager)
+                    BufferPoolManager *buffer_pool_manager,
+                    int redo_threads = RECOVERY_REDO_THREADS)
                 : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager),
-                  offset_(0) {
-            // global transaction through recovery phase
-            log_buffer_ = new char[LOG_BUFFER_SIZE];
-        }
+                  redo_threads_(std::max(redo_threads, 1)),
+                  // prefetched pages must not evict each other before use
+                  prefetch_depth_(std::min<size_t>(
+                          RECOVERY_PREFETCH_DEPTH,
+                          buffer_pool_manager->GetPoolSize() / 2)),
+                  reader_(disk_manager) {}
 
-        ~LogRecovery() {
-            delete[] log_buffer_;
-            log_buffer_ = nullptr;
-        }
+        // analysis pass, Redo runs it first
+        void Analysis();
 
         void Redo();
 
         void Undo();
 
-        bool DeserializeLogRecord(const char *data, LogRecord &log_record);
+        /*
+         * logical undo of leaf inserts and deletes logged by the B+ tree
+         * index name, undo(entry, inserted) must remove the key & value pair
+         * entry if inserted, insert it otherwise. Records of indexes not
+         * registered are undone on the page they were logged on
+         */
+        inline void RegisterIndex(const std::string &name,
+                                  std::function<void(const char *, bool)> undo) {
+            index_undo_[name] = undo;
+        }
+
+        // expose for test purpose
+        inline const std::unordered_map<page_id_t, lsn_t> &GetDirtyPageTable() {
+            return dirty_page_table_;
+        }
+
+        inline const std::unordered_map<txn_id_t, lsn_t> &GetActiveTxnTable() {
+            return active_txn_;
+        }
+
+        inline lsn_t GetRedoLSN() { return redo_lsn_; }
+
+        // pages read ahead by the last redo
+        inline size_t GetPrefetchCount() { return prefetch_count_; }
 
     private:
+        // a record to redo on one page
+        struct RedoTask {
+            LogRecord log_record;
+            page_id_t page_id;
+        };
+
+        // queue of a redo worker thread, batches are filled by the reader
+        struct RedoWorker {
+            std::mutex latch;
+            std::condition_variable cv;
+            std::deque<std::vector<RedoTask>> batches;
+            // reader reached the end of the log
+            bool done = false;
+            std::thread thread;
+        };
+
+        // page ids waiting for the prefetch thread
+        struct Prefetcher {
+            std::mutex latch;
+            std::condition_variable cv;
+            std::deque<page_id_t> pages;
+            bool done = false;
+            std::thread thread;
+        };
+
+        // records handed to a worker at once, and batches queued per worker
+        // before the reader waits
+        const static size_t REDO_BATCH_SIZE = 64;
+        const static size_t REDO_QUEUE_DEPTH = 16;
+
+        void RedoWorkerLoop(RedoWorker *worker);
+
+        void RedoRecord(LogRecord &log_record, page_id_t page_id);
+
+        void PrefetchLoop(Prefetcher *prefetcher);
+
+        page_id_t GetRecordPageId(LogRecord &log_record);
+
+        bool NeedRedo(page_id_t page_id, lsn_t lsn);
+
+        void RedoBPlusTreeRecord(LogRecord &log_record, Page *page);
+
+        void UndoBPlusTreeRecord(LogRecord &log_record);
+
         // TODO: you can add whatever member variable here
         // Don't forget to initialize newly added variable in constructor
         DiskManager *disk_manager_;
         BufferPoolManager *buffer_pool_manager_;
+        // number of redo worker threads
+        int redo_threads_;
+        // distinct pages of upcoming records prefetched ahead of redo
+        size_t prefetch_depth_;
+        size_t prefetch_count_ = 0;
         // maintain active transactions and its corresponds latest lsn
         std::unordered_map<txn_id_t, lsn_t> active_txn_;
-        // mapping log sequence number to log file offset, for undo purpose
-        std::unordered_map<lsn_t, int> lsn_mapping_;
-        // log buffer related
-        int offset_;
-        char *log_buffer_;
+        // dirty page table from analysis, page id -> recLSN
+        std::unordered_map<page_id_t, lsn_t> dirty_page_table_;
+        // redo starts at the minimum recLSN
+        lsn_t redo_lsn_ = INVALID_LSN;
+        // streams the log file
+        LogReader reader_;
+        // index name -> logical undo of its leaf entries
+        std::unordered_map<std::string, std::function<void(const char *, bool)>>
+                index_undo_;
     };
 
 } // namespace cmudb
\ No newline at end of file
@@ -6,9 +6,9 @@
  * It actually serves as a header part for each B+ tree page and
  * contains information shared by both leaf page and internal page.
  *
- * Header format (size in byte, 20 bytes in total):
+ * Header format (size in byte, 32 bytes in total):
  * ----------------------------------------------------------------------------
- * | PageType (4) | LSN (4) | CurrentSize (4) | MaxSize (4) |
+ * | PageType (4) | Padding (4) | LSN (8) | CurrentSize (4) | MaxSize (4) |
  * ----------------------------------------------------------------------------
  * | ParentPageId (4) | PageId(4) |
  * ----------------------------------------------------------------------------
@@ -36,6 +36,10 @@ enum class IndexPageType { INVALID_INDEX_PAGE = 0, LEAF_PAGE, INTERNAL_PAGE };
 
 enum class OpType {READ = 0, INSERT, DELETE};
 
+// offset of the entry array, leaf pages also store the next page id
+#define B_PLUS_TREE_PAGE_HEADER_SIZE 32
+#define B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE 36
+
 // Abstract class.
 class BPlusTreePage {
 public:
@@ -60,6 +64,14 @@ public:
   void SetLSN(lsn_t lsn = INVALID_LSN);
   bool IsSafe(OpType opType);
 
+  /*
+   * raw access to the entry array for logging and recovery, which do not
+   * know the key type. entry_size is the size of one key & value pair
+   */
+  char *GetEntryData(int index, int entry_size);
+  void InsertEntryData(int index, const char *data, int count, int entry_size);
+  void RemoveEntryData(int index, int count, int entry_size);
+
 
 private:
   // member variable, attributes that both internal and leaf page share
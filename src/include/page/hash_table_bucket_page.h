@@ -0,0 +1,71 @@
+/**
+ * hash_table_bucket_page.h
+ *
+ * Store indexed key and record id together within a bucket page of the
+ * disk-resident extendible hash index. Only support unique key. Records are
+ * unordered but kept packed in [0, size). When the directory can no longer
+ * grow, a full bucket chains an overflow bucket page through NextPageId.
+ *
+ * Bucket page format:
+ *  ---------------------------------------------------------------------
+ * | HEADER | KEY(1) + RID(1) | KEY(2) + RID(2) | ... | KEY(n) + RID(n) |
+ *  ---------------------------------------------------------------------
+ *
+ *  Header format (size in byte, 24 bytes in total):
+ *  ---------------------------------------------------------------------
+ * | PageId (4) | Padding (4) | LSN (8) | CurrentSize (4) | NextPageId (4) |
+ *  ---------------------------------------------------------------------
+ */
+#pragma once
+
+#include <utility>
+
+#include "common/config.h"
+#include "index/generic_key.h"
+
+namespace cmudb {
+
+#define MappingType std::pair<KeyType, ValueType>
+
+#define INDEX_TEMPLATE_ARGUMENTS                                               \
+  template <typename KeyType, typename ValueType, typename KeyComparator>
+
+#define HASH_TABLE_BUCKET_PAGE_TYPE                                            \
+  HashTableBucketPage<KeyType, ValueType, KeyComparator>
+
+INDEX_TEMPLATE_ARGUMENTS
+class HashTableBucketPage {
+public:
+  // After creating a new bucket page from buffer pool, must call initialize
+  // method to set default values
+  void Init(page_id_t page_id);
+
+  page_id_t GetPageId() const;
+  page_id_t GetNextPageId() const;
+  void SetNextPageId(page_id_t next_page_id);
+
+  int GetSize() const;
+  int GetMaxSize() const;
+  bool IsFull() const;
+  bool IsEmpty() const;
+
+  KeyType KeyAt(int index) const;
+  ValueType ValueAt(int index) const;
+
+  // insert and delete methods
+  bool Lookup(const KeyType &key, ValueType &value,
+              const KeyComparator &comparator) const;
+  void Insert(const KeyType &key, const ValueType &value);
+  bool Remove(const KeyType &key, const KeyComparator &comparator);
+  void RemoveAt(int index);
+
+private:
+  int KeyIndex(const KeyType &key, const KeyComparator &comparator) const;
+
+  page_id_t page_id_;
+  lsn_t lsn_;
+  int size_;
+  page_id_t next_page_id_;
+  MappingType array[0];
+};
+} // namespace cmudb
@@ -0,0 +1,83 @@
+/**
+ * hash_table_directory_page.h
+ *
+ * Directory page of the disk-resident extendible hash index. The low
+ * global_depth bits of a key's hash select a directory slot, which holds the
+ * page id of the bucket page containing that key together with the local
+ * depth of that bucket. The slots live in slot pages, the directory page
+ * keeps the global depth and the slot page ids.
+ * Up to SLOT_PAGE_DEPTH the whole directory fits into the first slot page.
+ * Beyond that there are DIRECTORY_ARRAY_SIZE slot pages and slot i lives in
+ * slot page i % N at offset i / N. Every local depth is then kept at least
+ * SLOT_PAGE_DEPTH, so all the slots of a bucket share one slot page and a
+ * split or merge changes a single slot page. The number of buckets of every
+ * local depth is counted here, so whether the directory can shrink is known
+ * without reading the slot pages.
+ *
+ * Directory page format (size in byte):
+ *  -------------------------------------------------------------------------
+ * | PageId (4) | Padding (4) | LSN (8) | GlobalDepth (4) | BucketCount_0 (4) |
+ *  -------------------------------------------------------------------------
+ *  ----------------------------------------------------------------
+ * | ... (4 * M) | SlotPageId_1 (4) | ... (4 * N)                   |
+ *  ----------------------------------------------------------------
+ * N = DIRECTORY_ARRAY_SIZE, M = DIRECTORY_MAX_DEPTH
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "common/config.h"
+#include "page/hash_table_slot_page.h"
+
+namespace cmudb {
+
+constexpr uint32_t Log2(uint32_t n) { return n <= 1 ? 0 : 1 + Log2(n / 2); }
+
+// largest global depth whose directory fits into one slot page
+#define SLOT_PAGE_DEPTH Log2(DIRECTORY_ARRAY_SIZE)
+// N slot pages of N slots
+#define DIRECTORY_MAX_DEPTH (2 * SLOT_PAGE_DEPTH)
+
+class HashTableDirectoryPage {
+public:
+  // After creating a new directory page from buffer pool, must call
+  // initialize method to set default values
+  void Init(page_id_t page_id, page_id_t slot_page_id);
+
+  page_id_t GetPageId() const;
+
+  // global depth related
+  uint32_t GetGlobalDepth() const;
+  uint32_t GetGlobalDepthMask() const;
+  uint32_t Size() const;
+  bool CanGrow() const;
+  void IncrGlobalDepth();
+  void DecrGlobalDepth();
+  bool CanShrink() const;
+
+  // bucket count per local depth, split turns a bucket of local_depth into
+  // two of local_depth + 1 and merge back
+  void SplitBucket(uint32_t local_depth);
+  void MergeBuckets(uint32_t local_depth);
+
+  // slot page related
+  uint32_t NumSlotPages() const;
+  uint32_t SlotPageIndex(uint32_t bucket_idx) const;
+  uint32_t SlotOffset(uint32_t bucket_idx) const;
+  page_id_t GetSlotPageId(uint32_t slot_page_idx) const;
+  void SetSlotPageId(uint32_t slot_page_idx, page_id_t slot_page_id);
+
+private:
+  page_id_t page_id_;
+  lsn_t lsn_;
+  uint32_t global_depth_;
+  uint32_t bucket_counts_[DIRECTORY_MAX_DEPTH + 1];
+  page_id_t slot_page_ids_[DIRECTORY_ARRAY_SIZE];
+};
+
+static_assert(sizeof(HashTableDirectoryPage) <= PAGE_SIZE,
+              "hash table directory does not fit into one page");
+
+} // namespace cmudb
@@ -0,0 +1,58 @@
+/**
+ * hash_table_slot_page.h
+ *
+ * Slot page of the disk-resident extendible hash index. The directory slots
+ * are spread over slot pages, each slot holds the page id of a bucket page
+ * together with the local depth of that bucket. HashTableDirectoryPage
+ * decides which slot page and offset a directory slot lives at.
+ *
+ * Slot page format (size in byte):
+ *  -------------------------------------------------------------------------
+ * | PageId (4) | Padding (4) | LSN (8) | LocalDepth_1 (1) | ... (1 * N)     |
+ *  -------------------------------------------------------------------------
+ *  -------------------------------------
+ * | BucketPageId_1 (4) | ... (4 * N)    |
+ *  -------------------------------------
+ * N = DIRECTORY_ARRAY_SIZE
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "common/config.h"
+
+namespace cmudb {
+
+// largest power of two N such that a slot page (16 + 5 * N bytes) fits into
+// one page
+constexpr uint32_t DirectoryArraySize(uint32_t n = 1) {
+  return 16 + 5 * (2 * n) <= PAGE_SIZE ? DirectoryArraySize(2 * n) : n;
+}
+
+#define DIRECTORY_ARRAY_SIZE DirectoryArraySize()
+
+class HashTableSlotPage {
+public:
+  // After creating a new slot page from buffer pool, must call initialize
+  // method to set default values
+  void Init(page_id_t page_id);
+
+  page_id_t GetPageId() const;
+
+  page_id_t GetBucketPageId(uint32_t offset) const;
+  void SetBucketPageId(uint32_t offset, page_id_t bucket_page_id);
+  uint32_t GetLocalDepth(uint32_t offset) const;
+  void SetLocalDepth(uint32_t offset, uint32_t local_depth);
+
+private:
+  page_id_t page_id_;
+  lsn_t lsn_;
+  uint8_t local_depths_[DIRECTORY_ARRAY_SIZE];
+  page_id_t bucket_page_ids_[DIRECTORY_ARRAY_SIZE];
+};
+
+static_assert(sizeof(HashTableSlotPage) <= PAGE_SIZE,
+              "hash table slot page does not fit into one page");
+
+} // namespace cmudb
@@ -6,9 +6,13 @@
  * 32 bytes) and their corresponding root_id
  *
  * Format (size in byte):
- *  -----------------------------------------------------------------
- * | RecordCount (4) | Entry_1 name (32) | Entry_1 root_id (4) | ... |
- *  -----------------------------------------------------------------
+ *  ---------------------------------------------------------------------
+ * | RecordCount (4) | Padding (4) | LSN (8) | Entry_1 name (32) |
+ *  ---------------------------------------------------------------------
+ * | Entry_1 root_id (4) | ... |
+ *  ---------------------------------------------------------------------
+ * LSN is at the same offset as in the other pages, root id changes of a B+
+ * tree are logged against it
  */
 
 #pragma once
@@ -40,5 +44,9 @@ private:
   int FindRecord(const std::string &name);
 
   void SetRecordCount(int record_count);
+
+  // records start after the LSN
+  static constexpr int RECORDS_OFFSET = 16;
+  static constexpr int RECORD_SIZE = 36;
 };
 } // namespace cmudb
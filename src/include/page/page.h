@@ -34,8 +34,10 @@ public:
   inline void RUnlatch() { rwlatch_.RUnlock(); }
   inline void RLatch() { rwlatch_.RLock(); }
 
-  inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + 4); }
-  inline void SetLSN(lsn_t lsn) { memcpy(GetData() + 4, &lsn, 4); }
+  // every page type keeps its LSN at offset 8, where an 8 byte field
+  // following a 4 byte one is naturally aligned
+  inline lsn_t GetLSN() { return *reinterpret_cast<lsn_t *>(GetData() + 8); }
+  inline void SetLSN(lsn_t lsn) { memcpy(GetData() + 8, &lsn, sizeof(lsn_t)); }
 
 private:
   // method used by buffer pool manager
@@ -45,6 +47,9 @@ private:
   page_id_t page_id_ = INVALID_PAGE_ID;
   int pin_count_ = 0;
   bool is_dirty_ = false;
+  // no log record before rec_lsn_ touched the page since it was last written
+  // to disk, INVALID_LSN while the page is clean and unpinned
+  lsn_t rec_lsn_ = INVALID_LSN;
   RWMutex rwlatch_;
 };
 
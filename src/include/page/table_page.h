@@ -10,7 +10,7 @@
  *
  *  Header format (size in byte):
  *  --------------------------------------------------------------------------
- * | PageId (4)| LSN (4)| PrevPageId (4)| NextPageId (4)| FreeSpacePointer(4) |
+ * | PageId (4)| PrevPageId (4)| LSN (8)| NextPageId (4)| FreeSpacePointer(4) |
  *  --------------------------------------------------------------------------
  *  --------------------------------------------------------------
  * | TupleCount (4) | Tuple_1 offset (4) | Tuple_1 size (4) | ... |
@@ -45,6 +45,8 @@ public:
 
   /**
    * Tuple related
+   * with logging enabled tuples are locked in lock_manager, which is nullptr
+   * if the table or page lock of the transaction already covers the tuple
    */
   bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn,
                    LockManager *lock_manager,
@@ -65,21 +67,27 @@ public:
   bool GetTuple(const RID &rid, Tuple &tuple, Transaction *txn,
                 LockManager *lock_manager);
 
+  // copy out the tuple without locking, false if rid holds no live tuple
+  bool ReadTuple(const RID &rid, Tuple &tuple);
+
+  // page LSN lives in the page header, so it reaches disk with the page
   inline void setPageLSN( lsn_t pageLSN ){
-      pageLSN_ = pageLSN;
+      SetLSN(pageLSN);
   }
   inline lsn_t GetPageLSN(){
-      return pageLSN_;
+      return GetLSN();
   }
 
   /**
    * Tuple iterator
+   * all_slots also visits empty slots and deleted tuples, which older
+   * snapshots may still see
    */
-  bool GetFirstTupleRid(RID &first_rid);
-  bool GetNextTupleRid(const RID &cur_rid, RID &next_rid);
+  bool GetFirstTupleRid(RID &first_rid, bool all_slots = false);
+  bool GetNextTupleRid(const RID &cur_rid, RID &next_rid,
+                       bool all_slots = false);
 
 private:
-    lsn_t pageLSN_;
   /**
    * helper functions
    */
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/version_manager.h"
 #include "logging/log_manager.h"
 #include "page/table_page.h"
 #include "table/table_iterator.h"
@@ -20,13 +21,19 @@ class TableHeap {
 public:
   ~TableHeap() {}
 
+  /*
+   * with a version manager writes keep version chains of the tuples they
+   * replace, and transactions with a snapshot read without locks
+   */
   // open a table heap
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager,
-            LogManager *log_manager, page_id_t first_page_id);
+            LogManager *log_manager, page_id_t first_page_id,
+            VersionManager *version_manager = nullptr);
 
   // create table heap
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager,
-            LogManager *log_manager, Transaction *txn);
+            LogManager *log_manager, Transaction *txn,
+            VersionManager *version_manager = nullptr);
 
   // for insert, if tuple is too large (>~page_size), return false
   bool InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn);
@@ -52,13 +59,24 @@ public:
 
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  // whether txn reads its snapshot
+  inline bool ReadsSnapshot(Transaction *txn) const {
+    return version_manager_ != nullptr && txn != nullptr &&
+           txn->GetReadTimestamp() != INVALID_TIMESTAMP;
+  }
+
 private:
+  // exclusive lock & snapshot isolation check before a snapshot writer
+  // overwrites rid
+  bool LockForWrite(const RID &rid, Transaction *txn, bool covered);
+
   /**
    * Members
    */
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
+  VersionManager *version_manager_;
   page_id_t first_page_id_;
 };
 
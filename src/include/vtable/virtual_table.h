@@ -8,6 +8,8 @@
 #include "catalog/schema.h"
 #include "concurrency/transaction_manager.h"
 #include "index/b_plus_tree_index.h"
+#include "index/extendible_hash_table_index.h"
+#include "logging/checkpoint_manager.h"
 #include "logging/log_manager.h"
 #include "sqlite/sqlite3ext.h"
 #include "table/table_heap.h"
@@ -76,10 +78,22 @@ public:
 
     // txn related
     lock_manager_ = new LockManager(true); // S2PL
-    transaction_manager_ = new TransactionManager(lock_manager_, log_manager_);
+    // snapshot reads, readers and writers do not block each other
+    version_manager_ = new VersionManager(buffer_pool_manager_, log_manager_);
+    version_manager_->RunGCThread();
+    transaction_manager_ =
+        new TransactionManager(lock_manager_, log_manager_, version_manager_);
+    checkpoint_manager_ = new CheckpointManager(
+        transaction_manager_, log_manager_, buffer_pool_manager_);
+    // checkpoints start once logging is enabled
+    checkpoint_manager_->RunCheckpointThread();
   }
 
   ~StorageEngine() {
+    // a checkpoint waits for the log flush thread
+    checkpoint_manager_->StopCheckpointThread();
+    // the garbage collector frees slots through the buffer pool and the log
+    version_manager_->StopGCThread();
     if (ENABLE_LOGGING)
       log_manager_->StopFlushThread();
     delete disk_manager_;
@@ -87,13 +101,17 @@ public:
     delete log_manager_;
     delete lock_manager_;
     delete transaction_manager_;
+    delete version_manager_;
+    delete checkpoint_manager_;
   }
 
   DiskManager *disk_manager_;
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   TransactionManager *transaction_manager_;
+  VersionManager *version_manager_;
   LogManager *log_manager_;
+  CheckpointManager *checkpoint_manager_;
 };
 
 StorageEngine *storage_engine_;
@@ -110,13 +128,14 @@ public:
       : schema_(schema), index_(index) {
     if (first_page_id != INVALID_PAGE_ID) {
       // reopen an exist table
-      table_heap_ = new TableHeap(buffer_pool_manager, lock_manager,
-                                  log_manager, first_page_id);
+      table_heap_ =
+          new TableHeap(buffer_pool_manager, lock_manager, log_manager,
+                        first_page_id, storage_engine_->version_manager_);
     } else {
       // create table for the first time
       Transaction *txn = storage_engine_->transaction_manager_->Begin();
-      table_heap_ =
-          new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn);
+      table_heap_ = new TableHeap(buffer_pool_manager, lock_manager, log_manager,
+                                  txn, storage_engine_->version_manager_);
       storage_engine_->transaction_manager_->Commit(txn);
     }
   }
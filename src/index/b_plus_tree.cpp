@@ -1,6 +1,7 @@
 /**
  * b_plus_tree.cpp
  */
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <memory>
@@ -17,9 +18,11 @@ namespace cmudb {
     BPLUSTREE_TYPE::BPlusTree(const std::string &name,
                               BufferPoolManager *buffer_pool_manager,
                               const KeyComparator &comparator,
-                              page_id_t root_page_id)
+                              page_id_t root_page_id,
+                              LogManager *log_manager)
             : index_name_(name), root_page_id_(root_page_id),
-              buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) {
+              buffer_pool_manager_(buffer_pool_manager), comparator_(comparator),
+              log_manager_(log_manager) {
 
     }
 
@@ -72,7 +75,7 @@ namespace cmudb {
                                 Transaction *transaction) {
         LockRootPageId(true);
         if (IsEmpty()) {
-            StartNewTree(key, value);
+            StartNewTree(key, value, transaction);
             TryUnlockRootPageId(true);
             return true;
         } else {
@@ -87,14 +90,25 @@ namespace cmudb {
  * tree's root page id and insert entry directly into leaf page.
  */
     INDEX_TEMPLATE_ARGUMENTS
-    void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {
+    void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value,
+                                      Transaction *transaction) {
+        lsn_t smo_prev_lsn = BeginSMO(transaction);
         Page *new_page = buffer_pool_manager_->NewPage(root_page_id_); //树的根节点page_id由buffer_pool_manager分配
         if (new_page == nullptr)
             throw Exception(EXCEPTION_TYPE_INDEX, "no free pages to allocate");
         auto root = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(new_page->GetData());
 
         root->Init(root_page_id_, INVALID_PAGE_ID); //根节点父节点无效
+        LogNewPage(root, transaction);
+        UpdateRootPageId(true, transaction);
+        EndSMO(smo_prev_lsn, transaction);
+
         root->Insert(key, value, comparator_);
+        if (IsLogging())
+            root->SetLSN(AppendLogRecord(LogRecordType::BTREE_INSERT, root_page_id_, 0, 1,
+                                         sizeof(MappingType),
+                                         root->GetEntryData(0, sizeof(MappingType)),
+                                         true, transaction));
         buffer_pool_manager_->UnpinPage(root_page_id_, true);
     }
 
@@ -119,15 +133,24 @@ namespace cmudb {
         /*
          * 此时leaf_page持有锁
          */
+        int index = leaf_page->KeyIndex(key, comparator_);
         leaf_page->Insert(key, value, comparator_);
+        if (IsLogging())
+            leaf_page->SetLSN(AppendLogRecord(LogRecordType::BTREE_INSERT,
+                                              leaf_page->GetPageId(), index, 1,
+                                              sizeof(MappingType),
+                                              leaf_page->GetEntryData(index, sizeof(MappingType)),
+                                              true, transaction));
         if ( leaf_page->GetSize() > leaf_page->GetMaxSize() ) {
             /*
              * leaf_page及其父节点均持有写锁
              */
+            lsn_t smo_prev_lsn = BeginSMO(transaction);
             auto alloc_page =
                     Split<BPlusTreeLeafPage<KeyType, ValueType, KeyComparator> >(leaf_page, transaction);
             InsertIntoParent(leaf_page,
                              alloc_page->KeyAt(0), alloc_page, transaction);
+            EndSMO(smo_prev_lsn, transaction);
         }
         ReleasePageInTransaction(true, transaction);
         return true;
@@ -159,7 +182,12 @@ namespace cmudb {
 
         N *index_page = reinterpret_cast<N *>(alloc_page->GetData());
         index_page->Init(alloc_page_id);
+        LogNewPage(index_page, transaction);
+        auto node_snapshot = TakeSnapshot(node);
+        auto index_page_snapshot = TakeSnapshot(index_page);
         node->MoveHalfTo(index_page, buffer_pool_manager_);
+        LogSnapshotDiff(node_snapshot, transaction);
+        LogSnapshotDiff(index_page_snapshot, transaction, node->GetPageId());
 
         return index_page;
     }
@@ -184,11 +212,18 @@ namespace cmudb {
             auto root_page =
                     reinterpret_cast< BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(new_page->GetData());
             root_page->Init(root_id);
+            LogNewPage(root_page, transaction);
+            auto root_snapshot = TakeSnapshot(root_page);
+            auto old_node_snapshot = TakeSnapshot(old_node);
+            auto new_node_snapshot = TakeSnapshot(new_node);
             root_page_id_ = root_id;
             old_node->SetParentPageId(root_id);
             new_node->SetParentPageId(root_id);
             root_page->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
-            UpdateRootPageId(false);
+            LogSnapshotDiff(root_snapshot, transaction);
+            LogSnapshotDiff(old_node_snapshot, transaction);
+            LogSnapshotDiff(new_node_snapshot, transaction);
+            UpdateRootPageId(false, transaction);
             buffer_pool_manager_->UnpinPage(root_page_id_, true);
             return;
         }
@@ -201,8 +236,12 @@ namespace cmudb {
              * 在执行分裂，注意递归过程中页的Unpin操作
              * 最终函数返回到InsertIntoLeafPage函数时，注意执行unpin leaf page操作
              */
+            auto parent_snapshot = TakeSnapshot(parent_page);
+            auto new_node_snapshot = TakeSnapshot(new_node);
             parent_page->InsertNodeAfter(old_node->GetPageId(), key, new_node->GetPageId());
             new_node->SetParentPageId(parent_page->GetPageId());
+            LogSnapshotDiff(parent_snapshot, transaction);
+            LogSnapshotDiff(new_node_snapshot, transaction);
             if (parent_page->GetSize() > parent_page->GetMaxSize()) {
                 auto alloc_internal_page =
                         Split<BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> >(parent_page, transaction);
@@ -228,9 +267,25 @@ namespace cmudb {
             return;
         }*/
         auto leaf_page = FindLeafPage(key, OpType::DELETE, false, transaction);
+        if (leaf_page == nullptr)
+            return;
+        // 删除前记录被删除的entry
+        int index = leaf_page->KeyIndex(key, comparator_);
+        lsn_t lsn = INVALID_LSN;
+        if (IsLogging() && index < leaf_page->GetSize() &&
+            comparator_(key, leaf_page->KeyAt(index)) == 0)
+            lsn = AppendLogRecord(LogRecordType::BTREE_DELETE, leaf_page->GetPageId(),
+                                  index, 1, sizeof(MappingType),
+                                  leaf_page->GetEntryData(index, sizeof(MappingType)),
+                                  true, transaction);
         leaf_page->RemoveAndDeleteRecord(key, comparator_);
-        if ( leaf_page->GetSize() < leaf_page->GetMinSize() )
+        if (lsn != INVALID_LSN)
+            leaf_page->SetLSN(lsn);
+        if ( leaf_page->GetSize() < leaf_page->GetMinSize() ) {
+            lsn_t smo_prev_lsn = BeginSMO(transaction);
             CoalesceOrRedistribute(leaf_page, transaction);
+            EndSMO(smo_prev_lsn, transaction);
+        }
         ReleasePageInTransaction(true, transaction);
 
     }
@@ -246,7 +301,7 @@ namespace cmudb {
     template<typename N>
     bool BPLUSTREE_TYPE::CoalesceOrRedistribute(N *node, Transaction *transaction) {
         if (node->IsRootPage()) {
-            bool ret = AdjustRoot(node);
+            bool ret = AdjustRoot(node, transaction);
             if (ret) transaction->AddIntoDeletedPageSet(node->GetPageId());
             return ret;
         } else {
@@ -274,7 +329,13 @@ namespace cmudb {
                 buffer_pool_manager_->UnpinPage(parent_id, true);
                 return true;
             } else {
+                auto sibling_snapshot = TakeSnapshot(sibling_page);
+                auto node_snapshot = TakeSnapshot(node);
+                auto parent_snapshot = TakeSnapshot(page);
                 Redistribute(sibling_page, node, index);
+                LogSnapshotDiff(sibling_snapshot, transaction);
+                LogSnapshotDiff(node_snapshot, transaction, sibling_page->GetPageId());
+                LogSnapshotDiff(parent_snapshot, transaction);
                 buffer_pool_manager_->UnpinPage(parent_id, true);
                 return false;
             }
@@ -300,9 +361,16 @@ namespace cmudb {
             BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *&parent,
             int index, Transaction *transaction) {
 
+        auto neighbor_snapshot = TakeSnapshot(neighbor_node);
+        auto node_snapshot = TakeSnapshot(node);
+        auto parent_snapshot = TakeSnapshot(parent);
         node->MoveAllTo(neighbor_node, index, buffer_pool_manager_);
         transaction->AddIntoDeletedPageSet(node->GetPageId());
         parent->Remove(index);
+        // parent的修改要在递归之前记录
+        LogSnapshotDiff(neighbor_snapshot, transaction, node->GetPageId());
+        LogSnapshotDiff(node_snapshot, transaction);
+        LogSnapshotDiff(parent_snapshot, transaction);
         if (parent->GetSize() < parent->GetMinSize())
             return CoalesceOrRedistribute(parent, transaction);
         return false;
@@ -336,12 +404,13 @@ namespace cmudb {
  * happend
  */
     INDEX_TEMPLATE_ARGUMENTS
-    bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
+    bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node,
+                                    Transaction *transaction) {
         if (old_root_node->IsLeafPage()) {
             int num = old_root_node->GetSize();
             if (num == 0) {
                 root_page_id_ = INVALID_PAGE_ID;
-                UpdateRootPageId(false);
+                UpdateRootPageId(false, transaction);
                 return true;
             }
             return false;
@@ -356,8 +425,10 @@ namespace cmudb {
 
                 auto child_page = buffer_pool_manager_->FetchPage(child_pageId);
                 auto child_page_node = reinterpret_cast<B_PLUS_TREE_INTERNAL_PAGE_TYPE *>(child_page->GetData());
+                auto child_snapshot = TakeSnapshot(child_page_node);
                 child_page_node->SetParentPageId(INVALID_PAGE_ID);
-                UpdateRootPageId(false);
+                LogSnapshotDiff(child_snapshot, transaction);
+                UpdateRootPageId(false, transaction);
 
                 buffer_pool_manager_->UnpinPage(child_pageId, true);
                 return true;
@@ -481,21 +552,233 @@ namespace cmudb {
  * Call this method everytime root page id is changed.
  * @parameter: insert_record      defualt value is false. When set to true,
  * insert a record <index_name, root_page_id> into header page instead of
- * updating it.
+ * updating it, unless the index already has one.
  */
     INDEX_TEMPLATE_ARGUMENTS
-    void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
+    void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record,
+                                          Transaction *transaction) {
         HeaderPage *header_page = static_cast<HeaderPage *>(
                 buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-        if (insert_record)
+        page_id_t old_root_id = INVALID_PAGE_ID;
+        bool exists = header_page->GetRootId(index_name_, old_root_id);
+        bool changed;
+        if (insert_record && !exists)
             // create a new record<index_name + root_page_id> in header_page
-            header_page->InsertRecord(index_name_, root_page_id_);
+            changed = header_page->InsertRecord(index_name_, root_page_id_);
         else
             // update root_page_id in header_page
-            header_page->UpdateRecord(index_name_, root_page_id_);
+            changed = header_page->UpdateRecord(index_name_, root_page_id_);
+        if (changed && IsLogging())
+            header_page->SetLSN(AppendLogRecord(LogRecordType::BTREE_ROOT, HEADER_PAGE_ID,
+                                                old_root_id, root_page_id_, transaction));
         buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
     }
 
+/*****************************************************************************
+ * LOGGING
+ *****************************************************************************/
+/*
+ * size of one key & value pair of node
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    int BPLUSTREE_TYPE::EntrySize(BPlusTreePage *node) {
+        return node->IsLeafPage() ? sizeof(MappingType)
+                                  : sizeof(std::pair<KeyType, page_id_t>);
+    }
+
+/*
+ * append a BTREE_INSERT/BTREE_DELETE/BTREE_NEWPAGE record to the chain of
+ * transaction. Logical records (leaf inserts and deletes of the user) carry
+ * the index name, recovery undoes them through the tree, the others are
+ * undone on the page
+ * @return: lsn of the record, caller sets it as page lsn
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    lsn_t BPLUSTREE_TYPE::AppendLogRecord(LogRecordType type, page_id_t page_id,
+                                          int index, int count, int entry_size,
+                                          const char *data, bool logical,
+                                          Transaction *transaction) {
+        LogRecord log_record(
+                transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(),
+                type, page_id, index, count, entry_size, data,
+                logical ? index_name_ : std::string());
+        lsn_t lsn = log_manager_->AppendLogRecord(log_record);
+        if (transaction != nullptr)
+            transaction->SetPrevLSN(lsn);
+        return lsn;
+    }
+
+/*
+ * append a BTREE_SET_PARENT/BTREE_SET_NEXT/BTREE_ROOT record, page_id's link
+ * changes from old_id to new_id
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    lsn_t BPLUSTREE_TYPE::AppendLogRecord(LogRecordType type, page_id_t page_id,
+                                          page_id_t old_id, page_id_t new_id,
+                                          Transaction *transaction) {
+        LogRecord log_record(
+                transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId(),
+                transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN(),
+                type, page_id, old_id, new_id,
+                type == LogRecordType::BTREE_ROOT ? index_name_ : std::string());
+        lsn_t lsn = log_manager_->AppendLogRecord(log_record);
+        if (transaction != nullptr)
+            transaction->SetPrevLSN(lsn);
+        return lsn;
+    }
+
+/*
+ * log the header of a page just initialized, redo copies it back
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    void BPLUSTREE_TYPE::LogNewPage(BPlusTreePage *node, Transaction *transaction) {
+        if (!IsLogging())
+            return;
+        int header_size = node->IsLeafPage() ? B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE
+                                             : B_PLUS_TREE_PAGE_HEADER_SIZE;
+        node->SetLSN(AppendLogRecord(LogRecordType::BTREE_NEWPAGE, node->GetPageId(),
+                                     0, 1, header_size,
+                                     reinterpret_cast<char *>(node), false,
+                                     transaction));
+    }
+
+/*
+ * remember the entries and links of node before a structure modification,
+ * the snapshot is empty when nothing is logged
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    typename BPLUSTREE_TYPE::PageSnapshot
+    BPLUSTREE_TYPE::TakeSnapshot(BPlusTreePage *node) {
+        PageSnapshot snapshot{nullptr, INVALID_PAGE_ID, INVALID_PAGE_ID, {}};
+        if (!IsLogging())
+            return snapshot;
+        snapshot.node = node;
+        snapshot.parent_id = node->GetParentPageId();
+        if (node->IsLeafPage())
+            snapshot.next_id =
+                    static_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node)->GetNextPageId();
+        int entry_size = EntrySize(node);
+        const char *entries = node->GetEntryData(0, entry_size);
+        snapshot.entries.assign(entries, entries + node->GetSize() * entry_size);
+        return snapshot;
+    }
+
+/*
+ * log how the page of snapshot changed since: the entries between the
+ * unchanged prefix and suffix as a BTREE_DELETE of the old ones plus a
+ * BTREE_INSERT of the new ones, and changed parent/next links.
+ * children_from is the page entries of an internal page were moved from,
+ * the children newly referenced by the page now point to it as parent,
+ * which is logged against the children
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    void BPLUSTREE_TYPE::LogSnapshotDiff(const PageSnapshot &snapshot,
+                                         Transaction *transaction,
+                                         page_id_t children_from) {
+        BPlusTreePage *node = snapshot.node;
+        if (node == nullptr)
+            return;
+        page_id_t page_id = node->GetPageId();
+        int entry_size = EntrySize(node);
+        int old_size = snapshot.entries.size() / entry_size;
+        int new_size = node->GetSize();
+        const char *old_entries = snapshot.entries.data();
+        const char *new_entries = node->GetEntryData(0, entry_size);
+        int prefix = 0;
+        while (prefix < old_size && prefix < new_size &&
+               memcmp(old_entries + prefix * entry_size,
+                      new_entries + prefix * entry_size, entry_size) == 0)
+            prefix++;
+        int suffix = 0;
+        while (prefix + suffix < old_size && prefix + suffix < new_size &&
+               memcmp(old_entries + (old_size - 1 - suffix) * entry_size,
+                      new_entries + (new_size - 1 - suffix) * entry_size,
+                      entry_size) == 0)
+            suffix++;
+
+        lsn_t lsn = INVALID_LSN;
+        if (old_size > prefix + suffix)
+            lsn = AppendLogRecord(LogRecordType::BTREE_DELETE, page_id, prefix,
+                                  old_size - prefix - suffix, entry_size,
+                                  old_entries + prefix * entry_size, false,
+                                  transaction);
+        if (new_size > prefix + suffix)
+            lsn = AppendLogRecord(LogRecordType::BTREE_INSERT, page_id, prefix,
+                                  new_size - prefix - suffix, entry_size,
+                                  new_entries + prefix * entry_size, false,
+                                  transaction);
+        if (node->GetParentPageId() != snapshot.parent_id)
+            lsn = AppendLogRecord(LogRecordType::BTREE_SET_PARENT, page_id,
+                                  snapshot.parent_id, node->GetParentPageId(),
+                                  transaction);
+        if (node->IsLeafPage()) {
+            page_id_t next_id =
+                    static_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(node)->GetNextPageId();
+            if (next_id != snapshot.next_id)
+                lsn = AppendLogRecord(LogRecordType::BTREE_SET_NEXT, page_id,
+                                      snapshot.next_id, next_id, transaction);
+        }
+        if (lsn != INVALID_LSN)
+            node->SetLSN(lsn);
+
+        if (children_from == INVALID_PAGE_ID || node->IsLeafPage())
+            return;
+        typedef std::pair<KeyType, page_id_t> InternalMappingType;
+        auto old_children = reinterpret_cast<const InternalMappingType *>(old_entries);
+        auto new_children = reinterpret_cast<const InternalMappingType *>(new_entries);
+        for (int i = prefix; i < new_size - suffix; i++) {
+            page_id_t child_id = new_children[i].second;
+            bool moved = true;
+            for (int j = 0; j < old_size && moved; j++)
+                moved = old_children[j].second != child_id;
+            if (!moved)
+                continue;
+            auto child = reinterpret_cast<BPlusTreePage *>(
+                    buffer_pool_manager_->FetchPage(child_id)->GetData());
+            child->SetLSN(AppendLogRecord(LogRecordType::BTREE_SET_PARENT, child_id,
+                                          children_from, page_id, transaction));
+            buffer_pool_manager_->UnpinPage(child_id, true);
+        }
+    }
+
+/*
+ * a structure modification is a nested top action: once BTREE_SMO_END is
+ * logged it survives the rollback of the transaction, whose undo jumps from
+ * BTREE_SMO_END back to the lsn before the modification. An interrupted one
+ * is undone page by page
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    lsn_t BPLUSTREE_TYPE::BeginSMO(Transaction *transaction) {
+        return transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN();
+    }
+
+    INDEX_TEMPLATE_ARGUMENTS
+    void BPLUSTREE_TYPE::EndSMO(lsn_t smo_prev_lsn, Transaction *transaction) {
+        // nothing to skip without a transaction or a logged change
+        if (!IsLogging() || transaction == nullptr ||
+            transaction->GetPrevLSN() == smo_prev_lsn)
+            return;
+        LogRecord log_record(transaction->GetTransactionId(), smo_prev_lsn,
+                             LogRecordType::BTREE_SMO_END);
+        transaction->SetPrevLSN(log_manager_->AppendLogRecord(log_record));
+    }
+
+/*
+ * Logical undo of a leaf insert or delete, used by recovery. The entry may
+ * have moved to another page since it was logged, so it goes through the
+ * tree
+ */
+    INDEX_TEMPLATE_ARGUMENTS
+    void BPLUSTREE_TYPE::UndoEntry(const char *entry, bool inserted) {
+        auto &pair = *reinterpret_cast<const MappingType *>(entry);
+        Transaction transaction(INVALID_TXN_ID);
+        if (inserted)
+            Remove(pair.first, &transaction);
+        else
+            Insert(pair.first, pair.second, &transaction);
+    }
+
 /*
  * This method is used for debug only
  * print out whole b+tree sturcture, rank by rank
@@ -0,0 +1,806 @@
+/**
+ * extendible_hash_table.cpp
+ */
+#include <cassert>
+
+#include "common/rid.h"
+#include "index/extendible_hash_table.h"
+#include "page/header_page.h"
+
+namespace cmudb {
+
+INDEX_TEMPLATE_ARGUMENTS
+EXTENDIBLE_HASH_TABLE_TYPE::ExtendibleHashTable(
+    const std::string &name, BufferPoolManager *buffer_pool_manager,
+    const KeyComparator &comparator, page_id_t directory_page_id)
+    : index_name_(name), directory_page_id_(directory_page_id),
+      buffer_pool_manager_(buffer_pool_manager), comparator_(comparator) {}
+
+/*
+ * Helper function to decide whether current hash table is empty
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::IsEmpty() const {
+  return directory_page_id_ == INVALID_PAGE_ID;
+}
+
+/*
+ * 64-bit FNV-1a over the raw key bytes, folded down to 32 bits so that the
+ * low bits used by the directory depend on every byte of the key
+ */
+INDEX_TEMPLATE_ARGUMENTS
+uint32_t EXTENDIBLE_HASH_TABLE_TYPE::Hash(const KeyType &key) const {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&key);
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < sizeof(KeyType); i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+/*
+ * Every page access may fail when all frames of the buffer pool are pinned.
+ * Like TableHeap, the operation then unpins what it holds, releases
+ * table_latch_ and returns false instead of leaving the table latched.
+ */
+
+/*
+ * allocate and initialize an empty bucket page, caller must unpin it
+ * @return: nullptr if there is no free frame
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *EXTENDIBLE_HASH_TABLE_TYPE::NewBucketPage(page_id_t &page_id) {
+  Page *page = buffer_pool_manager_->NewPage(page_id);
+  if (page != nullptr)
+    reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(page->GetData())
+        ->Init(page_id);
+  return page;
+}
+
+/*
+ * Create the directory page together with its first slot page and bucket,
+ * and record the directory page id in header page. Caller must hold
+ * table_latch_ in write mode
+ * @return: false if there is no free frame
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::CreateDirectory() {
+  page_id_t directory_page_id, slot_page_id, bucket_page_id;
+  Page *directory_page = buffer_pool_manager_->NewPage(directory_page_id);
+  if (directory_page == nullptr)
+    return false;
+  Page *slot_page = buffer_pool_manager_->NewPage(slot_page_id);
+  Page *bucket_page =
+      slot_page == nullptr ? nullptr : NewBucketPage(bucket_page_id);
+  if (bucket_page == nullptr) {
+    if (slot_page != nullptr) {
+      buffer_pool_manager_->UnpinPage(slot_page_id, false);
+      buffer_pool_manager_->DeletePage(slot_page_id);
+    }
+    buffer_pool_manager_->UnpinPage(directory_page_id, false);
+    buffer_pool_manager_->DeletePage(directory_page_id);
+    return false;
+  }
+  auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+  slots->Init(slot_page_id);
+  slots->SetBucketPageId(0, bucket_page_id);
+  slots->SetLocalDepth(0, 0);
+  reinterpret_cast<HashTableDirectoryPage *>(directory_page->GetData())
+      ->Init(directory_page_id, slot_page_id);
+  buffer_pool_manager_->UnpinPage(bucket_page_id, true);
+  buffer_pool_manager_->UnpinPage(slot_page_id, true);
+  buffer_pool_manager_->UnpinPage(directory_page_id, true);
+
+  directory_page_id_ = directory_page_id;
+  UpdateDirectoryPageId(true);
+  return true;
+}
+
+/*****************************************************************************
+ * DIRECTORY
+ *****************************************************************************/
+/*
+ * fetch the slot page holding directory slot bucket_idx, caller must unpin it
+ * @return: nullptr if there is no free frame
+ */
+INDEX_TEMPLATE_ARGUMENTS
+Page *EXTENDIBLE_HASH_TABLE_TYPE::FetchSlotPage(
+    HashTableDirectoryPage *directory, uint32_t bucket_idx) {
+  return buffer_pool_manager_->FetchPage(
+      directory->GetSlotPageId(directory->SlotPageIndex(bucket_idx)));
+}
+
+/*
+ * bucket page id and local depth of the directory slot of hash, through the
+ * directory page and one slot page. Caller must hold table_latch_ and the
+ * directory must exist
+ * @return: false if a page could not be fetched
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::FindBucket(uint32_t hash,
+                                            page_id_t &bucket_page_id,
+                                            uint32_t &local_depth) {
+  Page *directory_page = buffer_pool_manager_->FetchPage(directory_page_id_);
+  if (directory_page == nullptr)
+    return false;
+  auto directory =
+      reinterpret_cast<HashTableDirectoryPage *>(directory_page->GetData());
+  uint32_t bucket_idx = hash & directory->GetGlobalDepthMask();
+  Page *slot_page = FetchSlotPage(directory, bucket_idx);
+  if (slot_page != nullptr) {
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    uint32_t offset = directory->SlotOffset(bucket_idx);
+    bucket_page_id = slots->GetBucketPageId(offset);
+    local_depth = slots->GetLocalDepth(offset);
+    buffer_pool_manager_->UnpinPage(slot_page->GetPageId(), false);
+  }
+  buffer_pool_manager_->UnpinPage(directory_page_id_, false);
+  return slot_page != nullptr;
+}
+
+/*
+ * Split the bucket of directory slot bucket_idx, whose slot page is slots,
+ * into itself and its split image: entries whose hash has bit local_depth set
+ * move to the image. Local depth must be below global depth, so all the
+ * slots of the bucket are in slots. Caller holds table_latch_ in write mode
+ * @return: false if a page could not be fetched or allocated, nothing changed
+ * then
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::SplitBucket(HashTableDirectoryPage *directory,
+                                             HashTableSlotPage *slots,
+                                             uint32_t bucket_idx) {
+  uint32_t offset = directory->SlotOffset(bucket_idx);
+  page_id_t bucket_page_id = slots->GetBucketPageId(offset);
+  uint32_t local_depth = slots->GetLocalDepth(offset);
+  assert(local_depth < directory->GetGlobalDepth());
+  Page *bucket_page = buffer_pool_manager_->FetchPage(bucket_page_id);
+  if (bucket_page == nullptr)
+    return false;
+  page_id_t image_page_id;
+  Page *image_page = NewBucketPage(image_page_id);
+  if (image_page == nullptr) {
+    buffer_pool_manager_->UnpinPage(bucket_page_id, false);
+    return false;
+  }
+  auto bucket =
+      reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(bucket_page->GetData());
+  auto image =
+      reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(image_page->GetData());
+  uint32_t high_bit = 1U << local_depth;
+  for (int i = 0; i < bucket->GetSize();) {
+    if (Hash(bucket->KeyAt(i)) & high_bit) {
+      image->Insert(bucket->KeyAt(i), bucket->ValueAt(i));
+      bucket->RemoveAt(i);
+    } else {
+      i++;
+    }
+  }
+  // every slot that shared the old bucket gets local depth + 1
+  for (uint32_t i = bucket_idx & (high_bit - 1); i < directory->Size();
+       i += high_bit) {
+    assert(directory->SlotPageIndex(i) ==
+           directory->SlotPageIndex(bucket_idx));
+    slots->SetLocalDepth(directory->SlotOffset(i), local_depth + 1);
+    if (i & high_bit)
+      slots->SetBucketPageId(directory->SlotOffset(i), image_page_id);
+  }
+  directory->SplitBucket(local_depth);
+  buffer_pool_manager_->UnpinPage(image_page_id, true);
+  buffer_pool_manager_->UnpinPage(bucket_page_id, true);
+  return true;
+}
+
+/*
+ * Double the directory, slot i + Size() starts as a copy of slot i. Slot
+ * pages are copied one at a time and the global depth is raised last, so a
+ * page that can not be fetched leaves the directory as it was; the copies
+ * already made lie beyond Size() and are ignored.
+ * @return: false if a page could not be fetched or allocated
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::GrowDirectory(
+    HashTableDirectoryPage *directory) {
+  if (directory->GetGlobalDepth() == SLOT_PAGE_DEPTH)
+    return SpreadDirectory(directory);
+  // slots of one slot page: the whole directory, or the ones sharing the low
+  // bits of the slot page
+  uint32_t count = directory->Size() / directory->NumSlotPages();
+  for (uint32_t i = 0; i < directory->NumSlotPages(); i++) {
+    page_id_t slot_page_id = directory->GetSlotPageId(i);
+    Page *slot_page = buffer_pool_manager_->FetchPage(slot_page_id);
+    if (slot_page == nullptr)
+      return false;
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    for (uint32_t offset = 0; offset < count; offset++) {
+      slots->SetBucketPageId(offset + count, slots->GetBucketPageId(offset));
+      slots->SetLocalDepth(offset + count, slots->GetLocalDepth(offset));
+    }
+    buffer_pool_manager_->UnpinPage(slot_page_id, true);
+  }
+  directory->IncrGlobalDepth();
+  return true;
+}
+
+/*
+ * Grow the directory out of its first slot page. Every bucket is split to
+ * local depth SLOT_PAGE_DEPTH first, then slot i and its copy i + N go to
+ * slot page i. The new slot pages are filled before the directory points to
+ * them, the buckets split before a failure stay split.
+ * @return: false if a page could not be fetched or allocated
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::SpreadDirectory(
+    HashTableDirectoryPage *directory) {
+  page_id_t first_page_id = directory->GetSlotPageId(0);
+  Page *first_page = buffer_pool_manager_->FetchPage(first_page_id);
+  if (first_page == nullptr)
+    return false;
+  auto first = reinterpret_cast<HashTableSlotPage *>(first_page->GetData());
+  bool first_dirty = false;
+  for (uint32_t i = 0; i < DIRECTORY_ARRAY_SIZE; i++) {
+    while (first->GetLocalDepth(i) < SLOT_PAGE_DEPTH) {
+      if (!SplitBucket(directory, first, i)) {
+        buffer_pool_manager_->UnpinPage(first_page_id, first_dirty);
+        return false;
+      }
+      first_dirty = true;
+    }
+  }
+
+  std::vector<page_id_t> slot_page_ids{first_page_id};
+  for (uint32_t i = 1; i < DIRECTORY_ARRAY_SIZE; i++) {
+    page_id_t slot_page_id;
+    Page *slot_page = buffer_pool_manager_->NewPage(slot_page_id);
+    if (slot_page == nullptr) {
+      for (size_t j = 1; j < slot_page_ids.size(); j++)
+        buffer_pool_manager_->DeletePage(slot_page_ids[j]);
+      buffer_pool_manager_->UnpinPage(first_page_id, first_dirty);
+      return false;
+    }
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    slots->Init(slot_page_id);
+    for (uint32_t offset = 0; offset < 2; offset++) {
+      slots->SetBucketPageId(offset, first->GetBucketPageId(i));
+      slots->SetLocalDepth(offset, first->GetLocalDepth(i));
+    }
+    buffer_pool_manager_->UnpinPage(slot_page_id, true);
+    slot_page_ids.push_back(slot_page_id);
+  }
+  first->SetBucketPageId(1, first->GetBucketPageId(0));
+  first->SetLocalDepth(1, first->GetLocalDepth(0));
+  buffer_pool_manager_->UnpinPage(first_page_id, true);
+  for (uint32_t i = 1; i < DIRECTORY_ARRAY_SIZE; i++)
+    directory->SetSlotPageId(i, slot_page_ids[i]);
+  directory->IncrGlobalDepth();
+  return true;
+}
+
+/*
+ * Halve the directory. Going back to a single slot page, offset 0 of every
+ * slot page is read first and written into the first slot page at once, so
+ * a page that can not be fetched leaves the directory as it was.
+ * @return: false if a page could not be fetched
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::ShrinkDirectory(
+    HashTableDirectoryPage *directory) {
+  if (directory->GetGlobalDepth() != SLOT_PAGE_DEPTH + 1) {
+    directory->DecrGlobalDepth();
+    return true;
+  }
+  page_id_t first_page_id = directory->GetSlotPageId(0);
+  Page *first_page = buffer_pool_manager_->FetchPage(first_page_id);
+  if (first_page == nullptr)
+    return false;
+  page_id_t bucket_page_ids[DIRECTORY_ARRAY_SIZE];
+  uint32_t local_depths[DIRECTORY_ARRAY_SIZE];
+  for (uint32_t i = 1; i < DIRECTORY_ARRAY_SIZE; i++) {
+    page_id_t slot_page_id = directory->GetSlotPageId(i);
+    Page *slot_page = buffer_pool_manager_->FetchPage(slot_page_id);
+    if (slot_page == nullptr) {
+      buffer_pool_manager_->UnpinPage(first_page_id, false);
+      return false;
+    }
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    bucket_page_ids[i] = slots->GetBucketPageId(0);
+    local_depths[i] = slots->GetLocalDepth(0);
+    buffer_pool_manager_->UnpinPage(slot_page_id, false);
+  }
+  auto first = reinterpret_cast<HashTableSlotPage *>(first_page->GetData());
+  for (uint32_t i = 1; i < DIRECTORY_ARRAY_SIZE; i++) {
+    first->SetBucketPageId(i, bucket_page_ids[i]);
+    first->SetLocalDepth(i, local_depths[i]);
+  }
+  buffer_pool_manager_->UnpinPage(first_page_id, true);
+  for (uint32_t i = 1; i < DIRECTORY_ARRAY_SIZE; i++) {
+    buffer_pool_manager_->DeletePage(directory->GetSlotPageId(i));
+    directory->SetSlotPageId(i, INVALID_PAGE_ID);
+  }
+  directory->DecrGlobalDepth();
+  return true;
+}
+
+/*****************************************************************************
+ * BUCKET CHAIN
+ *****************************************************************************/
+/*
+ * A bucket is its head page plus the overflow pages chained behind it. The
+ * latch of the head page protects the whole chain, so overflow pages are only
+ * pinned, never latched.
+ * The chain helpers return false if an overflow page could not be fetched,
+ * their result is passed through the last argument.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::LookupInChain(
+    HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key, ValueType &value,
+    bool &found) {
+  found = head->Lookup(key, value, comparator_);
+  page_id_t next_page_id = head->GetNextPageId();
+  while (!found && next_page_id != INVALID_PAGE_ID) {
+    Page *page = buffer_pool_manager_->FetchPage(next_page_id);
+    if (page == nullptr)
+      return false;
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(page->GetData());
+    found = bucket->Lookup(key, value, comparator_);
+    page_id_t page_id = next_page_id;
+    next_page_id = bucket->GetNextPageId();
+    buffer_pool_manager_->UnpinPage(page_id, false);
+  }
+  return true;
+}
+
+/*
+ * insert into the first page of the chain that has room, inserted is false
+ * if every page of the chain is full
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::InsertIntoChain(
+    HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+    const ValueType &value, bool &inserted) {
+  inserted = !head->IsFull();
+  if (inserted) {
+    head->Insert(key, value);
+    return true;
+  }
+  page_id_t next_page_id = head->GetNextPageId();
+  while (next_page_id != INVALID_PAGE_ID) {
+    Page *page = buffer_pool_manager_->FetchPage(next_page_id);
+    if (page == nullptr)
+      return false;
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(page->GetData());
+    page_id_t page_id = next_page_id;
+    next_page_id = bucket->GetNextPageId();
+    inserted = !bucket->IsFull();
+    if (inserted)
+      bucket->Insert(key, value);
+    buffer_pool_manager_->UnpinPage(page_id, inserted);
+    if (inserted)
+      break;
+  }
+  return true;
+}
+
+/*
+ * remove key from the chain, an overflow page that becomes empty is unlinked
+ * and deleted
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::RemoveFromChain(
+    HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key, bool &removed) {
+  removed = head->Remove(key, comparator_);
+  if (removed)
+    return true;
+  HASH_TABLE_BUCKET_PAGE_TYPE *prev = head;
+  page_id_t prev_page_id = INVALID_PAGE_ID; // head is unpinned by caller
+  page_id_t page_id = head->GetNextPageId();
+  bool fetched = true;
+  while (page_id != INVALID_PAGE_ID) {
+    Page *page = buffer_pool_manager_->FetchPage(page_id);
+    if (page == nullptr) {
+      fetched = false;
+      break;
+    }
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(page->GetData());
+    if (bucket->Remove(key, comparator_)) {
+      removed = true;
+      if (bucket->IsEmpty()) {
+        prev->SetNextPageId(bucket->GetNextPageId());
+        buffer_pool_manager_->UnpinPage(page_id, false);
+        buffer_pool_manager_->DeletePage(page_id);
+      } else {
+        buffer_pool_manager_->UnpinPage(page_id, true);
+      }
+      break;
+    }
+    if (prev_page_id != INVALID_PAGE_ID)
+      buffer_pool_manager_->UnpinPage(prev_page_id, false);
+    prev = bucket;
+    prev_page_id = page_id;
+    page_id = bucket->GetNextPageId();
+  }
+  if (prev_page_id != INVALID_PAGE_ID)
+    buffer_pool_manager_->UnpinPage(prev_page_id, removed);
+  return fetched;
+}
+
+/*****************************************************************************
+ * SEARCH
+ *****************************************************************************/
+/*
+ * Return the only value that associated with input key
+ * This method is used for point query
+ * @return : true means key exists
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::GetValue(const KeyType &key,
+                                          std::vector<ValueType> &result,
+                                          Transaction *transaction) {
+  table_latch_.RLock();
+  page_id_t bucket_page_id;
+  uint32_t local_depth;
+  Page *bucket_page =
+      !IsEmpty() && FindBucket(Hash(key), bucket_page_id, local_depth)
+          ? buffer_pool_manager_->FetchPage(bucket_page_id)
+          : nullptr;
+  ValueType value;
+  bool found = false;
+  if (bucket_page != nullptr) {
+    bucket_page->RLatch();
+    if (!LookupInChain(reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(
+                           bucket_page->GetData()),
+                       key, value, found))
+      found = false;
+    bucket_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, false);
+  }
+  table_latch_.RUnlock();
+
+  if (found)
+    result.push_back(value);
+  return found;
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+/*
+ * Insert constant key & value pair into hash table
+ * if current hash table is empty, create the directory first. Insertion that
+ * fits into the target bucket only holds table_latch_ in read mode plus the
+ * bucket page latch; a full bucket retries under write mode and splits.
+ * @return: since we only support unique key, if user try to insert duplicate
+ * keys return false, otherwise return true.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::Insert(const KeyType &key,
+                                        const ValueType &value,
+                                        Transaction *transaction) {
+  table_latch_.RLock();
+  if (!IsEmpty()) {
+    page_id_t bucket_page_id;
+    uint32_t local_depth;
+    Page *bucket_page = FindBucket(Hash(key), bucket_page_id, local_depth)
+                            ? buffer_pool_manager_->FetchPage(bucket_page_id)
+                            : nullptr;
+    if (bucket_page == nullptr) {
+      table_latch_.RUnlock();
+      return false;
+    }
+    bucket_page->WLatch();
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(bucket_page->GetData());
+    ValueType old_value;
+    bool exist = false, inserted = false;
+    bool fetched = LookupInChain(bucket, key, old_value, exist) &&
+                   (exist || InsertIntoChain(bucket, key, value, inserted));
+    bucket_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, inserted);
+    if (!fetched || exist || inserted) {
+      table_latch_.RUnlock();
+      return inserted;
+    }
+  }
+  table_latch_.RUnlock();
+
+  table_latch_.WLock();
+  bool inserted =
+      (!IsEmpty() || CreateDirectory()) && SplitInsert(key, value);
+  table_latch_.WUnlock();
+  return inserted;
+}
+
+/*
+ * Insert with table_latch_ held in write mode. Split the target bucket (and
+ * double the directory when local depth == global depth) until the key fits.
+ * Only when the directory is at DIRECTORY_MAX_DEPTH, chain an overflow page.
+ * @return: false if key exists or a page could not be fetched or allocated
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::SplitInsert(const KeyType &key,
+                                             const ValueType &value) {
+  Page *directory_page = buffer_pool_manager_->FetchPage(directory_page_id_);
+  if (directory_page == nullptr)
+    return false;
+  auto directory =
+      reinterpret_cast<HashTableDirectoryPage *>(directory_page->GetData());
+  bool directory_dirty = false, inserted = false;
+  uint32_t hash = Hash(key);
+
+  while (true) {
+    uint32_t bucket_idx = hash & directory->GetGlobalDepthMask();
+    Page *slot_page = FetchSlotPage(directory, bucket_idx);
+    if (slot_page == nullptr)
+      break;
+    page_id_t slot_page_id = slot_page->GetPageId();
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    uint32_t offset = directory->SlotOffset(bucket_idx);
+    page_id_t bucket_page_id = slots->GetBucketPageId(offset);
+    uint32_t local_depth = slots->GetLocalDepth(offset);
+    Page *bucket_page = buffer_pool_manager_->FetchPage(bucket_page_id);
+    if (bucket_page == nullptr) {
+      buffer_pool_manager_->UnpinPage(slot_page_id, false);
+      break;
+    }
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(bucket_page->GetData());
+    ValueType old_value;
+    bool exist = false;
+    bool done = !LookupInChain(bucket, key, old_value, exist) || exist ||
+                !InsertIntoChain(bucket, key, value, inserted) || inserted;
+    if (!done && local_depth == directory->GetGlobalDepth() &&
+        !directory->CanGrow()) {
+      // 目录已达最大深度，在链尾追加溢出页
+      inserted = AppendOverflowPage(bucket, key, value);
+      done = true;
+    }
+    buffer_pool_manager_->UnpinPage(bucket_page_id, inserted);
+    if (done) {
+      buffer_pool_manager_->UnpinPage(slot_page_id, false);
+      break;
+    }
+
+    bool changed;
+    if (local_depth == directory->GetGlobalDepth()) {
+      buffer_pool_manager_->UnpinPage(slot_page_id, false);
+      changed = GrowDirectory(directory);
+    } else {
+      changed = SplitBucket(directory, slots, bucket_idx);
+      buffer_pool_manager_->UnpinPage(slot_page_id, changed);
+    }
+    if (!changed)
+      break;
+    directory_dirty = true;
+  }
+  // a doubled directory is still consistent, only the split is missing
+  buffer_pool_manager_->UnpinPage(directory_page_id_, directory_dirty);
+  return inserted;
+}
+
+/*
+ * chain a new overflow page holding key behind the last page of the bucket
+ * @return: false if a page could not be fetched or allocated
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::AppendOverflowPage(
+    HASH_TABLE_BUCKET_PAGE_TYPE *head, const KeyType &key,
+    const ValueType &value) {
+  HASH_TABLE_BUCKET_PAGE_TYPE *tail = head;
+  page_id_t tail_page_id = INVALID_PAGE_ID; // head is unpinned by caller
+  bool fetched = true;
+  while (tail->GetNextPageId() != INVALID_PAGE_ID) {
+    page_id_t next_page_id = tail->GetNextPageId();
+    Page *next_page = buffer_pool_manager_->FetchPage(next_page_id);
+    if (next_page == nullptr) {
+      fetched = false;
+      break;
+    }
+    if (tail_page_id != INVALID_PAGE_ID)
+      buffer_pool_manager_->UnpinPage(tail_page_id, false);
+    tail = reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(next_page->GetData());
+    tail_page_id = next_page_id;
+  }
+  page_id_t overflow_page_id;
+  Page *overflow_page = fetched ? NewBucketPage(overflow_page_id) : nullptr;
+  if (overflow_page != nullptr) {
+    reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(overflow_page->GetData())
+        ->Insert(key, value);
+    tail->SetNextPageId(overflow_page_id);
+    buffer_pool_manager_->UnpinPage(overflow_page_id, true);
+  }
+  if (tail_page_id != INVALID_PAGE_ID)
+    buffer_pool_manager_->UnpinPage(tail_page_id, overflow_page != nullptr);
+  return overflow_page != nullptr;
+}
+
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
+/*
+ * Delete key & value pair associated with input key
+ * If the bucket becomes empty, merge it with its split image and shrink the
+ * directory if possible (under table_latch_ in write mode).
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::Remove(const KeyType &key,
+                                        Transaction *transaction) {
+  table_latch_.RLock();
+  page_id_t bucket_page_id;
+  uint32_t local_depth;
+  Page *bucket_page =
+      !IsEmpty() && FindBucket(Hash(key), bucket_page_id, local_depth)
+          ? buffer_pool_manager_->FetchPage(bucket_page_id)
+          : nullptr;
+  bool removed = false, can_merge = false;
+  if (bucket_page != nullptr) {
+    bucket_page->WLatch();
+    auto bucket =
+        reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(bucket_page->GetData());
+    // removed stays false if the chain could not be walked to its end
+    RemoveFromChain(bucket, key, removed);
+    can_merge = local_depth > 0 && removed && bucket->IsEmpty() &&
+                bucket->GetNextPageId() == INVALID_PAGE_ID;
+    bucket_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, removed);
+  }
+  table_latch_.RUnlock();
+
+  if (can_merge) {
+    table_latch_.WLock();
+    Merge(key);
+    table_latch_.WUnlock();
+  }
+  return removed;
+}
+
+/*
+ * Merge the bucket of key with its split image, then halve the directory
+ * while every local depth is below global depth. Caller must hold
+ * table_latch_ in write mode, so the emptiness seen by Remove is rechecked.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::Merge(const KeyType &key) {
+  Page *directory_page = buffer_pool_manager_->FetchPage(directory_page_id_);
+  if (directory_page == nullptr)
+    return;
+  auto directory =
+      reinterpret_cast<HashTableDirectoryPage *>(directory_page->GetData());
+  bool directory_dirty = MergeBucket(directory, Hash(key));
+  while (directory->CanShrink() && ShrinkDirectory(directory)) {
+    directory_dirty = true;
+    // buckets emptied while the directory spanned several slot pages could
+    // not merge below SLOT_PAGE_DEPTH, merge them now
+    if (directory->GetGlobalDepth() == SLOT_PAGE_DEPTH)
+      for (uint32_t i = 0; i < directory->Size(); i++)
+        MergeBucket(directory, i);
+  }
+  buffer_pool_manager_->UnpinPage(directory_page_id_, directory_dirty);
+}
+
+/*
+ * merge the bucket of directory slot hash & mask with its split image while
+ * one of them is empty and both have the same local depth and no overflow
+ * page. While the directory spans several slot pages, local depth does not
+ * go below SLOT_PAGE_DEPTH, so bucket and image are in the same slot page
+ * @return: true if any bucket was merged
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool EXTENDIBLE_HASH_TABLE_TYPE::MergeBucket(HashTableDirectoryPage *directory,
+                                             uint32_t hash) {
+  uint32_t min_depth =
+      directory->GetGlobalDepth() > SLOT_PAGE_DEPTH ? SLOT_PAGE_DEPTH : 0;
+  bool merged = false;
+  while (true) {
+    uint32_t bucket_idx = hash & directory->GetGlobalDepthMask();
+    Page *slot_page = FetchSlotPage(directory, bucket_idx);
+    if (slot_page == nullptr)
+      break;
+    page_id_t slot_page_id = slot_page->GetPageId();
+    auto slots = reinterpret_cast<HashTableSlotPage *>(slot_page->GetData());
+    uint32_t local_depth =
+        slots->GetLocalDepth(directory->SlotOffset(bucket_idx));
+    uint32_t image_idx =
+        local_depth > 0 ? bucket_idx ^ (1U << (local_depth - 1)) : bucket_idx;
+    if (local_depth <= min_depth ||
+        slots->GetLocalDepth(directory->SlotOffset(image_idx)) != local_depth) {
+      buffer_pool_manager_->UnpinPage(slot_page_id, false);
+      break;
+    }
+    page_id_t bucket_page_id =
+        slots->GetBucketPageId(directory->SlotOffset(bucket_idx));
+    page_id_t image_page_id =
+        slots->GetBucketPageId(directory->SlotOffset(image_idx));
+    // merging is an optimization, give up if the buckets can not be fetched
+    Page *bucket_page = buffer_pool_manager_->FetchPage(bucket_page_id);
+    Page *image_page = bucket_page == nullptr
+                           ? nullptr
+                           : buffer_pool_manager_->FetchPage(image_page_id);
+    bool mergeable = false;
+    page_id_t survivor_page_id = bucket_page_id;
+    if (image_page != nullptr) {
+      auto bucket = reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(
+          bucket_page->GetData());
+      auto image =
+          reinterpret_cast<HASH_TABLE_BUCKET_PAGE_TYPE *>(image_page->GetData());
+      mergeable = (bucket->IsEmpty() || image->IsEmpty()) &&
+                  bucket->GetNextPageId() == INVALID_PAGE_ID &&
+                  image->GetNextPageId() == INVALID_PAGE_ID;
+      if (bucket->IsEmpty())
+        survivor_page_id = image_page_id;
+      buffer_pool_manager_->UnpinPage(image_page_id, false);
+    }
+    if (bucket_page != nullptr)
+      buffer_pool_manager_->UnpinPage(bucket_page_id, false);
+
+    if (mergeable) {
+      // all slots sharing the low (local_depth - 1) bits now point to survivor
+      uint32_t stride = 1U << (local_depth - 1);
+      for (uint32_t i = bucket_idx & (stride - 1); i < directory->Size();
+           i += stride) {
+        slots->SetBucketPageId(directory->SlotOffset(i), survivor_page_id);
+        slots->SetLocalDepth(directory->SlotOffset(i), local_depth - 1);
+      }
+      directory->MergeBuckets(local_depth);
+      buffer_pool_manager_->DeletePage(survivor_page_id == bucket_page_id
+                                           ? image_page_id
+                                           : bucket_page_id);
+    }
+    buffer_pool_manager_->UnpinPage(slot_page_id, mergeable);
+    if (!mergeable)
+      break;
+    merged = true;
+  }
+  return merged;
+}
+
+/*****************************************************************************
+ * UTILITIES AND DEBUG
+ *****************************************************************************/
+/*
+ * Update/Insert directory page id in header page(where page_id = 0,
+ * header_page is defined under include/page/header_page.h)
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void EXTENDIBLE_HASH_TABLE_TYPE::UpdateDirectoryPageId(bool insert_record) {
+  HeaderPage *header_page =
+      static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (insert_record)
+    // create a new record<index_name + directory_page_id> in header_page
+    header_page->InsertRecord(index_name_, directory_page_id_);
+  else
+    // update directory_page_id in header_page
+    header_page->UpdateRecord(index_name_, directory_page_id_);
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
+}
+
+/*
+ * This method is used for test only
+ */
+INDEX_TEMPLATE_ARGUMENTS
+uint32_t EXTENDIBLE_HASH_TABLE_TYPE::GetGlobalDepth() {
+  table_latch_.RLock();
+  uint32_t global_depth = 0;
+  Page *directory_page = IsEmpty()
+                             ? nullptr
+                             : buffer_pool_manager_->FetchPage(directory_page_id_);
+  if (directory_page != nullptr) {
+    global_depth =
+        reinterpret_cast<HashTableDirectoryPage *>(directory_page->GetData())
+            ->GetGlobalDepth();
+    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
+  }
+  table_latch_.RUnlock();
+  return global_depth;
+}
+
+template class ExtendibleHashTable<GenericKey<4>, RID, GenericComparator<4>>;
+template class ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>>;
+template class ExtendibleHashTable<GenericKey<16>, RID, GenericComparator<16>>;
+template class ExtendibleHashTable<GenericKey<32>, RID, GenericComparator<32>>;
+template class ExtendibleHashTable<GenericKey<64>, RID, GenericComparator<64>>;
+
+} // namespace cmudb
@@ -0,0 +1,84 @@
+/**
+ * checkpoint_manager.cpp
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "logging/checkpoint_manager.h"
+
+namespace cmudb {
+/*
+ * 1. append BEGIN_CHECKPOINT
+ * 2. sample active transaction table and dirty page table
+ * 3. append END_CHECKPOINT carrying both tables and wait until it is on disk
+ * 4. recovery never reads before the smallest of the begin lsn, the recLSNs
+ *    and the first lsn of active transactions, so the log before it is
+ *    truncated
+ */
+    lsn_t CheckpointManager::Checkpoint() {
+        if (!ENABLE_LOGGING)
+            return INVALID_LSN;
+        std::lock_guard<std::mutex> lock(latch_);
+
+        LogRecord begin_record(INVALID_TXN_ID, INVALID_LSN,
+                               LogRecordType::BEGIN_CHECKPOINT);
+        lsn_t begin_lsn = log_manager_->AppendLogRecord(begin_record);
+        lsn_t min_recovery_lsn = begin_lsn;
+
+        std::vector<std::pair<txn_id_t, lsn_t>> active_txns;
+        for (auto &entry : transaction_manager_->GetActiveTransactionTable()) {
+            active_txns.emplace_back(std::get<0>(entry), std::get<1>(entry));
+            min_recovery_lsn = std::min(min_recovery_lsn, std::get<2>(entry));
+        }
+        std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+        for (auto &entry : buffer_pool_manager_->GetDirtyPageTable()) {
+            dirty_pages.emplace_back(entry.first, entry.second);
+            min_recovery_lsn = std::min(min_recovery_lsn, entry.second);
+        }
+
+        LogRecord end_record(begin_lsn, active_txns, dirty_pages);
+        log_manager_->AppendLogRecord(end_record);
+        log_manager_->flushLogToDisk(true);
+
+        min_recovery_lsn_ = min_recovery_lsn;
+        log_manager_->TruncateLog(min_recovery_lsn);
+        return begin_lsn;
+    }
+
+    void CheckpointManager::RunCheckpointThread() {
+        std::lock_guard<std::mutex> lock(checkpoint_latch_);
+        if (checkpoint_thread_.joinable())
+            return;
+        stop_checkpoint_ = false;
+        checkpoint_thread_ = std::thread(&CheckpointManager::CheckpointLoop, this);
+    }
+
+    void CheckpointManager::StopCheckpointThread() {
+        {
+            std::lock_guard<std::mutex> lock(checkpoint_latch_);
+            stop_checkpoint_ = true;
+        }
+        checkpoint_cv_.notify_one();
+        if (checkpoint_thread_.joinable())
+            checkpoint_thread_.join();
+    }
+
+/*
+ * a checkpoint of an idle log would only repeat the previous one, skip it
+ * while the next lsn is still the one behind the last END_CHECKPOINT
+ */
+    void CheckpointManager::CheckpointLoop() {
+        lsn_t idle_lsn = INVALID_LSN;
+        std::unique_lock<std::mutex> lock(checkpoint_latch_);
+        while (!checkpoint_cv_.wait_for(lock, CHECKPOINT_INTERVAL,
+                                        [this] { return stop_checkpoint_; })) {
+            lock.unlock();
+            if (ENABLE_LOGGING && log_manager_->GetNextLSN() != idle_lsn &&
+                Checkpoint() != INVALID_LSN)
+                idle_lsn = log_manager_->GetNextLSN();
+            lock.lock();
+        }
+    }
+
+} // namespace cmudb
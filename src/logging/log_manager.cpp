@@ -2,6 +2,8 @@
  * log_manager.cpp
  */
 
+#include <vector>
+
 #include "logging/log_manager.h"
 #include "common/logger.h"
 namespace cmudb {
@@ -15,30 +17,53 @@ namespace cmudb {
     void LogManager::RunFlushThread() {
 
         ENABLE_LOGGING = true;
+        // 第一个segment也在后台zero-fill，第一次flush不用等
+        disk_manager_->PrepareLog();
 
         flush_thread_ = new std::thread([&] {
+            std::unique_lock<std::mutex> cvlock(latch_);
             //buffer pool force flush时，启动该线程
             while (ENABLE_LOGGING) {
-                std::unique_lock<std::mutex> cvlock(latch_);
-                cv_.wait_for(cvlock, LOG_TIMEOUT, [&] {
-                    return needFlush_.load();
-                });
-
-                if (writePosition > 0) {
-
-                    std::swap(log_buffer_, flush_buffer_);
-                    std::swap(writePosition, flushBufferSize);
-
-                    disk_manager_->WriteLog(flush_buffer_, flushBufferSize);
-
-                    flushBufferSize = 0;
-                    SetPersistentLSN(last_lsn_);
+                /*
+                 * 等待LOG_TIMEOUT、force flush或者segment写满；有事务在等待提交时，
+                 * 最多再等待自适应的group commit window以攒批
+                 */
+                std::chrono::steady_clock::time_point timeout =
+                        std::chrono::steady_clock::now() + LOG_TIMEOUT;
+                while (ENABLE_LOGGING && !needFlush_ &&
+                       !segments_[flush_index_].pending) {
+                    std::chrono::steady_clock::time_point deadline = timeout;
+                    if (waiting_commits_ > 0)
+                        deadline = std::min(deadline, first_commit_time_ +
+                                                      GroupCommitWindow());
+                    if (std::chrono::steady_clock::now() >= deadline)
+                        break;
+                    cv_.wait_until(cvlock, deadline);
                 }
-                //此时log buffer缓冲区可继续写，通知AppendRecord线程，继续写log
                 needFlush_ = false;
-                notFull.notify_all();
-            }
 
+                if (waiting_commits_ > 0) {
+                    uint64_t batch = waiting_commits_;
+                    waiting_commits_ = 0;
+                    metrics_.num_group_flushes++;
+                    metrics_.avg_batch_size +=
+                            (batch - metrics_.avg_batch_size) /
+                            metrics_.num_group_flushes;
+                    metrics_.max_batch_size =
+                            std::max(metrics_.max_batch_size, batch);
+                }
+
+                // time out or forced: the partially filled segment goes too
+                bool sealed = SealActiveSegment();
+                FlushPendingSegments(cvlock);
+                // ring was full when sealing, seal again now that it drained
+                if (!sealed && SealActiveSegment())
+                    FlushPendingSegments(cvlock);
+            }
+            // 退出前把剩余的log全部写入磁盘，ring满时先腾出segment再封存
+            do {
+                FlushPendingSegments(cvlock);
+            } while (SealActiveSegment());
         });
 
     }
@@ -52,37 +77,225 @@ namespace cmudb {
         flushLogToDisk( true );
         LOG_DEBUG( " Signal flushing thread " );
         flush_thread_->join();
-        assert(flushBufferSize == 0 && writePosition == 0 );
+        assert(GetWritePosition() == 0);
         delete flush_thread_;
 
     }
 
+/*
+ * Seal the active segment and let appenders continue in the next segment of
+ * the ring. Caller must hold latch_.
+ * @return: false if active segment is empty or the next segment is still
+ * waiting for flush
+ */
+    bool LogManager::SealActiveSegment() {
+        uint64_t state = reserve_state_.load();
+        uint32_t active = ReservedSegment(state);
+        uint32_t next = (active + 1) % LOG_BUFFER_SEGMENTS;
+        if (segments_[next].pending)
+            return false;
+        // only the sealer changes the active segment, appenders may still
+        // bump the offset so retry until the switch succeeds
+        do {
+            if (ReservedOffset(state) == 0)
+                return false;
+            // the next segment continues the log where this one ends, its
+            // base must be set before appenders can reserve in it
+            segments_[next].base_lsn =
+                    segments_[active].base_lsn + ReservedOffset(state);
+        } while (!reserve_state_.compare_exchange_weak(
+                state, PackState(ReservedGeneration(state) + 1, next, 0)));
+
+        LogSegment &segment = segments_[active];
+        segment.size = ReservedOffset(state);
+        segment.pending = true;
+        cv_.notify_one();
+        return true;
+    }
+
+/*
+ * Write pending segments to disk in ring order. All segments pending at once
+ * are written and then made durable by a single SyncLog, the group flush.
+ * latch_ is released during the disk I/O, so appenders and sealers are never
+ * blocked by it.
+ */
+    void LogManager::FlushPendingSegments(std::unique_lock<std::mutex> &lock) {
+        while (segments_[flush_index_].pending) {
+            uint32_t count = 0;
+            while (count < LOG_BUFFER_SEGMENTS &&
+                   segments_[(flush_index_ + count) % LOG_BUFFER_SEGMENTS].pending)
+                count++;
+            LogSegment &tail =
+                    segments_[(flush_index_ + count - 1) % LOG_BUFFER_SEGMENTS];
+            // last byte of the batch in the log
+            lsn_t last_lsn = tail.base_lsn + tail.size - 1;
+            lock.unlock();
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < count; i++) {
+                LogSegment &segment =
+                        segments_[(flush_index_ + i) % LOG_BUFFER_SEGMENTS];
+                // wait only for regions already reserved to be filled
+                while (segment.filled.load() != segment.size)
+                    std::this_thread::yield();
+                disk_manager_->WriteLog(segment.data, segment.size);
+            }
+            disk_manager_->SyncLog();
+            SetPersistentLSN(last_lsn);
+            std::chrono::duration<double, std::micro> write_time =
+                    std::chrono::steady_clock::now() - start;
+            lock.lock();
+            metrics_.flush_latency_us = metrics_.flush_latency_us == 0
+                    ? write_time.count()
+                    : 0.8 * metrics_.flush_latency_us + 0.2 * write_time.count();
+
+            // fire callbacks whose lsn became persistent, outside of latch_
+            auto end = flush_callbacks_.upper_bound(last_lsn);
+            if (end != flush_callbacks_.begin()) {
+                std::vector<std::function<void()>> callbacks;
+                for (auto it = flush_callbacks_.begin(); it != end; ++it) {
+                    NoteCommitDurable(it->second.first);
+                    callbacks.push_back(std::move(it->second.second));
+                }
+                flush_callbacks_.erase(flush_callbacks_.begin(), end);
+                lock.unlock();
+                for (auto &callback : callbacks)
+                    callback();
+                lock.lock();
+            }
+
+            for (uint32_t i = 0; i < count; i++) {
+                LogSegment &segment = segments_[flush_index_];
+                segment.filled = 0;
+                segment.pending = false;
+                flush_index_ = (flush_index_ + 1) % LOG_BUFFER_SEGMENTS;
+            }
+            //此时有空闲segment可继续写，通知AppendRecord线程以及等待提交的线程
+            notFull.notify_all();
+        }
+    }
+
     /*
      * txn commit/abort 或者 buffer pool evict page时调用该函数，
      * group commit 控制log buffer内的内容是否同步到磁盘中
+     * 返回时调用前已经append的log record都已写入磁盘
      */
     void LogManager::flushLogToDisk(bool force) {
-        /*
-         * 在log buffer内容刷到磁盘时，停止append线程
-         * 同其余append thread竞争，若拿到锁，则Append线程阻塞
-         */
         std::unique_lock<std::mutex> sync(latch_);
+        lsn_t target_lsn = GetNextLSN() - 1;
         if (force) {
             /*
              * 该函数被buffer pool manager calling thread调用，立即唤醒flush thread写日志，
              */
             needFlush_ = true;
             cv_.notify_one();
-            if (ENABLE_LOGGING)
-                notFull.wait(sync, [&] { return !needFlush_.load(); });
-        } else {
-            /*
-             * 等待LOG_TIMEOUT
-             * 要么等待flush thread直到
-             * LOG_TIMEOUT flush thread 写日志，完成后唤醒calling thread
-             * 出于 group commit 考虑
-             */
-            notFull.wait(sync);
+        }
+        if (!ENABLE_LOGGING)
+            return;
+        /*
+         * 非force时等待group commit window、LOG_TIMEOUT或者segment写满触发的flush，
+         * 出于 group commit 考虑
+         */
+        auto start = std::chrono::steady_clock::now();
+        if (persistent_lsn_ < target_lsn) {
+            if (!force)
+                NoteCommitArrival(start);
+            notFull.wait(sync, [&] {
+                return persistent_lsn_ >= target_lsn || !ENABLE_LOGGING;
+            });
+        }
+        if (!force)
+            NoteCommitDurable(start);
+    }
+
+/*
+ * 异步提交使用：不阻塞调用线程，lsn持久化后由flush thread调用callback
+ */
+    void LogManager::RegisterFlushCallback(lsn_t lsn,
+                                           std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            if (persistent_lsn_ < lsn && ENABLE_LOGGING) {
+                auto now = std::chrono::steady_clock::now();
+                NoteCommitArrival(now);
+                flush_callbacks_.emplace(
+                        lsn, std::make_pair(now, std::move(callback)));
+                return;
+            }
+        }
+        callback();
+    }
+
+/*
+ * Adaptive group commit. The flush thread may hold the first waiting commit
+ * for the latency SLO minus the observed write latency, so later commits
+ * share the same write. When commits arrive further apart than that budget
+ * the next one would not make it into the batch anyway, so the window drops
+ * to zero and a lightly loaded system flushes right away.
+ */
+    void LogManager::NoteCommitArrival(
+            std::chrono::steady_clock::time_point now) {
+        if (last_commit_time_ != std::chrono::steady_clock::time_point()) {
+            std::chrono::duration<double, std::micro> interval =
+                    now - last_commit_time_;
+            metrics_.commit_interval_us = metrics_.commit_interval_us == 0
+                    ? interval.count()
+                    : 0.8 * metrics_.commit_interval_us + 0.2 * interval.count();
+        }
+        last_commit_time_ = now;
+        if (waiting_commits_++ == 0) {
+            first_commit_time_ = now;
+            cv_.notify_one();
+        }
+    }
+
+    void LogManager::NoteCommitDurable(
+            std::chrono::steady_clock::time_point since) {
+        std::chrono::duration<double, std::micro> latency =
+                std::chrono::steady_clock::now() - since;
+        metrics_.num_commits++;
+        commit_latency_total_us_ += latency.count();
+        metrics_.avg_commit_latency_us =
+                commit_latency_total_us_ / metrics_.num_commits;
+        metrics_.max_commit_latency_us =
+                std::max(metrics_.max_commit_latency_us,
+                         static_cast<uint64_t>(latency.count()));
+    }
+
+    std::chrono::microseconds LogManager::GroupCommitWindow() const {
+        double budget = GROUP_COMMIT_LATENCY_SLO.count() -
+                        metrics_.flush_latency_us;
+        if (budget <= 0 || metrics_.commit_interval_us >= budget)
+            return std::chrono::microseconds(0);
+        return std::chrono::microseconds(static_cast<int64_t>(budget));
+    }
+
+    GroupCommitMetrics LogManager::GetGroupCommitMetrics() {
+        std::lock_guard<std::mutex> lock(latch_);
+        GroupCommitMetrics metrics = metrics_;
+        metrics.group_commit_window_us = GroupCommitWindow().count();
+        return metrics;
+    }
+
+/*
+ * lsn就是log offset，lsn之前的segment文件都可以删除
+ */
+    void LogManager::TruncateLog(lsn_t lsn) {
+        disk_manager_->TruncateLog(std::min<lsn_t>(lsn, persistent_lsn_ + 1));
+    }
+
+/*
+ * the offset read together with the base of its segment, generation tells
+ * whether the segment was switched in between and the base belongs to a
+ * later round of the ring
+ */
+    lsn_t LogManager::GetNextLSN() {
+        uint64_t state = reserve_state_.load();
+        while (true) {
+            lsn_t base = segments_[ReservedSegment(state)].base_lsn;
+            uint64_t current = reserve_state_.load();
+            if (ReservedGeneration(current) == ReservedGeneration(state))
+                return base + ReservedOffset(state);
+            state = current;
         }
     }
 
@@ -93,10 +306,10 @@ namespace cmudb {
  *
  *
  * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
+ * // First, serialize the must have fields(28 bytes in total)
+ * log_record.lsn_ = log offset of the record;
+ * log_record.SerializeHeader(log_buffer_ + offset_);
+ * int pos = offset_ + 28;
  *
  * if (log_record.log_record_type_ == LogRecordType::INSERT) {
  *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
@@ -107,49 +320,132 @@ namespace cmudb {
  *
  */
     lsn_t LogManager::AppendLogRecord(LogRecord &log_record) {
-        std::unique_lock<std::mutex> bufferLatch(latch_);
-
-        /*判断该log buffer剩余空间是否够存放log_record
-         *  如果空间不够，则挂起当前append线程，唤醒flush线程
-         *  否则，直接从offset位置开始写log record
+        // BEGIN is written lazily right before the first record of a txn, so
+        // transactions that never write leave no trace in the log
+        if (log_record.prev_lsn_ == INVALID_LSN &&
+            log_record.txn_id_ != INVALID_TXN_ID &&
+            log_record.log_record_type_ != LogRecordType::BEGIN) {
+            LogRecord begin_record(log_record.txn_id_, INVALID_LSN,
+                                   LogRecordType::BEGIN);
+            log_record.prev_lsn_ = AppendLogRecord(begin_record);
+        }
+        uint32_t size = log_record.GetSize();
+        assert(size < LOG_BUFFER_SIZE);
+        uint64_t state = reserve_state_.load();
+        /*
+         * 通过CAS在active segment中预留空间，lsn为segment起始lsn加上offset
+         *  如果空间不够，则封存active segment并切换到下一个segment；
+         *  若环形缓冲区已满，挂起当前append线程，唤醒flush线程
          */
-        if (writePosition + log_record.GetSize() >= LOG_BUFFER_SIZE) {
-            needFlush_ = true;
-            cv_.notify_one();
-            notFull.wait(bufferLatch, [&] {
-                return writePosition + log_record.GetSize() < LOG_BUFFER_SIZE;
-            });
+        while (true) {
+            if (ReservedOffset(state) + size >= LOG_BUFFER_SIZE) {
+                std::unique_lock<std::mutex> bufferLatch(latch_);
+                state = reserve_state_.load();
+                if (ReservedOffset(state) + size >= LOG_BUFFER_SIZE &&
+                    !SealActiveSegment()) {
+                    needFlush_ = true;
+                    cv_.notify_one();
+                    notFull.wait(bufferLatch, [&] {
+                        state = reserve_state_.load();
+                        return !segments_[(ReservedSegment(state) + 1) %
+                                          LOG_BUFFER_SEGMENTS].pending;
+                    });
+                }
+                state = reserve_state_.load();
+                continue;
+            }
+            if (reserve_state_.compare_exchange_weak(
+                    state, PackState(ReservedGeneration(state),
+                                     ReservedSegment(state),
+                                     ReservedOffset(state) + size)))
+                break;
         }
-        //TODO::待优化的并发度：如何使用原子类型进行加减？
-        log_record.lsn_ = next_lsn_++;
+        // segment can not be flushed, nor its base change, until this region
+        // is filled
+        LogSegment &segment = segments_[ReservedSegment(state)];
+        log_record.lsn_ = segment.base_lsn + ReservedOffset(state);
 
-        memcpy(log_buffer_ + writePosition, &log_record, 20);
-        int pos = writePosition + 20;
+        SerializeLogRecord(log_record, segment.data + ReservedOffset(state));
+        segment.filled.fetch_add(size);
+        return log_record.lsn_;
+    }
+
+/*
+ * write the header and the type specific body of log record into dest
+ */
+    void LogManager::SerializeLogRecord(LogRecord &log_record, char *dest) {
+        log_record.SerializeHeader(dest);
+        int pos = LogRecord::HEADER_SIZE;
 
         if (log_record.log_record_type_ == LogRecordType::INSERT) {
-            memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
+            memcpy(dest + pos, &log_record.insert_rid_, sizeof(RID));
             pos += sizeof(RID);
-            log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
+            log_record.insert_tuple_.SerializeTo(dest + pos);
         } else if (log_record.log_record_type_ == LogRecordType::APPLYDELETE ||
-                   log_record.log_record_type_ == LogRecordType::MARKDELETE) {
-            memcpy(log_buffer_ + pos, &log_record.delete_rid_, sizeof(RID));
+                   log_record.log_record_type_ == LogRecordType::MARKDELETE ||
+                   log_record.log_record_type_ == LogRecordType::ROLLBACKDELETE) {
+            memcpy(dest + pos, &log_record.delete_rid_, sizeof(RID));
             pos += sizeof(RID);
-            log_record.delete_tuple_.SerializeTo(log_buffer_ + pos);
+            log_record.delete_tuple_.SerializeTo(dest + pos);
         } else if (log_record.log_record_type_ == LogRecordType::UPDATE) {
-            memcpy(log_buffer_ + pos, &log_record.update_rid_, sizeof(RID));
+            memcpy(dest + pos, &log_record.update_rid_, sizeof(RID));
             pos += sizeof(RID);
-            log_record.old_tuple_.SerializeTo(log_buffer_ + pos);
-            pos += (log_record.old_tuple_.GetLength() + sizeof(int32_t)); //这里不明白为什么需要加sizeof(uint32_t)
-            log_record.new_tuple_.SerializeTo(log_buffer_ + pos);
+            int32_t sizes[3] = {log_record.old_tuple_size_,
+                                log_record.new_tuple_size_,
+                                static_cast<int32_t>(log_record.update_delta_.size())};
+            memcpy(dest + pos, sizes, sizeof(sizes));
+            pos += sizeof(sizes);
+            memcpy(dest + pos, log_record.update_delta_.data(), sizes[2]);
         } else if (log_record.log_record_type_ == LogRecordType::NEWPAGE) {
-            memcpy(log_buffer_ + pos, &log_record.prev_page_id_, sizeof(page_id_t));
+            memcpy(dest + pos, &log_record.prev_page_id_, sizeof(page_id_t));
             pos +=sizeof(page_id_t);
-            memcpy( log_buffer_ + pos, &log_record.page_id_, sizeof( page_id_t ));
+            memcpy(dest + pos, &log_record.page_id_, sizeof( page_id_t ));
+        } else if (log_record.log_record_type_ == LogRecordType::END_CHECKPOINT) {
+            memcpy(dest + pos, &log_record.begin_checkpoint_lsn_, sizeof(lsn_t));
+            pos += sizeof(lsn_t);
+            int32_t count = log_record.active_txns_.size();
+            memcpy(dest + pos, &count, sizeof(int32_t));
+            pos += sizeof(int32_t);
+            for (auto &entry : log_record.active_txns_) {
+                memcpy(dest + pos, &entry.first, sizeof(txn_id_t));
+                memcpy(dest + pos + sizeof(txn_id_t), &entry.second, sizeof(lsn_t));
+                pos += sizeof(txn_id_t) + sizeof(lsn_t);
+            }
+            count = log_record.dirty_pages_.size();
+            memcpy(dest + pos, &count, sizeof(int32_t));
+            pos += sizeof(int32_t);
+            for (auto &entry : log_record.dirty_pages_) {
+                memcpy(dest + pos, &entry.first, sizeof(page_id_t));
+                memcpy(dest + pos + sizeof(page_id_t), &entry.second, sizeof(lsn_t));
+                pos += sizeof(page_id_t) + sizeof(lsn_t);
+            }
+        } else if (log_record.log_record_type_ == LogRecordType::BTREE_INSERT ||
+                   log_record.log_record_type_ == LogRecordType::BTREE_DELETE ||
+                   log_record.log_record_type_ == LogRecordType::BTREE_NEWPAGE) {
+            int32_t fields[4] = {log_record.page_id_, log_record.btree_index_,
+                                 log_record.btree_count_,
+                                 log_record.btree_entry_size_};
+            memcpy(dest + pos, fields, sizeof(fields));
+            pos += sizeof(fields);
+            memcpy(dest + pos, log_record.btree_data_.data(),
+                   log_record.btree_data_.size());
+            pos += log_record.btree_data_.size();
+            SerializeIndexName(log_record.index_name_, dest + pos);
+        } else if (log_record.log_record_type_ == LogRecordType::BTREE_SET_PARENT ||
+                   log_record.log_record_type_ == LogRecordType::BTREE_SET_NEXT ||
+                   log_record.log_record_type_ == LogRecordType::BTREE_ROOT) {
+            page_id_t fields[3] = {log_record.page_id_, log_record.btree_old_id_,
+                                   log_record.btree_new_id_};
+            memcpy(dest + pos, fields, sizeof(fields));
+            pos += sizeof(fields);
+            SerializeIndexName(log_record.index_name_, dest + pos);
         }
+    }
 
-        //写完log_record后更新log file的偏移量
-        writePosition += log_record.GetSize();
-        return log_record.lsn_;
+    void LogManager::SerializeIndexName(const std::string &name, char *dest) {
+        int32_t size = name.size();
+        memcpy(dest, &size, sizeof(int32_t));
+        memcpy(dest + sizeof(int32_t), name.data(), size);
     }
 
 } // namespace cmudb
\ No newline at end of file
@@ -0,0 +1,269 @@
+/**
+ * log_reader.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "logging/log_reader.h"
+
+namespace cmudb {
+
+    LogReader::LogReader(DiskManager *disk_manager, int chunk_size)
+            : disk_manager_(disk_manager), chunk_size_(chunk_size) {
+        for (int i = 0; i < 2; i++) {
+            buffers_[i] = new char[chunk_size_];
+            buffer_offset_[i] = 0;
+            buffer_size_[i] = 0;
+        }
+        random_buffer_ = new char[chunk_size_];
+        log_end_ = disk_manager_->GetLogEndOffset();
+    }
+
+    LogReader::~LogReader() {
+        // read ahead still writes into buffers_
+        if (read_ahead_.valid())
+            read_ahead_.wait();
+        for (auto &buffer : buffers_) {
+            delete[] buffer;
+            buffer = nullptr;
+        }
+        delete[] random_buffer_;
+        random_buffer_ = nullptr;
+    }
+
+/*
+ * deserialize a log record body, the header is already in log_record
+ * @return: false if the record type is unknown
+ */
+    bool LogReader::DeserializeLogRecord(const char *data,
+                                         LogRecord &log_record) {
+        switch (log_record.log_record_type_) {
+            case LogRecordType::INSERT:
+                log_record.insert_rid_ = *(reinterpret_cast<const RID *>(data));
+                log_record.insert_tuple_.DeserializeFrom(data + sizeof(RID));
+                break;
+            case LogRecordType::MARKDELETE:
+            case LogRecordType::APPLYDELETE:
+            case LogRecordType::ROLLBACKDELETE:
+                log_record.delete_rid_ = *(reinterpret_cast<const RID *>(data));
+                log_record.delete_tuple_.DeserializeFrom(data + sizeof(RID));
+                break;
+            case LogRecordType::UPDATE:
+            {
+                //注意data内数据成员的偏移
+                log_record.update_rid_ = *(reinterpret_cast<const RID *>(data));
+                const int32_t *sizes = reinterpret_cast<const int32_t *>(data + sizeof(RID));
+                log_record.old_tuple_size_ = sizes[0];
+                log_record.new_tuple_size_ = sizes[1];
+                data += sizeof(RID) + 3 * sizeof(int32_t);
+                log_record.update_delta_.assign(data, data + sizes[2]);
+                break;
+            }
+            case LogRecordType::NEWPAGE:
+                log_record.prev_page_id_ = *(reinterpret_cast<const page_id_t *>(data));
+                log_record.page_id_ = *(reinterpret_cast<const page_id_t *>(data + sizeof(page_id_t)));
+                break;
+            case LogRecordType::END_CHECKPOINT:
+            {
+                log_record.begin_checkpoint_lsn_ = *(reinterpret_cast<const lsn_t *>(data));
+                data += sizeof(lsn_t);
+                int32_t count = *(reinterpret_cast<const int32_t *>(data));
+                data += sizeof(int32_t);
+                log_record.active_txns_.clear();
+                for (int32_t i = 0; i < count; i++) {
+                    log_record.active_txns_.emplace_back(
+                            *(reinterpret_cast<const txn_id_t *>(data)),
+                            *(reinterpret_cast<const lsn_t *>(data + sizeof(txn_id_t))));
+                    data += sizeof(txn_id_t) + sizeof(lsn_t);
+                }
+                count = *(reinterpret_cast<const int32_t *>(data));
+                data += sizeof(int32_t);
+                log_record.dirty_pages_.clear();
+                for (int32_t i = 0; i < count; i++) {
+                    log_record.dirty_pages_.emplace_back(
+                            *(reinterpret_cast<const page_id_t *>(data)),
+                            *(reinterpret_cast<const lsn_t *>(data + sizeof(page_id_t))));
+                    data += sizeof(page_id_t) + sizeof(lsn_t);
+                }
+                break;
+            }
+            case LogRecordType::BTREE_INSERT:
+            case LogRecordType::BTREE_DELETE:
+            case LogRecordType::BTREE_NEWPAGE:
+            {
+                const int32_t *fields = reinterpret_cast<const int32_t *>(data);
+                log_record.page_id_ = fields[0];
+                log_record.btree_index_ = fields[1];
+                log_record.btree_count_ = fields[2];
+                log_record.btree_entry_size_ = fields[3];
+                data += 4 * sizeof(int32_t);
+                int32_t size = fields[2] * fields[3];
+                log_record.btree_data_.assign(data, data + size);
+                data += size;
+                DeserializeIndexName(data, log_record.index_name_);
+                break;
+            }
+            case LogRecordType::BTREE_SET_PARENT:
+            case LogRecordType::BTREE_SET_NEXT:
+            case LogRecordType::BTREE_ROOT:
+            {
+                const page_id_t *fields = reinterpret_cast<const page_id_t *>(data);
+                log_record.page_id_ = fields[0];
+                log_record.btree_old_id_ = fields[1];
+                log_record.btree_new_id_ = fields[2];
+                DeserializeIndexName(data + 3 * sizeof(page_id_t),
+                                     log_record.index_name_);
+                break;
+            }
+            case LogRecordType::BEGIN:
+            case LogRecordType::COMMIT:
+            case LogRecordType::ABORT:
+            case LogRecordType::BEGIN_CHECKPOINT:
+            case LogRecordType::BTREE_SMO_END:
+                break;
+            default:
+                return false;
+        }
+
+        return true;
+    }
+
+    void LogReader::DeserializeIndexName(const char *data, std::string &name) {
+        int32_t size = *(reinterpret_cast<const int32_t *>(data));
+        name.assign(data + sizeof(int32_t), size);
+    }
+
+    int LogReader::ReadChunk(char *buffer, int64_t offset) {
+        int size = static_cast<int>(
+                std::min<int64_t>(chunk_size_, log_end_ - offset));
+        if (size <= 0)
+            return 0;
+        return disk_manager_->ReadLog(buffer, size, offset) ? size : 0;
+    }
+
+    void LogReader::StartReadAhead() {
+        int next = current_ ^ 1;
+        int64_t offset = buffer_offset_[current_] + buffer_size_[current_];
+        buffer_offset_[next] = offset;
+        // 已经到log末尾时不需要额外的线程
+        auto policy = offset < log_end_ ? std::launch::async
+                                        : std::launch::deferred;
+        read_ahead_ = std::async(policy, &LogReader::ReadChunk, this,
+                                 buffers_[next], offset);
+    }
+
+    bool LogReader::NextChunk() {
+        if (!read_ahead_.valid())
+            return false;
+        int size = read_ahead_.get();
+        current_ ^= 1;
+        buffer_size_[current_] = size;
+        position_ = 0;
+        if (size == 0)
+            return false;
+        StartReadAhead();
+        return true;
+    }
+
+    void LogReader::Seek(int64_t offset) {
+        if (read_ahead_.valid())
+            read_ahead_.wait();
+        log_end_ = disk_manager_->GetLogEndOffset();
+        current_ = 0;
+        position_ = 0;
+        buffer_offset_[current_] = offset;
+        buffer_size_[current_] = ReadChunk(buffers_[current_], offset);
+        record_offset_ = next_offset_ = offset;
+        StartReadAhead();
+    }
+
+    const char *LogReader::Consume(int size) {
+        if (position_ + size <= buffer_size_[current_]) {
+            const char *data = buffers_[current_] + position_;
+            position_ += size;
+            return data;
+        }
+        //record横跨两个chunk，拼接到record_buffer_中
+        record_buffer_.resize(size);
+        int copied = 0;
+        while (copied < size) {
+            int available = buffer_size_[current_] - position_;
+            if (available == 0) {
+                if (!NextChunk())
+                    return nullptr;
+                continue;
+            }
+            int count = std::min(available, size - copied);
+            memcpy(record_buffer_.data() + copied,
+                   buffers_[current_] + position_, count);
+            copied += count;
+            position_ += count;
+        }
+        return record_buffer_.data();
+    }
+
+    bool LogReader::Next(LogRecord &log_record) {
+        if (NextRecord(log_record))
+            return true;
+        // scan is over, no read may touch the disk manager behind the caller
+        if (read_ahead_.valid())
+            read_ahead_.wait();
+        return false;
+    }
+
+    bool LogReader::NextRecord(LogRecord &log_record) {
+        record_offset_ = next_offset_;
+        if (next_offset_ + LogRecord::HEADER_SIZE > log_end_)
+            return false;
+        const char *header = Consume(LogRecord::HEADER_SIZE);
+        if (header == nullptr)
+            return false;
+        log_record.DeserializeHeader(header);
+        //丢弃不完整的log record
+        if (log_record.size_ < LogRecord::HEADER_SIZE ||
+            next_offset_ + log_record.size_ > log_end_)
+            return false;
+        const char *body = Consume(log_record.size_ - LogRecord::HEADER_SIZE);
+        if (body == nullptr || !DeserializeLogRecord(body, log_record))
+            return false;
+        next_offset_ += log_record.size_;
+        return true;
+    }
+
+/*
+ * undo follows prevLSN backwards, so the window is centered on offset and
+ * the earlier records of the same transaction are usually already cached
+ */
+    bool LogReader::ReadAt(int64_t offset, LogRecord &log_record) {
+        int64_t log_start = disk_manager_->GetLogStartOffset();
+        if (offset < log_start || offset + LogRecord::HEADER_SIZE > log_end_)
+            return false;
+        if (offset < random_offset_ ||
+            offset + LogRecord::HEADER_SIZE > random_offset_ + random_size_) {
+            random_offset_ = std::max(log_start, offset - chunk_size_ / 2);
+            random_size_ = ReadChunk(random_buffer_, random_offset_);
+            if (offset + LogRecord::HEADER_SIZE > random_offset_ + random_size_)
+                return false;
+        }
+        const char *header = random_buffer_ + (offset - random_offset_);
+        log_record.DeserializeHeader(header);
+        // lsn is the log offset, anything else is not a record boundary
+        if (log_record.lsn_ != offset ||
+            log_record.size_ < LogRecord::HEADER_SIZE ||
+            offset + log_record.size_ > log_end_)
+            return false;
+        const char *body = header + LogRecord::HEADER_SIZE;
+        if (offset + log_record.size_ > random_offset_ + random_size_) {
+            // record longer than what is left of the window
+            int body_size = log_record.size_ - LogRecord::HEADER_SIZE;
+            record_buffer_.resize(body_size);
+            if (!disk_manager_->ReadLog(record_buffer_.data(), body_size,
+                                        offset + LogRecord::HEADER_SIZE))
+                return false;
+            body = record_buffer_.data();
+        }
+        return DeserializeLogRecord(body, log_record);
+    }
+
+} // namespace cmudb
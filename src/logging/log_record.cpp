@@ -0,0 +1,119 @@
+/**
+ * log_record.cpp
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "logging/log_record.h"
+
+namespace cmudb {
+/*
+ * 计算old tuple到new tuple的delta。先去掉相同的前缀和后缀；
+ * tuple长度不变时(定长列更新)中间部分再按不同的字节拆成多个range，
+ * 相同字节的间隙不超过一个range header时合并到同一个range，避免range过碎
+ */
+    void LogRecord::EncodeUpdateDelta(const Tuple &old_tuple,
+                                      const Tuple &new_tuple) {
+        const char *old_data = old_tuple.GetData();
+        const char *new_data = new_tuple.GetData();
+        int32_t old_size = old_tuple.GetLength();
+        int32_t new_size = new_tuple.GetLength();
+        int32_t min_size = std::min(old_size, new_size);
+
+        int32_t prefix = 0;
+        while (prefix < min_size && old_data[prefix] == new_data[prefix])
+            prefix++;
+        int32_t suffix = 0;
+        while (suffix < min_size - prefix &&
+               old_data[old_size - 1 - suffix] == new_data[new_size - 1 - suffix])
+            suffix++;
+
+        auto append_range = [&](int32_t offset, int32_t old_len, int32_t new_len) {
+            int32_t header[3] = {offset, old_len, new_len};
+            size_t pos = update_delta_.size();
+            update_delta_.resize(pos + DELTA_RANGE_HEADER_SIZE + old_len + new_len);
+            memcpy(update_delta_.data() + pos, header, DELTA_RANGE_HEADER_SIZE);
+            pos += DELTA_RANGE_HEADER_SIZE;
+            memcpy(update_delta_.data() + pos, old_data + offset, old_len);
+            memcpy(update_delta_.data() + pos + old_len, new_data + offset, new_len);
+        };
+
+        update_delta_.clear();
+        if (old_size != new_size) {
+            // 变长列导致后续字节整体平移，只能记录一个range
+            append_range(prefix, old_size - suffix - prefix,
+                         new_size - suffix - prefix);
+            return;
+        }
+        int32_t end = old_size - suffix;
+        int32_t pos = prefix;
+        while (pos < end) {
+            // old_data[pos] != new_data[pos]
+            int32_t last_diff = pos;
+            for (int32_t i = pos + 1; i < end; i++) {
+                if (old_data[i] != new_data[i])
+                    last_diff = i;
+                else if (i - last_diff > DELTA_RANGE_HEADER_SIZE)
+                    break;
+            }
+            append_range(pos, last_diff + 1 - pos, last_diff + 1 - pos);
+            pos = last_diff + 1;
+            while (pos < end && old_data[pos] == new_data[pos])
+                pos++;
+        }
+    }
+
+/*
+ * 按range顺序把未改变的字节从tuple拷贝过来，改变的字节从delta中取。
+ * undo时输入为new tuple，range的offset需要加上之前range造成的长度差
+ */
+    bool LogRecord::ApplyUpdateDelta(const Tuple &tuple, Tuple &result,
+                                     bool undo) const {
+        assert(log_record_type_ == LogRecordType::UPDATE);
+        int32_t from_size = undo ? new_tuple_size_ : old_tuple_size_;
+        int32_t to_size = undo ? old_tuple_size_ : new_tuple_size_;
+        if (tuple.GetLength() != from_size)
+            return false;
+
+        // serialized form of result: | size | data |
+        std::vector<char> image(sizeof(int32_t) + to_size);
+        memcpy(image.data(), &to_size, sizeof(int32_t));
+        char *dest = image.data() + sizeof(int32_t);
+        const char *from = tuple.GetData();
+
+        int32_t from_pos = 0;
+        int32_t to_pos = 0;
+        int32_t shift = 0;
+        size_t pos = 0;
+        while (pos < update_delta_.size()) {
+            int32_t header[3];
+            memcpy(header, update_delta_.data() + pos, DELTA_RANGE_HEADER_SIZE);
+            pos += DELTA_RANGE_HEADER_SIZE;
+            const char *old_bytes = update_delta_.data() + pos;
+            const char *new_bytes = old_bytes + header[1];
+            pos += header[1] + header[2];
+
+            int32_t offset = undo ? header[0] + shift : header[0];
+            int32_t from_len = undo ? header[2] : header[1];
+            int32_t to_len = undo ? header[1] : header[2];
+            const char *to_bytes = undo ? old_bytes : new_bytes;
+            shift += header[2] - header[1];
+
+            if (offset < from_pos || offset + from_len > from_size ||
+                to_pos + offset - from_pos + to_len > to_size)
+                return false;
+            memcpy(dest + to_pos, from + from_pos, offset - from_pos);
+            to_pos += offset - from_pos;
+            memcpy(dest + to_pos, to_bytes, to_len);
+            to_pos += to_len;
+            from_pos = offset + from_len;
+        }
+        if (to_pos + from_size - from_pos != to_size)
+            return false;
+        memcpy(dest + to_pos, from + from_pos, from_size - from_pos);
+        result.DeserializeFrom(image.data());
+        return true;
+    }
+
+} // namespace cmudb
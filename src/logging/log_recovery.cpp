@@ -2,125 +2,444 @@
  * log_recovey.cpp
  */
 
+#include <cstring>
+#include <unordered_set>
+
 #include "logging/log_recovery.h"
+#include "page/b_plus_tree_page.h"
+#include "page/header_page.h"
 #include "page/table_page.h"
 
 namespace cmudb {
+    // records logged by BPlusTree, applied to its pages (header page for root)
+    static bool IsBPlusTreeRecord(LogRecordType type) {
+        return type >= LogRecordType::BTREE_INSERT &&
+               type <= LogRecordType::BTREE_SMO_END;
+    }
+
 /*
- * deserialize a log record from log buffer
- * @return: true means deserialize succeed, otherwise can't deserialize cause
- * incomplete log record
+ * page a data log record modifies, INVALID_PAGE_ID for the other types
  */
-    bool LogRecovery::DeserializeLogRecord( const char *data,
-                                           LogRecord &log_record ) {
-
-        if( data + LogRecord::HEADER_SIZE >= log_buffer_ + LOG_BUFFER_SIZE )
-            return false;
-        memcpy(&log_record, data, LogRecord::HEADER_SIZE);
-        data += LogRecord::HEADER_SIZE;
-        //丢弃不完整的log record
-        if( data + log_record.size_ > log_buffer_ + LOG_BUFFER_SIZE )
-            return false;
+    page_id_t LogRecovery::GetRecordPageId(LogRecord &log_record) {
         switch (log_record.log_record_type_) {
             case LogRecordType::INSERT:
-                log_record.insert_rid_ = *(reinterpret_cast<const RID *>(data));
-                log_record.insert_tuple_.DeserializeFrom(data+sizeof(RID));
-                break;
+                return log_record.insert_rid_.GetPageId();
+            case LogRecordType::UPDATE:
+                return log_record.update_rid_.GetPageId();
             case LogRecordType::MARKDELETE:
             case LogRecordType::APPLYDELETE:
             case LogRecordType::ROLLBACKDELETE:
-                log_record.delete_rid_ = *(reinterpret_cast<const RID *>(data));
-                log_record.delete_tuple_.DeserializeFrom( data + sizeof(RID));
-                break;
-            case LogRecordType::UPDATE:
-                //注意data内数据成员的偏移
-                log_record.update_rid_ = *(reinterpret_cast<const RID *>(data));
-                log_record.old_tuple_.DeserializeFrom( data + sizeof( RID ));
-                data += (log_record.old_tuple_.GetLength() +2* sizeof(RID));
-                log_record.new_tuple_.DeserializeFrom( data );
-                break;
+                return log_record.delete_rid_.GetPageId();
             case LogRecordType::NEWPAGE:
-                log_record.prev_page_id_ = *(reinterpret_cast<const page_id_t *>(data));
-                log_record.page_id_ = *(reinterpret_cast<const page_id_t *>(data + sizeof(page_id_t)));
-                break;
-            case LogRecordType::BEGIN:
-            case LogRecordType::COMMIT:
-            case LogRecordType::ABORT:
-                break;
+            case LogRecordType::BTREE_INSERT:
+            case LogRecordType::BTREE_DELETE:
+            case LogRecordType::BTREE_NEWPAGE:
+            case LogRecordType::BTREE_SET_PARENT:
+            case LogRecordType::BTREE_SET_NEXT:
+            case LogRecordType::BTREE_ROOT:
+                return log_record.page_id_;
             default:
-                return false;
+                return INVALID_PAGE_ID;
         }
+    }
 
-        return true;
+/*
+ *analysis phase (ARIES)
+ *scan the log from its first live offset, build active_txn_
+ *and the dirty page table. At an END_CHECKPOINT the dirty page table is
+ *replaced by the checkpoint's one plus pages first touched since its
+ *BEGIN_CHECKPOINT: any other page was written back before the checkpoint.
+ *Redo starts from the minimum recLSN
+ */
+    void LogRecovery::Analysis() {
+        //顺序读取log file，truncate之前的部分已经不需要恢复
+        reader_.Seek(disk_manager_->GetLogStartOffset());
+        // pages first touched since the last BEGIN_CHECKPOINT
+        std::unordered_map<page_id_t, lsn_t> dirty_since_checkpoint;
+        lsn_t checkpoint_lsn = INVALID_LSN;
+        std::unordered_set<txn_id_t> finished_txn;
+        LogRecord logRecord;
+        while (reader_.Next(logRecord)) {
+            auto type = logRecord.log_record_type_;
+            if (type == LogRecordType::BEGIN_CHECKPOINT) {
+                checkpoint_lsn = logRecord.GetLSN();
+                dirty_since_checkpoint.clear();
+                continue;
+            }
+            if (type == LogRecordType::END_CHECKPOINT) {
+                if (logRecord.begin_checkpoint_lsn_ != checkpoint_lsn)
+                    continue;
+                dirty_page_table_.clear();
+                for (auto &entry : logRecord.dirty_pages_)
+                    dirty_page_table_[entry.first] = entry.second;
+                for (auto &entry : dirty_since_checkpoint)
+                    if (dirty_page_table_.count(entry.first) == 0)
+                        dirty_page_table_[entry.first] = entry.second;
+                //checkpoint时仍在运行、但扫描中没有看到结束的事务
+                for (auto &entry : logRecord.active_txns_)
+                    if (finished_txn.count(entry.first) == 0 &&
+                        active_txn_.count(entry.first) == 0)
+                        active_txn_[entry.first] = entry.second;
+                continue;
+            }
+            //每个txn对应其最大的lsn，没有事务的index修改不需要undo
+            if (logRecord.GetTxnId() != INVALID_TXN_ID)
+                active_txn_[logRecord.GetTxnId()] = logRecord.GetLSN();
+            if (type == LogRecordType::COMMIT || type == LogRecordType::ABORT) {
+                active_txn_.erase(logRecord.txn_id_);
+                finished_txn.insert(logRecord.txn_id_);
+                continue;
+            }
+            page_id_t page_id = GetRecordPageId(logRecord);
+            if (page_id == INVALID_PAGE_ID)
+                continue;
+            // pages allocated before the crash may not be in the db file yet
+            disk_manager_->MarkAllocated(page_id);
+            dirty_page_table_.emplace(page_id, logRecord.GetLSN());
+            dirty_since_checkpoint.emplace(page_id, logRecord.GetLSN());
+            // NEWPAGE also links the previous page to the new one
+            if (type == LogRecordType::NEWPAGE &&
+                logRecord.prev_page_id_ != INVALID_PAGE_ID) {
+                dirty_page_table_.emplace(logRecord.prev_page_id_, logRecord.GetLSN());
+                dirty_since_checkpoint.emplace(logRecord.prev_page_id_,
+                                               logRecord.GetLSN());
+            }
+        }
+        redo_lsn_ = INVALID_LSN;
+        for (auto &entry : dirty_page_table_)
+            if (redo_lsn_ == INVALID_LSN || entry.second < redo_lsn_)
+                redo_lsn_ = entry.second;
+    }
+
+/*
+ * true if the change of log record on page_id may be missing on disk,
+ * i.e. the page is in the dirty page table and its recLSN is not after lsn
+ */
+    bool LogRecovery::NeedRedo(page_id_t page_id, lsn_t lsn) {
+        auto it = dirty_page_table_.find(page_id);
+        return it != dirty_page_table_.end() && it->second <= lsn;
     }
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
- *read log file from the beginning to end (you must prefetch log records into
- *log buffer to reduce unnecessary I/O operations), remember to compare page's
- *LSN with log_record's sequence number, and also build active_txn_ table &
- *lsn_mapping_ table
+ *run the analysis pass, then repeat history from the minimum recLSN. Pages
+ *outside the dirty page table or with a recLSN past the record are skipped
+ *without being fetched. The calling thread parses the log and hands every
+ *remaining record to the worker owning its page (page id modulo number of
+ *workers), so records of one page are applied in log order while different
+ *pages are redone in parallel. Pages of records about to be dispatched are
+ *prefetched by another thread, so their reads overlap with replay
  */
     void LogRecovery::Redo() {
+        Analysis();
+        prefetch_count_ = 0;
+        if (redo_lsn_ == INVALID_LSN)
+            return;
+        std::vector<std::unique_ptr<RedoWorker>> workers;
+        for (int i = 0; i < redo_threads_; i++) {
+            workers.emplace_back(new RedoWorker());
+            workers.back()->thread =
+                    std::thread(&LogRecovery::RedoWorkerLoop, this, workers.back().get());
+        }
+        std::vector<std::vector<RedoTask>> batches(redo_threads_);
+        // hand the batch of worker i over, wait while its queue is full
+        auto dispatch = [&](int i) {
+            RedoWorker *worker = workers[i].get();
+            std::unique_lock<std::mutex> lock(worker->latch);
+            worker->cv.wait(lock, [&] {
+                return worker->batches.size() < REDO_QUEUE_DEPTH;
+            });
+            worker->batches.push_back(std::move(batches[i]));
+            batches[i].clear();
+            worker->cv.notify_all();
+        };
+        // prefetch pages the next records need, unless requested recently
+        Prefetcher prefetcher;
+        prefetcher.thread = std::thread(&LogRecovery::PrefetchLoop, this, &prefetcher);
+        std::deque<page_id_t> recent_pages;
+        std::unordered_set<page_id_t> recent_page_set;
+        auto prefetch = [&](page_id_t page_id) {
+            if (prefetch_depth_ == 0 || !recent_page_set.insert(page_id).second)
+                return;
+            recent_pages.push_back(page_id);
+            if (recent_pages.size() > prefetch_depth_) {
+                recent_page_set.erase(recent_pages.front());
+                recent_pages.pop_front();
+            }
+            // prefetch只是提示，队列满时直接丢弃
+            std::lock_guard<std::mutex> lock(prefetcher.latch);
+            if (prefetcher.pages.size() < prefetch_depth_) {
+                prefetcher.pages.push_back(page_id);
+                prefetcher.cv.notify_one();
+            }
+        };
+        auto add_task = [&](const LogRecord &log_record, page_id_t page_id) {
+            // a new page is initialized by redo, its old content is not needed
+            if ((log_record.log_record_type_ != LogRecordType::NEWPAGE ||
+                 log_record.page_id_ != page_id) &&
+                log_record.log_record_type_ != LogRecordType::BTREE_NEWPAGE)
+                prefetch(page_id);
+            int i = page_id % redo_threads_;
+            batches[i].push_back(RedoTask{log_record, page_id});
+            if (batches[i].size() >= REDO_BATCH_SIZE)
+                dispatch(i);
+        };
 
-        //读取log file
-        disk_manager_->ReadLog(log_buffer_, LOG_BUFFER_SIZE, 0);
+        // lsn is the log offset, a recLSN is always a record boundary
+        reader_.Seek(std::max<int64_t>(redo_lsn_,
+                                       disk_manager_->GetLogStartOffset()));
         LogRecord logRecord;
-        while (DeserializeLogRecord(log_buffer_ + offset_, logRecord)) {
-            //构建lsn_mapping_和active_txn_表
-            lsn_mapping_[logRecord.GetLSN()] = offset_;
-            active_txn_[logRecord.GetTxnId()] = logRecord.GetLSN(); //每个txn对应其最大的lsn
-            offset_ += logRecord.size_;
-            if (logRecord.log_record_type_ == LogRecordType::COMMIT ||
-                logRecord.log_record_type_ == LogRecordType::ABORT) {
-                active_txn_.erase(logRecord.txn_id_);
+        while (reader_.Next(logRecord)) {
+            lsn_t lsn = logRecord.GetLSN();
+            if (lsn < redo_lsn_)
                 continue;
+            page_id_t page_id = GetRecordPageId(logRecord);
+            if (page_id != INVALID_PAGE_ID && NeedRedo(page_id, lsn))
+                add_task(logRecord, page_id);
+            // NEWPAGE还要修改prev page的next page信息，由prev page的worker执行
+            if (logRecord.log_record_type_ == LogRecordType::NEWPAGE &&
+                logRecord.prev_page_id_ != INVALID_PAGE_ID &&
+                NeedRedo(logRecord.prev_page_id_, lsn))
+                add_task(logRecord, logRecord.prev_page_id_);
+        }
+
+        for (int i = 0; i < redo_threads_; i++) {
+            if (!batches[i].empty())
+                dispatch(i);
+            std::lock_guard<std::mutex> lock(workers[i]->latch);
+            workers[i]->done = true;
+            workers[i]->cv.notify_all();
+        }
+        for (auto &worker : workers)
+            worker->thread.join();
+        {
+            std::lock_guard<std::mutex> lock(prefetcher.latch);
+            prefetcher.done = true;
+            prefetcher.cv.notify_all();
+        }
+        prefetcher.thread.join();
+    }
+
+/*
+ * prefetch thread of redo, read the requested pages into the buffer pool
+ * without keeping them pinned, so the worker redoing them hits the cache.
+ * Pages still queued when redo finishes are dropped
+ */
+    void LogRecovery::PrefetchLoop(Prefetcher *prefetcher) {
+        while (true) {
+            page_id_t page_id;
+            {
+                std::unique_lock<std::mutex> lock(prefetcher->latch);
+                prefetcher->cv.wait(lock, [&] {
+                    return !prefetcher->pages.empty() || prefetcher->done;
+                });
+                if (prefetcher->done)
+                    return;
+                page_id = prefetcher->pages.front();
+                prefetcher->pages.pop_front();
+            }
+            // 所有frame都被pin住时放弃这次prefetch
+            if (buffer_pool_manager_->FetchPage(page_id) != nullptr) {
+                buffer_pool_manager_->UnpinPage(page_id, false);
+                prefetch_count_++;
             }
-            if (logRecord.log_record_type_ == LogRecordType::NEWPAGE) {
-                auto page = static_cast<TablePage *>(
-                        buffer_pool_manager_->FetchPage(logRecord.page_id_));
+        }
+    }
 
+/*
+ * worker thread of redo, apply the batches queued for its pages until the
+ * reader is done
+ */
+    void LogRecovery::RedoWorkerLoop(RedoWorker *worker) {
+        std::vector<RedoTask> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(worker->latch);
+                worker->cv.wait(lock, [&] {
+                    return !worker->batches.empty() || worker->done;
+                });
+                if (worker->batches.empty())
+                    return;
+                batch = std::move(worker->batches.front());
+                worker->batches.pop_front();
+                // reader may wait for room in the queue
+                worker->cv.notify_all();
+            }
+            for (auto &task : batch)
+                RedoRecord(task.log_record, task.page_id);
+        }
+    }
+
+/*
+ * redo the change of log_record on page_id if the page LSN shows it is
+ * missing. A NEWPAGE record is redone on the new page and, separately, on
+ * the previous page whose next page id it sets
+ */
+    void LogRecovery::RedoRecord(LogRecord &logRecord, page_id_t page_id) {
+        lsn_t lsn = logRecord.GetLSN();
+        if (IsBPlusTreeRecord(logRecord.log_record_type_)) {
+            Page *page = buffer_pool_manager_->FetchPage(page_id);
+            // 与table page的NEWPAGE一样，新页总是重新初始化
+            bool need_redo = logRecord.log_record_type_ == LogRecordType::BTREE_NEWPAGE ||
+                             lsn > page->GetLSN();
+            if (need_redo) {
+                RedoBPlusTreeRecord(logRecord, page);
+                page->SetLSN(lsn);
+            }
+            buffer_pool_manager_->UnpinPage(page_id, need_redo);
+            return;
+        }
+        if (logRecord.log_record_type_ == LogRecordType::NEWPAGE) {
+            TablePage *page = static_cast<TablePage *>(
+                    buffer_pool_manager_->FetchPage(page_id));
+            if (page_id == logRecord.page_id_) {
                 //新申请的一页， 初始化信息，并赋给log record的lsn
                 page->Init(logRecord.page_id_, PAGE_SIZE, logRecord.prev_page_id_, nullptr, nullptr);
-                page->setPageLSN(logRecord.lsn_);
-                //修改prev page的信息
-                TablePage *prevPage = static_cast<TablePage *>(
-                        buffer_pool_manager_->FetchPage(logRecord.prev_page_id_));
-                //如果prev page有next page 则修改next page的头部信息
-
-                prevPage->SetNextPageId(logRecord.page_id_);
-                buffer_pool_manager_->UnpinPage( logRecord.prev_page_id_, true );
-                buffer_pool_manager_->UnpinPage(logRecord.page_id_, true);
-                continue;
+                page->setPageLSN(lsn);
+            } else {
+                //修改prev page的next page信息
+                page->SetNextPageId(logRecord.page_id_);
             }
-            //由log record获取record rid，再由record ID获取page ID
-            RID tupleRid = logRecord.log_record_type_ == LogRecordType::INSERT ? logRecord.insert_rid_
-                                                                               : logRecord.log_record_type_ ==
-                                                                                 LogRecordType::UPDATE
-                                                                                 ? logRecord.update_rid_
-                                                                                 : logRecord.delete_rid_;
-            TablePage *tablePage = static_cast<TablePage *>(
-                    buffer_pool_manager_->FetchPage(tupleRid.GetPageId()));
-            bool need_redo = logRecord.GetLSN() > tablePage->GetPageLSN();
-            if (need_redo) {
-                if (logRecord.log_record_type_ == LogRecordType::INSERT) {
-                    tablePage->InsertTuple(logRecord.insert_tuple_, tupleRid,
-                                           nullptr, nullptr, nullptr);
-                } else if (logRecord.log_record_type_ == LogRecordType::UPDATE) {
-                    tablePage->UpdateTuple(logRecord.old_tuple_, logRecord.new_tuple_, tupleRid,
+            buffer_pool_manager_->UnpinPage(page_id, true);
+            return;
+        }
+        //由log record获取record rid，再由record ID获取page ID
+        RID tupleRid = logRecord.log_record_type_ == LogRecordType::INSERT ? logRecord.insert_rid_
+                                                                           : logRecord.log_record_type_ ==
+                                                                             LogRecordType::UPDATE
+                                                                             ? logRecord.update_rid_
+                                                                             : logRecord.delete_rid_;
+        TablePage *tablePage = static_cast<TablePage *>(
+                buffer_pool_manager_->FetchPage(page_id));
+        bool need_redo = lsn > tablePage->GetPageLSN();
+        if (need_redo) {
+            if (logRecord.log_record_type_ == LogRecordType::INSERT) {
+                tablePage->InsertTuple(logRecord.insert_tuple_, tupleRid,
+                                       nullptr, nullptr, nullptr);
+            } else if (logRecord.log_record_type_ == LogRecordType::UPDATE) {
+                // 由页面上的before image和delta重建after image
+                Tuple old_tuple, new_tuple;
+                tablePage->GetTuple(tupleRid, old_tuple, nullptr, nullptr);
+                if (logRecord.ApplyUpdateDelta(old_tuple, new_tuple, false))
+                    tablePage->UpdateTuple(new_tuple, old_tuple, tupleRid,
                                            nullptr, nullptr, nullptr);
-                } else if (logRecord.log_record_type_ == LogRecordType::MARKDELETE) {
-                    tablePage->MarkDelete(tupleRid, nullptr, nullptr, nullptr);
-                } else if (logRecord.log_record_type_ == LogRecordType::APPLYDELETE) {
-                    tablePage->ApplyDelete(tupleRid, nullptr, nullptr);
-                } else if (logRecord.log_record_type_ == LogRecordType::ROLLBACKDELETE) {
-                    tablePage->RollbackDelete(tupleRid, nullptr, nullptr);
+            } else if (logRecord.log_record_type_ == LogRecordType::MARKDELETE) {
+                tablePage->MarkDelete(tupleRid, nullptr, nullptr, nullptr);
+            } else if (logRecord.log_record_type_ == LogRecordType::APPLYDELETE) {
+                tablePage->ApplyDelete(tupleRid, nullptr, nullptr);
+            } else if (logRecord.log_record_type_ == LogRecordType::ROLLBACKDELETE) {
+                tablePage->RollbackDelete(tupleRid, nullptr, nullptr);
+            }
+            tablePage->setPageLSN(lsn);
+        }
+        buffer_pool_manager_->UnpinPage(page_id, need_redo);
+    }
+
+/*
+ * apply a B+ tree log record to its page, page LSN is checked by the caller
+ */
+    void LogRecovery::RedoBPlusTreeRecord(LogRecord &logRecord, Page *page) {
+        auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+        switch (logRecord.log_record_type_) {
+            case LogRecordType::BTREE_INSERT:
+                node->InsertEntryData(logRecord.btree_index_, logRecord.btree_data_.data(),
+                                      logRecord.btree_count_, logRecord.btree_entry_size_);
+                break;
+            case LogRecordType::BTREE_DELETE:
+                node->RemoveEntryData(logRecord.btree_index_, logRecord.btree_count_,
+                                      logRecord.btree_entry_size_);
+                break;
+            case LogRecordType::BTREE_NEWPAGE:
+                //日志中是初始化后的header
+                memcpy(page->GetData(), logRecord.btree_data_.data(),
+                       logRecord.btree_data_.size());
+                break;
+            case LogRecordType::BTREE_SET_PARENT:
+                node->SetParentPageId(logRecord.btree_new_id_);
+                break;
+            case LogRecordType::BTREE_SET_NEXT:
+                // next page id是leaf header的最后一项
+                memcpy(page->GetData() + B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE - sizeof(page_id_t),
+                       &logRecord.btree_new_id_, sizeof(page_id_t));
+                break;
+            case LogRecordType::BTREE_ROOT:
+            {
+                auto header_page = static_cast<HeaderPage *>(page);
+                if (!header_page->UpdateRecord(logRecord.GetIndexName(), logRecord.btree_new_id_) &&
+                    logRecord.btree_new_id_ != INVALID_PAGE_ID)
+                    header_page->InsertRecord(logRecord.GetIndexName(), logRecord.btree_new_id_);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+/*
+ * undo a B+ tree log record of a loser transaction. Leaf inserts and deletes
+ * of the user are undone logically through the registered index, the entry
+ * may have moved to another page since. Records of a structure modification
+ * are only seen when it was interrupted (a finished one is skipped through
+ * its BTREE_SMO_END), they are undone on the page
+ */
+    void LogRecovery::UndoBPlusTreeRecord(LogRecord &logRecord) {
+        auto type = logRecord.log_record_type_;
+        if (type == LogRecordType::BTREE_SMO_END)
+            return;
+        if (type == LogRecordType::BTREE_NEWPAGE) {
+            buffer_pool_manager_->DeletePage(logRecord.page_id_);
+            disk_manager_->DeallocatePage(logRecord.page_id_);
+            return;
+        }
+        int entry_size = logRecord.btree_entry_size_;
+        int count = logRecord.btree_count_;
+        const char *data = logRecord.btree_data_.data();
+        if (type == LogRecordType::BTREE_INSERT || type == LogRecordType::BTREE_DELETE) {
+            auto it = index_undo_.find(logRecord.GetIndexName());
+            if (!logRecord.GetIndexName().empty() && it != index_undo_.end()) {
+                for (int i = 0; i < count; i++)
+                    it->second(data + i * entry_size, type == LogRecordType::BTREE_INSERT);
+                return;
+            }
+        }
+
+        Page *page = buffer_pool_manager_->FetchPage(logRecord.page_id_);
+        auto node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+        switch (type) {
+            case LogRecordType::BTREE_INSERT:
+            {
+                int index = logRecord.btree_index_;
+                if (index + count > node->GetSize() ||
+                    memcmp(node->GetEntryData(index, entry_size), data, count * entry_size) != 0) {
+                    //entry已经不在记录的位置上，在页内查找
+                    index = -1;
+                    for (int i = 0; i + count <= node->GetSize() && index == -1; i++)
+                        if (memcmp(node->GetEntryData(i, entry_size), data, count * entry_size) == 0)
+                            index = i;
                 }
+                if (index != -1)
+                    node->RemoveEntryData(index, count, entry_size);
+                break;
             }
-            tablePage->setPageLSN(logRecord.GetLSN());
-            buffer_pool_manager_->UnpinPage(tablePage->GetPageId(), need_redo);
+            case LogRecordType::BTREE_DELETE:
+                node->InsertEntryData(std::min(logRecord.btree_index_, node->GetSize()),
+                                      data, count, entry_size);
+                break;
+            case LogRecordType::BTREE_SET_PARENT:
+                node->SetParentPageId(logRecord.btree_old_id_);
+                break;
+            case LogRecordType::BTREE_SET_NEXT:
+                memcpy(page->GetData() + B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE - sizeof(page_id_t),
+                       &logRecord.btree_old_id_, sizeof(page_id_t));
+                break;
+            case LogRecordType::BTREE_ROOT:
+                static_cast<HeaderPage *>(page)->UpdateRecord(logRecord.GetIndexName(),
+                                                              logRecord.btree_old_id_);
+                break;
+            default:
+                break;
         }
-        //是否继续读取log file?
+        buffer_pool_manager_->UnpinPage(logRecord.page_id_, true);
     }
 
 /*
@@ -129,14 +448,20 @@ namespace cmudb {
  */
     void LogRecovery::Undo() {
         for( auto &mapped_value : active_txn_ ){
-            int travLsn = mapped_value.second;
+            lsn_t travLsn = mapped_value.second;
             //每一个事务初始的lsn的prev lsn为INVALID
             while ( travLsn != INVALID_LSN ){
-                //定位log buffer中的log record
-                int log_off = lsn_mapping_[travLsn];
+                //lsn即log offset，BEGIN可能已经随checkpoint被truncate
                 LogRecord currentLogRecord;
-                DeserializeLogRecord( log_buffer_ + log_off, currentLogRecord );//获取log record
+                if (!reader_.ReadAt(travLsn, currentLogRecord))//获取log record
+                    break;
                 travLsn = currentLogRecord.GetPrevLSN();
+                if (currentLogRecord.log_record_type_ == LogRecordType::BEGIN)
+                    break;
+                if (IsBPlusTreeRecord(currentLogRecord.log_record_type_)) {
+                    UndoBPlusTreeRecord(currentLogRecord);
+                    continue;
+                }
                 /*
                  * 执行Undo，事务处于未提交或者未回滚状态
                  * 从NEW PAGE状态开始Undo
@@ -163,8 +488,12 @@ namespace cmudb {
                 if (currentLogRecord.log_record_type_ == LogRecordType::INSERT) {
                     tablePage->ApplyDelete( tupleRid, nullptr, nullptr );
                 } else if (currentLogRecord.log_record_type_ == LogRecordType::UPDATE) {
-                    tablePage->UpdateTuple(currentLogRecord.new_tuple_, currentLogRecord.old_tuple_, tupleRid,
-                                           nullptr, nullptr, nullptr);
+                    // 由页面上的after image和delta还原before image
+                    Tuple new_tuple, old_tuple;
+                    tablePage->GetTuple(tupleRid, new_tuple, nullptr, nullptr);
+                    if (currentLogRecord.ApplyUpdateDelta(new_tuple, old_tuple, true))
+                        tablePage->UpdateTuple(old_tuple, new_tuple, tupleRid,
+                                               nullptr, nullptr, nullptr);
                 } else if (currentLogRecord.log_record_type_ == LogRecordType::MARKDELETE) {
                     tablePage->RollbackDelete( tupleRid, nullptr, nullptr );
                 } else if (currentLogRecord.log_record_type_ == LogRecordType::APPLYDELETE) {
@@ -177,7 +506,7 @@ namespace cmudb {
             }
         }
         active_txn_.clear();
-        lsn_mapping_.clear();
+        dirty_page_table_.clear();
     }
 
 } // namespace cmudb
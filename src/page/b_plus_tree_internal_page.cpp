@@ -25,6 +25,8 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::Init(page_id_t page_id,
     SetPageId(page_id);
     SetMaxSize( ( (PAGE_SIZE - sizeof(B_PLUS_TREE_INTERNAL_PAGE_TYPE) )
                           / sizeof(MappingType) ) - 2 );
+    assert(reinterpret_cast<char *>(array) - reinterpret_cast<char *>(this) ==
+           B_PLUS_TREE_PAGE_HEADER_SIZE);
 }
 /*
  * Helper method to get/set the key associated with input "index"(a.k.a
@@ -29,6 +29,8 @@ void B_PLUS_TREE_LEAF_PAGE_TYPE::Init(page_id_t page_id, page_id_t parent_id) {
     SetNextPageId(INVALID_PAGE_ID);
     SetMaxSize(((PAGE_SIZE - sizeof(B_PLUS_TREE_LEAF_PAGE_TYPE) )
                                 / sizeof(MappingType)) - 2 );
+    assert(reinterpret_cast<char *>(array) - reinterpret_cast<char *>(this) ==
+           B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE);
 }
 
 /**
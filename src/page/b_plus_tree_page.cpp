@@ -1,6 +1,8 @@
 /**
  * b_plus_tree_page.cpp
  */
+#include <cstring>
+
 #include "page/b_plus_tree_page.h"
 
 namespace cmudb {
@@ -69,4 +71,29 @@ bool BPlusTreePage::IsSafe(OpType opType) {
     } else
         return true;
 }
+
+/*
+ * Helper methods to access entries as raw bytes
+ */
+char *BPlusTreePage::GetEntryData(int index, int entry_size) {
+    int header_size = IsLeafPage() ? B_PLUS_TREE_LEAF_PAGE_HEADER_SIZE
+                                   : B_PLUS_TREE_PAGE_HEADER_SIZE;
+    return reinterpret_cast<char *>(this) + header_size + index * entry_size;
+}
+
+void BPlusTreePage::InsertEntryData(int index, const char *data, int count,
+                                    int entry_size) {
+    char *position = GetEntryData(index, entry_size);
+    memmove(position + count * entry_size, position,
+            (GetSize() - index) * entry_size);
+    memcpy(position, data, count * entry_size);
+    IncreaseSize(count);
+}
+
+void BPlusTreePage::RemoveEntryData(int index, int count, int entry_size) {
+    char *position = GetEntryData(index, entry_size);
+    memmove(position, position + count * entry_size,
+            (GetSize() - index - count) * entry_size);
+    IncreaseSize(-count);
+}
 } // namespace cmudb
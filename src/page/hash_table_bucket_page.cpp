@@ -0,0 +1,152 @@
+/**
+ * hash_table_bucket_page.cpp
+ */
+
+#include <cassert>
+
+#include "common/rid.h"
+#include "page/hash_table_bucket_page.h"
+
+namespace cmudb {
+
+/*****************************************************************************
+ * HELPER METHODS AND UTILITIES
+ *****************************************************************************/
+
+/**
+ * Init method after creating a new bucket page
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_TABLE_BUCKET_PAGE_TYPE::Init(page_id_t page_id) {
+  page_id_ = page_id;
+  lsn_ = INVALID_LSN;
+  size_ = 0;
+  next_page_id_ = INVALID_PAGE_ID;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t HASH_TABLE_BUCKET_PAGE_TYPE::GetPageId() const { return page_id_; }
+
+/**
+ * Helper methods to set/get the overflow page id
+ */
+INDEX_TEMPLATE_ARGUMENTS
+page_id_t HASH_TABLE_BUCKET_PAGE_TYPE::GetNextPageId() const {
+  return next_page_id_;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_TABLE_BUCKET_PAGE_TYPE::SetNextPageId(page_id_t next_page_id) {
+  next_page_id_ = next_page_id;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_TABLE_BUCKET_PAGE_TYPE::GetSize() const { return size_; }
+
+/*
+ * capacity of the page, derived from the page size and the size of one
+ * key/value pair
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_TABLE_BUCKET_PAGE_TYPE::GetMaxSize() const {
+  return (PAGE_SIZE - sizeof(HASH_TABLE_BUCKET_PAGE_TYPE)) / sizeof(MappingType);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool HASH_TABLE_BUCKET_PAGE_TYPE::IsFull() const {
+  return size_ >= GetMaxSize();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool HASH_TABLE_BUCKET_PAGE_TYPE::IsEmpty() const { return size_ == 0; }
+
+INDEX_TEMPLATE_ARGUMENTS
+KeyType HASH_TABLE_BUCKET_PAGE_TYPE::KeyAt(int index) const {
+  assert(index >= 0 && index < size_);
+  return array[index].first;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+ValueType HASH_TABLE_BUCKET_PAGE_TYPE::ValueAt(int index) const {
+  assert(index >= 0 && index < size_);
+  return array[index].second;
+}
+
+/*
+ * linear scan of the packed records, return -1 if key does not exist
+ */
+INDEX_TEMPLATE_ARGUMENTS
+int HASH_TABLE_BUCKET_PAGE_TYPE::KeyIndex(
+    const KeyType &key, const KeyComparator &comparator) const {
+  for (int i = 0; i < size_; i++) {
+    if (comparator(key, array[i].first) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/*****************************************************************************
+ * LOOKUP
+ *****************************************************************************/
+/*
+ * For the given key, check to see whether it exists in the bucket. If it
+ * does, then store its corresponding value in input "value" and return true.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool HASH_TABLE_BUCKET_PAGE_TYPE::Lookup(const KeyType &key, ValueType &value,
+                                         const KeyComparator &comparator) const {
+  int index = KeyIndex(key, comparator);
+  if (index < 0)
+    return false;
+  value = array[index].second;
+  return true;
+}
+
+/*****************************************************************************
+ * INSERTION
+ *****************************************************************************/
+/*
+ * Append key & value pair at the end of the packed records
+ * caller must make sure the page is not full and the key does not exist
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_TABLE_BUCKET_PAGE_TYPE::Insert(const KeyType &key,
+                                         const ValueType &value) {
+  assert(!IsFull());
+  array[size_] = MappingType(key, value);
+  size_++;
+}
+
+/*****************************************************************************
+ * REMOVE
+ *****************************************************************************/
+/*
+ * First look through the bucket to see whether the key exists or not. If
+ * exist, perform deletion, otherwise return false
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool HASH_TABLE_BUCKET_PAGE_TYPE::Remove(const KeyType &key,
+                                         const KeyComparator &comparator) {
+  int index = KeyIndex(key, comparator);
+  if (index < 0)
+    return false;
+  RemoveAt(index);
+  return true;
+}
+
+/*
+ * 用最后一条记录填补被删除的位置，保持记录紧凑
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void HASH_TABLE_BUCKET_PAGE_TYPE::RemoveAt(int index) {
+  assert(index >= 0 && index < size_);
+  array[index] = array[size_ - 1];
+  size_--;
+}
+
+template class HashTableBucketPage<GenericKey<4>, RID, GenericComparator<4>>;
+template class HashTableBucketPage<GenericKey<8>, RID, GenericComparator<8>>;
+template class HashTableBucketPage<GenericKey<16>, RID, GenericComparator<16>>;
+template class HashTableBucketPage<GenericKey<32>, RID, GenericComparator<32>>;
+template class HashTableBucketPage<GenericKey<64>, RID, GenericComparator<64>>;
+} // namespace cmudb
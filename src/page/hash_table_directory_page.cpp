@@ -0,0 +1,105 @@
+/**
+ * hash_table_directory_page.cpp
+ */
+
+#include <cassert>
+
+#include "page/hash_table_directory_page.h"
+
+namespace cmudb {
+
+/**
+ * Init method after creating a new directory page
+ * The directory starts with global depth 0 and a single slot, in slot page
+ * slot_page_id, pointing to one bucket
+ */
+void HashTableDirectoryPage::Init(page_id_t page_id, page_id_t slot_page_id) {
+  page_id_ = page_id;
+  lsn_ = INVALID_LSN;
+  global_depth_ = 0;
+  for (auto &count : bucket_counts_)
+    count = 0;
+  bucket_counts_[0] = 1;
+  for (auto &id : slot_page_ids_)
+    id = INVALID_PAGE_ID;
+  slot_page_ids_[0] = slot_page_id;
+}
+
+page_id_t HashTableDirectoryPage::GetPageId() const { return page_id_; }
+
+/*
+ * Helper methods to get global depth related information
+ * hash & GetGlobalDepthMask() gives the directory slot of the key. The slots
+ * are copied or moved by the hash table before the depth changes
+ */
+uint32_t HashTableDirectoryPage::GetGlobalDepth() const { return global_depth_; }
+
+uint32_t HashTableDirectoryPage::GetGlobalDepthMask() const {
+  return (1U << global_depth_) - 1;
+}
+
+uint32_t HashTableDirectoryPage::Size() const { return 1U << global_depth_; }
+
+bool HashTableDirectoryPage::CanGrow() const {
+  return global_depth_ < DIRECTORY_MAX_DEPTH;
+}
+
+void HashTableDirectoryPage::IncrGlobalDepth() {
+  assert(CanGrow());
+  global_depth_++;
+}
+
+void HashTableDirectoryPage::DecrGlobalDepth() {
+  assert(global_depth_ > 0);
+  global_depth_--;
+}
+
+/*
+ * The directory can be halved when no bucket has local depth == global depth
+ */
+bool HashTableDirectoryPage::CanShrink() const {
+  return global_depth_ > 0 && bucket_counts_[global_depth_] == 0;
+}
+
+void HashTableDirectoryPage::SplitBucket(uint32_t local_depth) {
+  assert(bucket_counts_[local_depth] > 0);
+  bucket_counts_[local_depth]--;
+  bucket_counts_[local_depth + 1] += 2;
+}
+
+void HashTableDirectoryPage::MergeBuckets(uint32_t local_depth) {
+  assert(bucket_counts_[local_depth] >= 2);
+  bucket_counts_[local_depth] -= 2;
+  bucket_counts_[local_depth - 1]++;
+}
+
+/*
+ * Helper methods to locate a directory slot: the first slot page holds the
+ * whole directory up to SLOT_PAGE_DEPTH, beyond that the low bits of the
+ * slot pick the slot page
+ */
+uint32_t HashTableDirectoryPage::NumSlotPages() const {
+  return global_depth_ <= SLOT_PAGE_DEPTH ? 1 : DIRECTORY_ARRAY_SIZE;
+}
+
+uint32_t HashTableDirectoryPage::SlotPageIndex(uint32_t bucket_idx) const {
+  return global_depth_ <= SLOT_PAGE_DEPTH
+             ? 0
+             : bucket_idx & (DIRECTORY_ARRAY_SIZE - 1);
+}
+
+uint32_t HashTableDirectoryPage::SlotOffset(uint32_t bucket_idx) const {
+  return global_depth_ <= SLOT_PAGE_DEPTH ? bucket_idx
+                                          : bucket_idx >> SLOT_PAGE_DEPTH;
+}
+
+page_id_t HashTableDirectoryPage::GetSlotPageId(uint32_t slot_page_idx) const {
+  return slot_page_ids_[slot_page_idx];
+}
+
+void HashTableDirectoryPage::SetSlotPageId(uint32_t slot_page_idx,
+                                           page_id_t slot_page_id) {
+  slot_page_ids_[slot_page_idx] = slot_page_id;
+}
+
+} // namespace cmudb
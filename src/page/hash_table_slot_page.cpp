@@ -0,0 +1,40 @@
+/**
+ * hash_table_slot_page.cpp
+ */
+
+#include "page/hash_table_slot_page.h"
+
+namespace cmudb {
+
+/**
+ * Init method after creating a new slot page
+ * Slots are filled in by the directory before they are read
+ */
+void HashTableSlotPage::Init(page_id_t page_id) {
+  page_id_ = page_id;
+  lsn_ = INVALID_LSN;
+}
+
+page_id_t HashTableSlotPage::GetPageId() const { return page_id_; }
+
+/*
+ * Helper methods to get/set the bucket page id & local depth of one slot
+ */
+page_id_t HashTableSlotPage::GetBucketPageId(uint32_t offset) const {
+  return bucket_page_ids_[offset];
+}
+
+void HashTableSlotPage::SetBucketPageId(uint32_t offset,
+                                        page_id_t bucket_page_id) {
+  bucket_page_ids_[offset] = bucket_page_id;
+}
+
+uint32_t HashTableSlotPage::GetLocalDepth(uint32_t offset) const {
+  return local_depths_[offset];
+}
+
+void HashTableSlotPage::SetLocalDepth(uint32_t offset, uint32_t local_depth) {
+  local_depths_[offset] = static_cast<uint8_t>(local_depth);
+}
+
+} // namespace cmudb
@@ -34,19 +34,19 @@ namespace cmudb {
     }
 
     page_id_t TablePage::GetPrevPageId() {
-        return *reinterpret_cast<page_id_t *>(GetData() + 8);
+        return *reinterpret_cast<page_id_t *>(GetData() + 4);
     }
 
     page_id_t TablePage::GetNextPageId() {
-        return *reinterpret_cast<page_id_t *>(GetData() + 12);
+        return *reinterpret_cast<page_id_t *>(GetData() + 16);
     }
 
     void TablePage::SetPrevPageId(page_id_t prev_page_id) {
-        memcpy(GetData() + 8, &prev_page_id, 4);
+        memcpy(GetData() + 4, &prev_page_id, 4);
     }
 
     void TablePage::SetNextPageId(page_id_t next_page_id) {
-        memcpy(GetData() + 12, &next_page_id, 4);
+        memcpy(GetData() + 16, &next_page_id, 4);
     }
 
 /**
@@ -92,7 +92,8 @@ namespace cmudb {
         // write the log after set rid
         if (ENABLE_LOGGING) {
             // acquire the exclusive lock
-            assert(lock_manager->LockExclusive(txn, rid.Get()));
+            if (lock_manager != nullptr)
+                assert(lock_manager->LockExclusive(txn, rid.Get()));
             // TODO: add your logging logic here
             //insert log record
 
@@ -133,7 +134,9 @@ namespace cmudb {
         if (ENABLE_LOGGING) {
             // acquire exclusive lock
             // if has shared lock
-            if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
+            if (lock_manager == nullptr) {
+                // covered by the table or page lock
+            } else if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
                 if (!lock_manager->LockUpgrade(txn, rid))
                     return false;
             } else if (txn->GetExclusiveLockSet()->find(rid) ==
@@ -196,7 +199,9 @@ namespace cmudb {
         if (ENABLE_LOGGING) {
             // acquire exclusive lock
             // if has shared lock
-            if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
+            if (lock_manager == nullptr) {
+                // covered by the table or page lock
+            } else if (txn->GetSharedLockSet()->find(rid) != txn->GetSharedLockSet()->end()) {
                 if (!lock_manager->LockUpgrade(txn, rid))
                     return false;
             } else if (txn->GetExclusiveLockSet()->find(rid) ==
@@ -237,7 +242,8 @@ namespace cmudb {
 /*
  * ApplyDelete function truly delete a tuple from table page, and make the slot
  * available for use again.
- * This function is called when a transaction commits or when you undo insert
+ * This function is called when a transaction commits or when you undo insert,
+ * or with no txn when the version manager frees a committed delete
  */
     void TablePage::ApplyDelete(const RID &rid, Transaction *txn,
                                 LogManager *log_manager) {
@@ -259,15 +265,17 @@ namespace cmudb {
         delete_tuple.allocated_ = true;
 
         if (ENABLE_LOGGING) {
-            // must already grab the exclusive lock
-            assert(txn->GetExclusiveLockSet()->find(rid) !=
-                   txn->GetExclusiveLockSet()->end());
+            // must already grab the exclusive lock, of the tuple or of its
+            // table or page (checked by TableHeap)
             // TODO: add your logging logic here
             //Apply delete的log record写入log buffer中
-            LogRecord logRecord( txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::APPLYDELETE,
-                                 rid, delete_tuple );
+            // without txn the record has no transaction to undo it
+            LogRecord logRecord( txn == nullptr ? INVALID_TXN_ID : txn->GetTransactionId(),
+                                 txn == nullptr ? INVALID_LSN : txn->GetPrevLSN(),
+                                 LogRecordType::APPLYDELETE, rid, delete_tuple );
             lsn_t lsn = log_manager->AppendLogRecord( logRecord );
-            txn->SetPrevLSN(lsn);
+            if (txn != nullptr)
+                txn->SetPrevLSN(lsn);
             SetLSN( lsn );
 
         }
@@ -299,8 +307,7 @@ namespace cmudb {
         if (ENABLE_LOGGING) {
             // must have already grab the exclusive lock
             // 执行aborting a txn时，该txn持有的写锁并未释放
-            assert(txn->GetExclusiveLockSet()->find(rid) !=
-                   txn->GetExclusiveLockSet()->end());
+            // the lock may be the exclusive lock of its table or page
             //make sure your log records are permanently stored on disk file before release the locks
             // TODO: add your logging logic here
             /*
@@ -343,8 +350,9 @@ namespace cmudb {
         }
 
         if (ENABLE_LOGGING) {
-            // acquire shared lock
-            if (txn->GetExclusiveLockSet()->find(rid) ==
+            // acquire shared lock, unless covered by the table or page lock
+            if (lock_manager != nullptr &&
+                txn->GetExclusiveLockSet()->find(rid) ==
                 txn->GetExclusiveLockSet()->end() &&
                 txn->GetSharedLockSet()->find(rid) == txn->GetSharedLockSet()->end() &&
                 !lock_manager->LockShared(txn, rid)) {
@@ -363,12 +371,26 @@ namespace cmudb {
         return true;
     }
 
+    bool TablePage::ReadTuple(const RID &rid, Tuple &tuple) {
+        int slot_num = rid.GetSlotNum();
+        if (slot_num >= GetTupleCount() || GetTupleSize(slot_num) <= 0)
+            return false;
+        tuple.size_ = GetTupleSize(slot_num);
+        if (tuple.allocated_)
+            delete[] tuple.data_;
+        tuple.data_ = new char[tuple.size_];
+        memcpy(tuple.data_, GetData() + GetTupleOffset(slot_num), tuple.size_);
+        tuple.rid_ = rid;
+        tuple.allocated_ = true;
+        return true;
+    }
+
 /**
  * Tuple iterator
  */
-    bool TablePage::GetFirstTupleRid(RID &first_rid) {
+    bool TablePage::GetFirstTupleRid(RID &first_rid, bool all_slots) {
         for (int i = 0; i < GetTupleCount(); ++i) {
-            if (GetTupleSize(i) > 0) { // valid tuple
+            if (all_slots || GetTupleSize(i) > 0) { // valid tuple
                 first_rid.Set(GetPageId(), i);
                 return true;
             }
@@ -378,10 +400,11 @@ namespace cmudb {
         return false;
     }
 
-    bool TablePage::GetNextTupleRid(const RID &cur_rid, RID &next_rid) {
+    bool TablePage::GetNextTupleRid(const RID &cur_rid, RID &next_rid,
+                                    bool all_slots) {
         assert(cur_rid.GetPageId() == GetPageId());
         for (auto i = cur_rid.GetSlotNum() + 1; i < GetTupleCount(); ++i) {
-            if (GetTupleSize(i) > 0) { // valid tuple
+            if (all_slots || GetTupleSize(i) > 0) { // valid tuple
                 next_rid.Set(GetPageId(), i);
                 return true;
             }
@@ -395,45 +418,45 @@ namespace cmudb {
 
 // tuple slots
     int32_t TablePage::GetTupleOffset(int slot_num) {
-        return *reinterpret_cast<int32_t *>(GetData() + 24 + 8 * slot_num);
+        return *reinterpret_cast<int32_t *>(GetData() + 28 + 8 * slot_num);
     }
 
     int32_t TablePage::GetTupleSize(int slot_num) {
-        return *reinterpret_cast<int32_t *>(GetData() + 28 + 8 * slot_num);
+        return *reinterpret_cast<int32_t *>(GetData() + 32 + 8 * slot_num);
     }
 
     void TablePage::SetTupleOffset(int slot_num, int32_t offset) {
-        memcpy(GetData() + 24 + 8 * slot_num, &offset, 4);
+        memcpy(GetData() + 28 + 8 * slot_num, &offset, 4);
     }
 
     void TablePage::SetTupleSize(int slot_num, int32_t offset) {
-        memcpy(GetData() + 28 + 8 * slot_num, &offset, 4);
+        memcpy(GetData() + 32 + 8 * slot_num, &offset, 4);
     }
 
 // free space
     int32_t TablePage::GetFreeSpacePointer() {
-        return *reinterpret_cast<int32_t *>(GetData() + 16);
+        return *reinterpret_cast<int32_t *>(GetData() + 20);
     }
 
     void TablePage::SetFreeSpacePointer(int32_t free_space_pointer) {
-        memcpy(GetData() + 16, &free_space_pointer, 4);
+        memcpy(GetData() + 20, &free_space_pointer, 4);
     }
 
 // tuple count
     int32_t TablePage::GetTupleCount() {
-        return *reinterpret_cast<int32_t *>(GetData() + 20);
+        return *reinterpret_cast<int32_t *>(GetData() + 24);
     }
 
     void TablePage::SetTupleCount(int32_t tuple_count) {
-        memcpy(GetData() + 20, &tuple_count, 4);
+        memcpy(GetData() + 24, &tuple_count, 4);
     }
 
 // for free space calculation
     int32_t TablePage::GetFreeSpaceSize() {
         /*
          * tuple size + tuple offset共8字节
-         * 24 表示头部前6项，每项4字节
+         * 28 表示头部：LSN 8字节，其余5项每项4字节
          */
-        return GetFreeSpacePointer() - 24 - GetTupleCount() * 8;
+        return GetFreeSpacePointer() - 28 - GetTupleCount() * 8;
     }
 } // namespace cmudb
@@ -12,16 +12,17 @@ namespace cmudb {
 // open table
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
                      LockManager *lock_manager, LogManager *log_manager,
-                     page_id_t first_page_id)
+                     page_id_t first_page_id, VersionManager *version_manager)
     : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager),
-      log_manager_(log_manager), first_page_id_(first_page_id) {}
+      log_manager_(log_manager), version_manager_(version_manager),
+      first_page_id_(first_page_id) {}
 
 // create table
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
                      LockManager *lock_manager, LogManager *log_manager,
-                     Transaction *txn)
+                     Transaction *txn, VersionManager *version_manager)
     : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager),
-      log_manager_(log_manager) {
+      log_manager_(log_manager), version_manager_(version_manager) {
   auto first_page =
       static_cast<TablePage *>(buffer_pool_manager_->NewPage(first_page_id_));
   assert(first_page != nullptr); // todo: abort table creation?
@@ -34,11 +35,19 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager,
 }
 
 bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
-  if (tuple.size_ + 32 > PAGE_SIZE) { // larger than one page size
+  if (tuple.size_ + 36 > PAGE_SIZE || // larger than one page size
+      txn->IsReadOnly()) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
 
+  // the page of the new tuple is not known up front, every page tried gets
+  // IX, taken before its latch so no lock wait holds a latch
+  bool covered = false;
+  if (ENABLE_LOGGING &&
+      !lock_manager_->LockIntention(txn, first_page_id_, first_page_id_,
+                                    LockMode::EXCLUSIVE, covered))
+    return false;
   auto cur_page =
       static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
   if (cur_page == nullptr) {
@@ -48,12 +57,16 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
 
   cur_page->WLatch();
   while (!cur_page->InsertTuple(
-      tuple, rid, txn, lock_manager_,
+      tuple, rid, txn, covered ? nullptr : lock_manager_,
       log_manager_)) { // fail to insert due to not enough space
     auto next_page_id = cur_page->GetNextPageId();
     if (next_page_id != INVALID_PAGE_ID) { // valid next page
       cur_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), false);
+      if (ENABLE_LOGGING &&
+          !lock_manager_->LockIntention(txn, first_page_id_, next_page_id,
+                                        LockMode::EXCLUSIVE, covered))
+        return false;
       cur_page = static_cast<TablePage *>(
           buffer_pool_manager_->FetchPage(next_page_id));
       cur_page->WLatch();
@@ -75,8 +88,19 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
       cur_page->WUnlatch();
       buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
       cur_page = new_page;
+      // nobody else locks a page before it is latched, IX never waits here
+      if (ENABLE_LOGGING &&
+          !lock_manager_->LockIntention(txn, first_page_id_, next_page_id,
+                                        LockMode::EXCLUSIVE, covered)) {
+        cur_page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
+        return false;
+      }
     }
   }
+  // invisible to other snapshots until the transaction commits
+  if (version_manager_ != nullptr)
+    version_manager_->InsertVersion(rid, txn);
   cur_page->WUnlatch();
   buffer_pool_manager_->UnpinPage(cur_page->GetPageId(), true);
   txn->GetWriteSet()->emplace_back(rid, WType::INSERT, Tuple{}, this);
@@ -84,6 +108,17 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID &rid, Transaction *txn) {
 }
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  bool covered = false;
+  if (ENABLE_LOGGING &&
+      !lock_manager_->LockIntention(txn, first_page_id_, rid.GetPageId(),
+                                    LockMode::EXCLUSIVE, covered))
+    return false;
+  if (ReadsSnapshot(txn) && !LockForWrite(rid, txn, covered))
+    return false;
   // todo: remove empty page
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
@@ -92,15 +127,40 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
     return false;
   }
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
+  // older snapshots read the deleted image from the version chain
+  Tuple old_tuple;
+  bool is_deleted =
+      version_manager_ == nullptr || page->ReadTuple(rid, old_tuple);
+  if (is_deleted)
+    is_deleted = page->MarkDelete(rid, txn, covered ? nullptr : lock_manager_,
+                                  log_manager_);
+  else
+    txn->SetState(TransactionState::ABORTED);
+  if (is_deleted && version_manager_ != nullptr)
+    version_manager_->DeleteVersion(rid, old_tuple, txn);
   page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
-  txn->GetWriteSet()->emplace_back(rid, WType::DELETE, Tuple{}, this);
-  return true;
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), is_deleted);
+  if (is_deleted)
+    txn->GetWriteSet()->emplace_back(rid, WType::DELETE, Tuple{}, this);
+  return is_deleted;
 }
 
 bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid,
                             Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  // the rollback of an aborted transaction runs under the locks it holds,
+  // LockIntention would refuse it
+  bool rollback = txn->GetState() == TransactionState::ABORTED;
+  bool covered = rollback;
+  if (ENABLE_LOGGING && !rollback &&
+      !lock_manager_->LockIntention(txn, first_page_id_, rid.GetPageId(),
+                                    LockMode::EXCLUSIVE, covered))
+    return false;
+  if (!rollback && ReadsSnapshot(txn) && !LockForWrite(rid, txn, covered))
+    return false;
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
@@ -109,8 +169,15 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid,
   }
   Tuple old_tuple;
   page->WLatch();
-  bool is_updated = page->UpdateTuple(tuple, old_tuple, rid, txn, lock_manager_,
-                                      log_manager_);
+  bool is_updated =
+      page->UpdateTuple(tuple, old_tuple, rid, txn,
+                        covered ? nullptr : lock_manager_, log_manager_);
+  if (is_updated && version_manager_ != nullptr) {
+    if (rollback)
+      version_manager_->RollbackVersion(rid, txn);
+    else
+      version_manager_->UpdateVersion(rid, old_tuple, txn);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), is_updated);
   if (is_updated && txn->GetState() != TransactionState::ABORTED)
@@ -119,12 +186,22 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid,
 }
 
 void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
+  // a committed delete stays on the page and keeps its lock until its version
+  // is stamped, the version manager frees the slot once no snapshot sees it
+  if (version_manager_ != nullptr &&
+      txn->GetState() == TransactionState::COMMITTED)
+    return;
   auto page = reinterpret_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   assert(page != nullptr);
   page->WLatch();
   page->ApplyDelete(rid, txn, log_manager_);
-  lock_manager_->Unlock(txn, rid);
+  // rollback of an insert
+  if (version_manager_ != nullptr)
+    version_manager_->RollbackVersion(rid, txn);
+  // no tuple lock if the table or page lock covered it
+  if (txn->GetExclusiveLockSet()->count(rid) != 0)
+    lock_manager_->Unlock(txn, rid);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
@@ -135,12 +212,36 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   assert(page != nullptr);
   page->WLatch();
   page->RollbackDelete(rid, txn, log_manager_);
+  if (version_manager_ != nullptr)
+    version_manager_->RollbackVersion(rid, txn);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
 }
 
 // called by tuple iterator
 bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
+  if (ReadsSnapshot(txn)) {
+    // no lock, the version visible to the snapshot is on the page or in the
+    // version chain
+    auto page = static_cast<TablePage *>(
+        buffer_pool_manager_->FetchPage(rid.GetPageId()));
+    if (page == nullptr)
+      return false;
+    page->RLatch();
+    bool on_page = false;
+    bool res = version_manager_->GetVisibleVersion(rid, txn, tuple, on_page) &&
+               (!on_page || page->ReadTuple(rid, tuple));
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
+    tuple.rid_ = rid;
+    return res;
+  }
+  // a scan holding the table S lock costs one lock set lookup per tuple
+  bool covered = false;
+  if (ENABLE_LOGGING &&
+      !lock_manager_->LockIntention(txn, first_page_id_, rid.GetPageId(),
+                                    LockMode::SHARED, covered))
+    return false;
   auto page = static_cast<TablePage *>(
       buffer_pool_manager_->FetchPage(rid.GetPageId()));
   if (page == nullptr) {
@@ -148,7 +249,8 @@ bool TableHeap::GetTuple(const RID &rid, Tuple &tuple, Transaction *txn) {
     return false;
   }
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res =
+      page->GetTuple(rid, tuple, txn, covered ? nullptr : lock_manager_);
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
   return res;
@@ -159,19 +261,44 @@ bool TableHeap::DeleteTableHeap() {
   return true;
 }
 
+/*
+ * a scan locks the whole table in S instead of every tuple it reads, with
+ * logging enabled. Writers of the table wait for it through their IX.
+ * A snapshot scan takes no lock and also visits deleted tuples
+ */
 TableIterator TableHeap::begin(Transaction *txn) {
+  bool snapshot = ReadsSnapshot(txn);
+  if (ENABLE_LOGGING && !snapshot &&
+      !lock_manager_->LockTable(txn, first_page_id_, LockMode::SHARED))
+    return end();
   auto page =
       static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
   page->RLatch();
   RID rid;
   // if failed (no tuple), rid will be the result of default
   // constructor, which means eof
-  page->GetFirstTupleRid(rid);
+  page->GetFirstTupleRid(rid, snapshot);
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(first_page_id_, false);
   return TableIterator(this, rid, txn);
 }
 
+/*
+ * first updater wins: a tuple committed after the snapshot was written by a
+ * transaction the snapshot does not see, overwriting it would lose that update
+ */
+bool TableHeap::LockForWrite(const RID &rid, Transaction *txn, bool covered) {
+  if (ENABLE_LOGGING && !covered &&
+      txn->GetExclusiveLockSet()->count(rid) == 0 &&
+      !lock_manager_->LockExclusive(txn, rid))
+    return false;
+  if (!version_manager_->CheckWrite(rid, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
 TableIterator TableHeap::end() {
   return TableIterator(this, RID(INVALID_PAGE_ID, -1), nullptr);
 }
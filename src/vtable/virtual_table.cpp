@@ -158,9 +158,9 @@ int VtabDisconnect(sqlite3_vtab *pVtab) {
 
 int VtabOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
   // LOG_DEBUG("VtabOpen");
-  // if read operation, begin transaction here
+  // if read operation, begin a read-only transaction here
   if (global_transaction_ == nullptr) {
-    VtabBegin(pVtab);
+    global_transaction_ = storage_engine_->transaction_manager_->Begin(true);
   }
   VirtualTable *virtual_table = reinterpret_cast<VirtualTable *>(pVtab);
   Cursor *cursor = new Cursor(virtual_table);
@@ -450,6 +450,20 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
   assert(n != std::string::npos);
   index_name = sql.substr(0, n);
   sql = sql.substr(n + 1);
+  // optional index type, e.g. "idx using hash a, b"
+  IndexType index_type = IndexType::BPlusTreeIndex;
+  StringUtility::Trim(sql);
+  if (sql.compare(0, 6, "using ") == 0) {
+    sql = sql.substr(6);
+    StringUtility::Trim(sql);
+    n = sql.find_first_of(' ');
+    std::string type_name = sql.substr(0, n);
+    if (type_name == "hash")
+      index_type = IndexType::HashTableIndex;
+    else if (type_name != "btree")
+      throw Exception(EXCEPTION_TYPE_INDEX, "unknown index type " + type_name);
+    sql = n == std::string::npos ? "" : sql.substr(n + 1);
+  }
 
   std::vector<std::string> tok = StringUtility::Split(sql, ',');
   // iterate through returned result
@@ -463,7 +477,7 @@ IndexMetadata *ParseIndexStatement(std::string &sql,
     throw Exception(EXCEPTION_TYPE_INDEX, "can't create index, format error");
 
   IndexMetadata *metadata =
-      new IndexMetadata(index_name, table_name, schema, key_attrs);
+      new IndexMetadata(index_name, table_name, schema, key_attrs, index_type);
 
   // LOG_DEBUG("%s", metadata->ToString().c_str());
   return metadata;
@@ -514,6 +528,30 @@ Index *ConstructIndex(IndexMetadata *metadata,
   // for each varchar attribute, we assume the largest size is 16 bytes
   key_size += 16 * key_schema->GetUnlinedColumnCount();
 
+  if (metadata->GetIndexType() == IndexType::HashTableIndex) {
+    if (key_size <= 4) {
+      return new ExtendibleHashTableIndex<GenericKey<4>, RID,
+                                          GenericComparator<4>>(
+          metadata, buffer_pool_manager, root_id);
+    } else if (key_size <= 8) {
+      return new ExtendibleHashTableIndex<GenericKey<8>, RID,
+                                          GenericComparator<8>>(
+          metadata, buffer_pool_manager, root_id);
+    } else if (key_size <= 16) {
+      return new ExtendibleHashTableIndex<GenericKey<16>, RID,
+                                          GenericComparator<16>>(
+          metadata, buffer_pool_manager, root_id);
+    } else if (key_size <= 32) {
+      return new ExtendibleHashTableIndex<GenericKey<32>, RID,
+                                          GenericComparator<32>>(
+          metadata, buffer_pool_manager, root_id);
+    } else {
+      return new ExtendibleHashTableIndex<GenericKey<64>, RID,
+                                          GenericComparator<64>>(
+          metadata, buffer_pool_manager, root_id);
+    }
+  }
+
   if (key_size <= 4) {
     return new BPlusTreeIndex<GenericKey<4>, RID, GenericComparator<4>>(
         metadata, buffer_pool_manager, root_id);
@@ -3,6 +3,7 @@
  */
 
 #include <cstdio>
+#include <cstring>
 
 #include "buffer/buffer_pool_manager.h"
 #include "gtest/gtest.h"
@@ -94,4 +95,23 @@ namespace cmudb {
 
         remove("test.db");
     }
+
+    // a page read past the end of the file must not break later I/O
+    TEST(BufferPoolManagerTest, ShortReadTest) {
+        DiskManager *disk_manager = new DiskManager("test.db");
+        char data[PAGE_SIZE], buffer[PAGE_SIZE];
+        memset(data, 'x', PAGE_SIZE);
+
+        // the db file is still empty
+        disk_manager->ReadPage(0, buffer);
+        EXPECT_EQ(0, buffer[0]);
+        disk_manager->WritePage(0, data);
+        disk_manager->WritePage(1, data);
+        disk_manager->ReadPage(1, buffer);
+        EXPECT_EQ(0, memcmp(data, buffer, PAGE_SIZE));
+
+        delete disk_manager;
+        remove("test.db");
+        remove("test.log");
+    }
 } // namespace cmudb
@@ -70,4 +70,25 @@ namespace cmudb {
             value = -1;
         }
     }
+
+    // a value inserted again is moved to the front, and erased from there
+    TEST(LRUReplacerTest, ReinsertTest) {
+        LRUReplacer<int> lru_replacer;
+        lru_replacer.Insert(1);
+        lru_replacer.Insert(2);
+        lru_replacer.Insert(1);
+        lru_replacer.Insert(1);
+        EXPECT_EQ(2, lru_replacer.Size());
+        EXPECT_EQ(true, lru_replacer.Erase(1));
+        EXPECT_EQ(1, lru_replacer.Size());
+
+        lru_replacer.Insert(3);
+        lru_replacer.Insert(2);
+        int value;
+        lru_replacer.Victim(value);
+        EXPECT_EQ(3, value);
+        lru_replacer.Victim(value);
+        EXPECT_EQ(2, value);
+        EXPECT_EQ(false, lru_replacer.Victim(value));
+    }
 } // namespace cmudb
@@ -2,7 +2,14 @@
  * lock_manager_test.cpp
  */
 
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
 #include <thread>
+#include <vector>
 
 #include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
@@ -537,4 +544,517 @@ namespace cmudb {
         thread1.join();
         thread2.join();
     }
+
+    // transactions on disjoint rows spread over the lock table partitions,
+    // every request queue is dropped once its last lock is released
+    TEST(LockManagerTest, DisjointRowsTest) {
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const int num_threads = 8;
+        const int rows_per_txn = 16;
+        const int txns_per_thread = 200;
+
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.emplace_back([&, tid] {
+                for (int i = 0; i < txns_per_thread; i++) {
+                    Transaction *txn = txn_mgr.Begin();
+                    for (int slot = 0; slot < rows_per_txn; slot++) {
+                        RID rid{tid, i * rows_per_txn + slot};
+                        bool res = slot % 2 == 0 ? lock_mgr.LockShared(txn, rid)
+                                                 : lock_mgr.LockExclusive(txn, rid);
+                        EXPECT_TRUE(res);
+                    }
+                    EXPECT_EQ(static_cast<size_t>(rows_per_txn / 2), txn->GetSharedLockSet()->size());
+                    EXPECT_EQ(static_cast<size_t>(rows_per_txn / 2), txn->GetExclusiveLockSet()->size());
+                    txn_mgr.Commit(txn);
+                    EXPECT_TRUE(txn->GetSharedLockSet()->empty());
+                    EXPECT_TRUE(txn->GetExclusiveLockSet()->empty());
+                    delete txn;
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // wait-die: a younger requester dies, an older one waits
+    TEST(LockManagerTest, WaitDieTest) {
+        LockManager lock_mgr{false, DeadlockPolicy::WAIT_DIE};
+        TransactionManager txn_mgr{&lock_mgr};
+        RID rid0{0, 0}, rid1{0, 1};
+        Transaction txn0(0), txn1(1);
+
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid0));
+        EXPECT_TRUE(lock_mgr.LockShared(&txn1, rid1));
+        EXPECT_FALSE(lock_mgr.LockShared(&txn1, rid0));
+        EXPECT_EQ(TransactionState::ABORTED, txn1.GetState());
+        EXPECT_EQ(1U, lock_mgr.GetAbortMetrics().num_died);
+
+        std::thread t([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            txn_mgr.Abort(&txn1);
+        });
+        // older txn0 waits for txn1 to release rid1
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid1));
+        t.join();
+        txn_mgr.Commit(&txn0);
+        EXPECT_EQ(1U, lock_mgr.GetAbortMetrics().num_died);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // wound-wait: an older requester aborts the younger holder, which fails
+    // its next lock request, and waits for it to release the lock
+    TEST(LockManagerTest, WoundWaitTest) {
+        LockManager lock_mgr{false, DeadlockPolicy::WOUND_WAIT};
+        TransactionManager txn_mgr{&lock_mgr};
+        RID rid0{0, 0}, rid1{0, 1};
+        Transaction txn0(0), txn1(1);
+
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn1, rid0));
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid1));
+        std::promise<void> wounded;
+        std::thread t([&] {
+            wounded.get_future().wait();
+            // a younger requester waits for the older holder, but is wounded
+            EXPECT_FALSE(lock_mgr.LockShared(&txn1, rid1));
+            EXPECT_EQ(TransactionState::ABORTED, txn1.GetState());
+            txn_mgr.Abort(&txn1);
+        });
+        std::thread older([&] {
+            EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid0));
+        });
+        while (lock_mgr.GetAbortMetrics().num_wounded == 0)
+            std::this_thread::yield();
+        wounded.set_value();
+        older.join();
+        t.join();
+        txn_mgr.Commit(&txn0);
+        EXPECT_EQ(1U, lock_mgr.GetAbortMetrics().num_wounded);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // two transactions lock two rows in opposite order, the detector aborts
+    // the younger one and the older one gets both rows
+    TEST(LockManagerTest, DeadlockDetectionTest) {
+        LockManager lock_mgr{false, DeadlockPolicy::DETECTION};
+        TransactionManager txn_mgr{&lock_mgr};
+        RID rid0{0, 0}, rid1{0, 1};
+        Transaction txn0(0), txn1(1);
+
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid0));
+        EXPECT_TRUE(lock_mgr.LockShared(&txn1, rid1));
+        std::thread t([&] {
+            EXPECT_FALSE(lock_mgr.LockExclusive(&txn1, rid0));
+            EXPECT_EQ(TransactionState::ABORTED, txn1.GetState());
+            txn_mgr.Abort(&txn1);
+        });
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid1));
+        t.join();
+        txn_mgr.Commit(&txn0);
+        LockAbortMetrics metrics = lock_mgr.GetAbortMetrics();
+        EXPECT_EQ(1U, metrics.num_deadlock_victims);
+        EXPECT_EQ(0U, metrics.num_timeouts);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // a waiter gives up after the lock wait timeout, later waiters move on
+    TEST(LockManagerTest, LockWaitTimeoutTest) {
+        LockManager lock_mgr{false, DeadlockPolicy::DETECTION,
+                             std::chrono::milliseconds(50)};
+        TransactionManager txn_mgr{&lock_mgr};
+        RID rid{0, 0};
+        Transaction txn0(0), txn1(1);
+
+        EXPECT_TRUE(lock_mgr.LockShared(&txn0, rid));
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(lock_mgr.LockExclusive(&txn1, rid));
+        EXPECT_GE(std::chrono::steady_clock::now() - start,
+                  std::chrono::milliseconds(50));
+        EXPECT_EQ(TransactionState::ABORTED, txn1.GetState());
+        EXPECT_EQ(1U, lock_mgr.GetAbortMetrics().num_timeouts);
+        txn_mgr.Abort(&txn1);
+
+        // the timed out exclusive request no longer blocks shared requests
+        Transaction txn2(2);
+        EXPECT_TRUE(lock_mgr.LockShared(&txn2, rid));
+        txn_mgr.Commit(&txn2);
+        txn_mgr.Commit(&txn0);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    TEST(LockManagerTest, IntentionLockTest) {
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const page_id_t table_id = 0;
+        Transaction txn0(0), txn1(1), txn2(2);
+
+        // IX and IS are compatible, S has to wait for IX
+        EXPECT_TRUE(lock_mgr.LockTable(&txn0, table_id, LockMode::INTENTION_EXCLUSIVE));
+        EXPECT_TRUE(lock_mgr.LockTable(&txn1, table_id, LockMode::INTENTION_SHARED));
+        auto scan = std::async(std::launch::async, [&] {
+            bool res = lock_mgr.LockTable(&txn2, table_id, LockMode::SHARED);
+            EXPECT_EQ(1U, txn2.GetSharedLockSet()->count(LockManager::TableLockId(table_id)));
+            txn_mgr.Commit(&txn2);
+            return res;
+        });
+        EXPECT_EQ(std::future_status::timeout,
+                  scan.wait_for(std::chrono::milliseconds(50)));
+
+        // a conversion does not queue behind the waiting S
+        EXPECT_TRUE(lock_mgr.LockTable(&txn1, table_id, LockMode::INTENTION_EXCLUSIVE));
+        EXPECT_TRUE(txn1.GetIntentionSharedLockSet()->empty());
+        EXPECT_EQ(1U, txn1.GetIntentionExclusiveLockSet()->size());
+        txn_mgr.Commit(&txn0);
+        EXPECT_EQ(std::future_status::timeout,
+                  scan.wait_for(std::chrono::milliseconds(50)));
+        txn_mgr.Commit(&txn1);
+        EXPECT_TRUE(scan.get());
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    TEST(LockManagerTest, LockIntentionTest) {
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const page_id_t table_id = 0, page_id = 3;
+        RID table = LockManager::TableLockId(table_id);
+        RID page = LockManager::PageLockId(page_id);
+        Transaction txn0(0), txn1(1);
+        bool covered = false;
+
+        // a tuple read locks IS on table and page, a scan covers every tuple
+        EXPECT_TRUE(lock_mgr.LockIntention(&txn0, table_id, page_id, LockMode::SHARED, covered));
+        EXPECT_FALSE(covered);
+        EXPECT_EQ(1U, txn0.GetIntentionSharedLockSet()->count(table));
+        EXPECT_EQ(1U, txn0.GetIntentionSharedLockSet()->count(page));
+        EXPECT_TRUE(lock_mgr.LockTable(&txn0, table_id, LockMode::SHARED));
+        EXPECT_EQ(1U, txn0.GetSharedLockSet()->count(table));
+        EXPECT_TRUE(lock_mgr.LockIntention(&txn0, table_id, page_id + 1, LockMode::SHARED, covered));
+        EXPECT_TRUE(covered);
+        EXPECT_FALSE(LockManager::HoldsLock(&txn0, LockManager::PageLockId(page_id + 1),
+                                            LockMode::INTENTION_SHARED));
+
+        // a write after the scan converts S to SIX and IS to IX
+        EXPECT_TRUE(lock_mgr.LockIntention(&txn0, table_id, page_id, LockMode::EXCLUSIVE, covered));
+        EXPECT_FALSE(covered);
+        EXPECT_EQ(1U, txn0.GetSharedIntentionExclusiveLockSet()->count(table));
+        EXPECT_EQ(1U, txn0.GetIntentionExclusiveLockSet()->count(page));
+        EXPECT_TRUE(txn0.GetSharedLockSet()->empty());
+        EXPECT_TRUE(txn0.GetIntentionSharedLockSet()->empty());
+        EXPECT_TRUE(LockManager::HoldsLock(&txn0, table, LockMode::SHARED));
+
+        // SIX only admits IS
+        EXPECT_TRUE(lock_mgr.LockTable(&txn1, table_id, LockMode::INTENTION_SHARED));
+        auto writer = std::async(std::launch::async, [&] {
+            return lock_mgr.LockIntention(&txn1, table_id, page_id + 1,
+                                          LockMode::EXCLUSIVE, covered);
+        });
+        EXPECT_EQ(std::future_status::timeout,
+                  writer.wait_for(std::chrono::milliseconds(50)));
+        txn_mgr.Commit(&txn0);
+        EXPECT_TRUE(writer.get());
+        EXPECT_EQ(1U, txn1.GetIntentionExclusiveLockSet()->count(table));
+        txn_mgr.Commit(&txn1);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // lock a tuple the way TableHeap does, under intention locks
+    static bool LockTuple(LockManager &lock_mgr, Transaction *txn, page_id_t table_id,
+                          const RID &rid, LockMode mode) {
+        bool covered = false;
+        if (!lock_mgr.LockIntention(txn, table_id, rid.GetPageId(), mode, covered))
+            return false;
+        return covered || lock_mgr.LockTemplate(txn, rid, mode);
+    }
+
+    TEST(LockManagerTest, PageEscalationTest) {
+        size_t page_threshold = LOCK_ESCALATION_PAGE_THRESHOLD;
+        LOCK_ESCALATION_PAGE_THRESHOLD = 4;
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const page_id_t table_id = 0;
+        Transaction txn0(0), txn1(1);
+
+        // the fifth tuple lock on page 1 locks the page instead
+        for (int slot = 0; slot < 6; slot++)
+            EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{1, slot}, LockMode::SHARED));
+        EXPECT_EQ(1U, lock_mgr.GetNumEscalations());
+        EXPECT_EQ(1U, txn0.GetSharedLockSet()->size());
+        EXPECT_EQ(1U, txn0.GetSharedLockSet()->count(LockManager::PageLockId(1)));
+        // table IS and page S are all that is left in the lock table
+        EXPECT_EQ(2U, lock_mgr.GetLockTableSize());
+
+        // a reader of page 2 keeps txn0 from escalating its writes there
+        EXPECT_TRUE(LockTuple(lock_mgr, &txn1, table_id, RID{2, 0}, LockMode::SHARED));
+        for (int slot = 1; slot < 6; slot++)
+            EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{2, slot}, LockMode::EXCLUSIVE));
+        EXPECT_EQ(1U, lock_mgr.GetNumEscalations());
+        EXPECT_EQ(5U, txn0.GetExclusiveLockSet()->size());
+        EXPECT_EQ(1U, txn0.GetIntentionExclusiveLockSet()->count(LockManager::PageLockId(2)));
+        txn_mgr.Commit(&txn1);
+
+        // retried on the next tuple lock
+        EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{2, 6}, LockMode::EXCLUSIVE));
+        EXPECT_EQ(2U, lock_mgr.GetNumEscalations());
+        EXPECT_EQ(1U, txn0.GetExclusiveLockSet()->size());
+        EXPECT_EQ(1U, txn0.GetExclusiveLockSet()->count(LockManager::PageLockId(2)));
+        txn_mgr.Commit(&txn0);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+        LOCK_ESCALATION_PAGE_THRESHOLD = page_threshold;
+    }
+
+    TEST(LockManagerTest, TableEscalationTest) {
+        size_t table_threshold = LOCK_ESCALATION_TABLE_THRESHOLD;
+        LOCK_ESCALATION_TABLE_THRESHOLD = 8;
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const page_id_t table_id = 0;
+        Transaction txn0(0), txn1(1);
+
+        // page IX and tuple X locks on pages 1 and 2 count towards the table
+        for (int slot = 0; slot < 4; slot++)
+            EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{1, slot}, LockMode::EXCLUSIVE));
+        for (int slot = 0; slot < 2; slot++)
+            EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{2, slot}, LockMode::EXCLUSIVE));
+        EXPECT_EQ(0U, lock_mgr.GetNumEscalations());
+        EXPECT_TRUE(LockTuple(lock_mgr, &txn0, table_id, RID{3, 0}, LockMode::EXCLUSIVE));
+        EXPECT_EQ(1U, lock_mgr.GetNumEscalations());
+        EXPECT_EQ(1U, txn0.GetExclusiveLockSet()->size());
+        EXPECT_TRUE(txn0.GetIntentionExclusiveLockSet()->empty());
+        EXPECT_EQ(1U, lock_mgr.GetLockTableSize());
+
+        // the table X lock conflicts with everybody else
+        auto reader = std::async(std::launch::async, [&] {
+            return LockTuple(lock_mgr, &txn1, table_id, RID{4, 0}, LockMode::SHARED);
+        });
+        EXPECT_EQ(std::future_status::timeout,
+                  reader.wait_for(std::chrono::milliseconds(50)));
+        txn_mgr.Commit(&txn0);
+        EXPECT_TRUE(reader.get());
+        txn_mgr.Commit(&txn1);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+        LOCK_ESCALATION_TABLE_THRESHOLD = table_threshold;
+    }
+
+    // uncontended lock & unlock reuse pooled requests and queues
+    TEST(LockManagerTest, UncontendedLockBenchmarkTest) {
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        const int num_threads = 4;
+        const int rows_per_txn = 8;
+        const int txns_per_thread = 20000;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.emplace_back([&, tid] {
+                Transaction txn(tid);
+                for (int i = 0; i < txns_per_thread; i++) {
+                    txn.SetState(TransactionState::GROWING);
+                    for (int slot = 0; slot < rows_per_txn; slot++)
+                        EXPECT_TRUE(lock_mgr.LockExclusive(&txn, RID{tid, slot}));
+                    for (int slot = 0; slot < rows_per_txn; slot++)
+                        EXPECT_TRUE(lock_mgr.Unlock(&txn, RID{tid, slot}));
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        std::chrono::duration<double, std::nano> elapsed =
+                std::chrono::steady_clock::now() - start;
+        std::cout << "uncontended lock & unlock: "
+                  << elapsed.count() * num_threads /
+                     (num_threads * txns_per_thread * rows_per_txn)
+                  << " ns" << std::endl;
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+
+        // the lock table grows past its initial buckets and shrinks back
+        Transaction txn(0);
+        const int num_rows = 64 * LOCK_TABLE_PARTITIONS * LOCK_TABLE_PARTITION_BUCKETS;
+        for (int slot = 0; slot < num_rows; slot++)
+            EXPECT_TRUE(lock_mgr.LockShared(&txn, RID{slot % 97, slot}));
+        EXPECT_EQ(static_cast<size_t>(num_rows), lock_mgr.GetLockTableSize());
+        txn_mgr.Commit(&txn);
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+    }
+
+    // queue up exclusive waiters behind txn 0, return the order they are granted in
+    static std::vector<txn_id_t> GrantOrder(LockManager &lock_mgr,
+                                            std::vector<Transaction *> waiters) {
+        TransactionManager txn_mgr{&lock_mgr};
+        RID rid{0, 0};
+        Transaction txn0(0);
+        std::mutex mutex;
+        std::vector<txn_id_t> order;
+
+        EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid));
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < waiters.size(); i++) {
+            Transaction *txn = waiters[i];
+            threads.emplace_back([&, txn] {
+                EXPECT_TRUE(lock_mgr.LockExclusive(txn, rid));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    order.push_back(txn->GetTransactionId());
+                }
+                txn_mgr.Commit(txn);
+            });
+            // one waiter at a time so that arrival order is known
+            while (lock_mgr.GetContention(rid).num_waits < i + 1)
+                std::this_thread::yield();
+        }
+        txn_mgr.Commit(&txn0);
+        for (auto &thread : threads)
+            thread.join();
+        return order;
+    }
+
+    TEST(LockManagerTest, GrantPolicyTest) {
+        {
+            LockManager lock_mgr{false};
+            Transaction txn1(1), txn2(2), txn3(3);
+            EXPECT_EQ((std::vector<txn_id_t>{3, 1, 2}),
+                      GrantOrder(lock_mgr, {&txn3, &txn1, &txn2}));
+        }
+        {
+            LockManager lock_mgr{false, DeadlockPolicy::DETECTION,
+                                 LOCK_WAIT_TIMEOUT, GrantPolicy::AGE};
+            Transaction txn1(1), txn2(2), txn3(3);
+            EXPECT_EQ((std::vector<txn_id_t>{1, 2, 3}),
+                      GrantOrder(lock_mgr, {&txn3, &txn1, &txn2}));
+        }
+        {
+            LockManager lock_mgr{false, DeadlockPolicy::DETECTION,
+                                 LOCK_WAIT_TIMEOUT, GrantPolicy::PRIORITY};
+            Transaction txn1(1), txn2(2), txn3(3);
+            txn1.SetPriority(1);
+            txn2.SetPriority(5);
+            txn3.SetPriority(5);
+            // equal priorities keep arrival order
+            EXPECT_EQ((std::vector<txn_id_t>{3, 2, 1}),
+                      GrantOrder(lock_mgr, {&txn1, &txn3, &txn2}));
+        }
+        {
+            LockManager lock_mgr{false, DeadlockPolicy::DETECTION,
+                                 LOCK_WAIT_TIMEOUT, GrantPolicy::LOCKS_HELD};
+            Transaction txn1(1), txn2(2), txn3(3);
+            for (int slot = 1; slot <= 2; slot++)
+                EXPECT_TRUE(lock_mgr.LockShared(&txn2, RID{1, slot}));
+            EXPECT_TRUE(lock_mgr.LockShared(&txn3, RID{1, 3}));
+            EXPECT_EQ((std::vector<txn_id_t>{2, 3, 1}),
+                      GrantOrder(lock_mgr, {&txn1, &txn3, &txn2}));
+            EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+        }
+    }
+
+    TEST(LockManagerTest, LockContentionTest) {
+        LockManager lock_mgr{false};
+        TransactionManager txn_mgr{&lock_mgr};
+        RID hot{0, 0}, cold{0, 1};
+        Transaction txn0(0), txn1(1), txn2(2);
+
+        EXPECT_TRUE(lock_mgr.LockShared(&txn0, hot));
+        EXPECT_TRUE(lock_mgr.LockShared(&txn1, hot));
+        EXPECT_TRUE(lock_mgr.LockShared(&txn0, cold));
+        std::thread t([&] {
+            EXPECT_TRUE(lock_mgr.LockExclusive(&txn2, hot));
+            txn_mgr.Commit(&txn2);
+        });
+        while (lock_mgr.GetContention(hot).num_waits == 0)
+            std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        txn_mgr.Commit(&txn1);
+        txn_mgr.Commit(&txn0);
+        t.join();
+
+        // the statistics outlive the queue
+        EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+        LockContention contention = lock_mgr.GetContention(hot);
+        EXPECT_EQ(3U, contention.num_requests);
+        EXPECT_EQ(1U, contention.num_waits);
+        EXPECT_EQ(3U, contention.max_queue_length);
+        EXPECT_GE(contention.max_wait_us, 10000U);
+        EXPECT_EQ(contention.max_wait_us, contention.total_wait_us);
+        // uncontended rids are not kept
+        EXPECT_EQ(0U, lock_mgr.GetContention(cold).num_requests);
+
+        auto hottest = lock_mgr.GetHottestRids(10);
+        ASSERT_EQ(1U, hottest.size());
+        EXPECT_EQ(hot, hottest[0].first);
+    }
+
+    /*
+     * transactions exclusively lock rows drawn from a zipfian distribution
+     * (theta 0.99) in rid order, so there is no deadlock, and hold them for
+     * a short while. Prints the latency distribution of each grant policy
+     */
+    TEST(LockManagerTest, ZipfianGrantPolicyBenchmarkTest) {
+        const int num_rows = 100;
+        const int num_threads = 8;
+        const int txns_per_thread = 100;
+        const int rows_per_txn = 4;
+        const double theta = 0.99;
+
+        std::vector<double> cdf(num_rows);
+        double sum = 0;
+        for (int i = 0; i < num_rows; i++)
+            cdf[i] = sum += 1.0 / std::pow(i + 1, theta);
+        for (auto &p : cdf)
+            p /= sum;
+
+        const std::pair<GrantPolicy, const char *> policies[] = {
+                {GrantPolicy::FIFO, "FIFO"},
+                {GrantPolicy::AGE, "AGE"},
+                {GrantPolicy::LOCKS_HELD, "LOCKS_HELD"}};
+        for (auto &policy : policies) {
+            LockManager lock_mgr{false, DeadlockPolicy::DETECTION,
+                                 LOCK_WAIT_TIMEOUT, policy.first};
+            TransactionManager txn_mgr{&lock_mgr};
+            std::mutex mutex;
+            std::vector<double> latencies;
+            std::vector<std::thread> threads;
+            for (int tid = 0; tid < num_threads; tid++) {
+                threads.emplace_back([&, tid] {
+                    std::mt19937 rng(tid);
+                    std::uniform_real_distribution<double> uniform(0, 1);
+                    std::vector<double> local;
+                    for (int i = 0; i < txns_per_thread; i++) {
+                        std::vector<int> rows;
+                        for (int j = 0; j < rows_per_txn; j++)
+                            rows.push_back(static_cast<int>(
+                                    std::lower_bound(cdf.begin(), cdf.end() - 1, uniform(rng)) -
+                                    cdf.begin()));
+                        std::sort(rows.begin(), rows.end());
+                        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+                        Transaction txn(tid * txns_per_thread + i);
+                        auto start = std::chrono::steady_clock::now();
+                        for (int row : rows)
+                            EXPECT_TRUE(lock_mgr.LockExclusive(&txn, RID{0, row}));
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                        txn_mgr.Commit(&txn);
+                        std::chrono::duration<double, std::micro> elapsed =
+                                std::chrono::steady_clock::now() - start;
+                        local.push_back(elapsed.count());
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    latencies.insert(latencies.end(), local.begin(), local.end());
+                });
+            }
+            for (auto &thread : threads)
+                thread.join();
+            EXPECT_EQ(0U, lock_mgr.GetLockTableSize());
+
+            std::sort(latencies.begin(), latencies.end());
+            auto hottest = lock_mgr.GetHottestRids(1);
+            ASSERT_EQ(1U, hottest.size());
+            std::cout << policy.second << " txn latency p50 "
+                      << latencies[latencies.size() / 2] << " us, p99 "
+                      << latencies[latencies.size() * 99 / 100] << " us, max "
+                      << latencies.back() << " us, hottest row "
+                      << hottest[0].first.GetSlotNum() << " waited "
+                      << hottest[0].second.total_wait_us << " us" << std::endl;
+        }
+    }
 } // namespace cmudb
\ No newline at end of file
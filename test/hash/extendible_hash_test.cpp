@@ -3,6 +3,7 @@
  */
 
 #include <thread>
+#include <map>
 #include <random>
 #include "hash/extendible_hash.h"
 #include "gtest/gtest.h"
@@ -79,6 +80,39 @@ namespace cmudb {
         delete test;
     }
 
+    TEST(ExtendibleHashTest, MergeShrinkTest) {
+        ExtendibleHash<int, int> *test = new ExtendibleHash<int, int>(4);
+        const int num_keys = 1000;
+        for (int i = 0; i < num_keys; i++) {
+            test->Insert(i, i);
+        }
+        int peak_depth = test->GetGlobalDepth();
+        int peak_buckets = test->GetNumBuckets();
+        EXPECT_LT(0, peak_depth);
+
+        // removing most of the keys merges sparse buddies and halves the directory
+        for (int i = 0; i < num_keys; i++) {
+            if (i % 100 != 0) {
+                EXPECT_EQ(1, test->Remove(i));
+            }
+        }
+        EXPECT_GT(peak_depth, test->GetGlobalDepth());
+        EXPECT_GT(peak_buckets, test->GetNumBuckets());
+        int val;
+        for (int i = 0; i < num_keys; i++) {
+            EXPECT_EQ(i % 100 == 0, test->Find(i, val));
+        }
+
+        // remove the rest, table collapses back to a single bucket
+        for (int i = 0; i < num_keys; i += 100) {
+            EXPECT_EQ(1, test->Remove(i));
+        }
+        EXPECT_EQ(0, test->GetGlobalDepth());
+        EXPECT_EQ(1, test->GetNumBuckets());
+
+        delete test;
+    }
+
     TEST(ExtendibleHashTest, ConcurrentInsertTest) {
         const int num_runs = 50;
         const int num_threads = 3;
@@ -133,4 +167,35 @@ namespace cmudb {
         }
     }
 
+    TEST(ExtendibleHashTest, ConcurrentInsertFindTest) {
+        const int num_threads = 4;
+        const int num_keys = 2000;
+        std::shared_ptr<ExtendibleHash<int, int>> test{new ExtendibleHash<int, int>(4)};
+        std::vector<std::thread> threads;
+        // writers insert disjoint key ranges (forcing splits), readers keep probing
+        for (int tid = 0; tid < num_threads; tid++) {
+            threads.push_back(std::thread([tid, &test]() {
+                for (int i = tid; i < num_keys; i += num_threads) {
+                    test->Insert(i, i);
+                }
+            }));
+            threads.push_back(std::thread([tid, &test]() {
+                int val;
+                for (int i = tid; i < num_keys; i += num_threads) {
+                    if (test->Find(i, val)) {
+                        EXPECT_EQ(i, val);
+                    }
+                }
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (int i = 0; i < num_keys; i++) {
+            int val = -1;
+            EXPECT_TRUE(test->Find(i, val));
+            EXPECT_EQ(i, val);
+        }
+    }
+
 } // namespace cmudb
@@ -0,0 +1,288 @@
+/**
+ * extendible_hash_table_test.cpp
+ */
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "index/extendible_hash_table.h"
+#include "page/header_page.h"
+#include "vtable/virtual_table.h"
+#include "gtest/gtest.h"
+
+namespace cmudb {
+
+TEST(ExtendibleHashTableTest, InsertRemoveTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+  // create and fetch header_page
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  bpm->UnpinPage(page_id, true);
+
+  ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>> table(
+      "foo_pk", bpm, comparator);
+  EXPECT_TRUE(table.IsEmpty());
+
+  GenericKey<8> index_key;
+  RID rid;
+  std::vector<RID> rids;
+  // enough keys to grow the directory beyond its first slot page
+  const int64_t scale = 3000;
+  for (int64_t key = 0; key < scale; key++) {
+    rid.Set((int32_t)(key >> 32), (int32_t)key);
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+  EXPECT_LT(DIRECTORY_ARRAY_SIZE, 1U << table.GetGlobalDepth());
+
+  // duplicate keys are rejected
+  index_key.SetFromInteger(42);
+  EXPECT_FALSE(table.Insert(index_key, rid));
+
+  for (int64_t key = 0; key < scale; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    EXPECT_EQ(1, rids.size());
+    EXPECT_EQ((int32_t)key, rids[0].GetSlotNum());
+  }
+  index_key.SetFromInteger(scale);
+  EXPECT_FALSE(table.GetValue(index_key, rids));
+
+  // reopen through directory page id recorded in header page
+  page_id_t directory_page_id;
+  HeaderPage *header_page =
+      static_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+  EXPECT_TRUE(header_page->GetRootId("foo_pk", directory_page_id));
+  bpm->UnpinPage(HEADER_PAGE_ID, false);
+  EXPECT_EQ(table.GetDirectoryPageId(), directory_page_id);
+  ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>> reopened(
+      "foo_pk", bpm, comparator, directory_page_id);
+  rids.clear();
+  index_key.SetFromInteger(scale - 1);
+  EXPECT_TRUE(reopened.GetValue(index_key, rids));
+
+  // remove everything, buckets merge and the directory shrinks back
+  for (int64_t key = 0; key < scale; key++) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Remove(index_key));
+  }
+  index_key.SetFromInteger(0);
+  EXPECT_FALSE(table.Remove(index_key));
+  EXPECT_EQ(0, table.GetGlobalDepth());
+
+  // table still usable after shrinking
+  for (int64_t key = 0; key < 100; key++) {
+    rid.Set(0, (int32_t)key);
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+  rids.clear();
+  index_key.SetFromInteger(99);
+  EXPECT_TRUE(table.GetValue(index_key, rids));
+
+  delete key_schema;
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// far more keys than DIRECTORY_ARRAY_SIZE full buckets hold: the directory
+// spreads over slot pages instead of chaining overflow pages, so a lookup
+// still reads at most directory page + slot page + bucket page
+TEST(ExtendibleHashTableTest, PageAccessTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(10, disk_manager);
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  bpm->UnpinPage(page_id, true);
+
+  ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>> table(
+      "foo_pk", bpm, comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  std::vector<RID> rids;
+  const int64_t scale = 20000;
+  for (int64_t key = 0; key < scale; key++) {
+    rid.Set(0, (int32_t)key);
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+  EXPECT_LT(DIRECTORY_ARRAY_SIZE, 1U << table.GetGlobalDepth());
+
+  int num_reads = disk_manager->GetNumReads();
+  for (int64_t key = 0; key < scale; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+  }
+  EXPECT_GE(3 * scale, disk_manager->GetNumReads() - num_reads);
+
+  // emptying the table gathers the directory back into one slot page
+  for (int64_t key = 0; key < scale; key++) {
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Remove(index_key));
+  }
+  EXPECT_EQ(0, table.GetGlobalDepth());
+  index_key.SetFromInteger(0);
+  EXPECT_FALSE(table.GetValue(index_key, rids));
+
+  delete key_schema;
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(ExtendibleHashTableTest, ConcurrentInsertTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  bpm->UnpinPage(page_id, true);
+
+  ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>> table(
+      "foo_pk", bpm, comparator);
+
+  const int num_threads = 4;
+  const int64_t per_thread = 500;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([&table, tid, per_thread]() {
+      GenericKey<8> index_key;
+      RID rid;
+      for (int64_t i = 0; i < per_thread; i++) {
+        int64_t key = i * num_threads + tid;
+        rid.Set(0, (int32_t)key);
+        index_key.SetFromInteger(key);
+        EXPECT_TRUE(table.Insert(index_key, rid));
+      }
+    }));
+  }
+  for (auto &t : threads)
+    t.join();
+
+  GenericKey<8> index_key;
+  std::vector<RID> rids;
+  for (int64_t key = 0; key < num_threads * per_thread; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    EXPECT_EQ((int32_t)key, rids[0].GetSlotNum());
+  }
+
+  delete key_schema;
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// running out of frames fails the operation without leaving the table latched
+TEST(ExtendibleHashTableTest, PoolExhaustedTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  const int pool_size = 10;
+  BufferPoolManager *bpm = new BufferPoolManager(pool_size, disk_manager);
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  bpm->UnpinPage(page_id, true);
+
+  ExtendibleHashTable<GenericKey<8>, RID, GenericComparator<8>> table(
+      "foo_pk", bpm, comparator);
+  GenericKey<8> index_key;
+  RID rid;
+  std::vector<RID> rids;
+  // split the first bucket, so the next inserts go through the directory
+  const int64_t scale = 500;
+  for (int64_t key = 0; key < scale; key++) {
+    rid.Set(0, (int32_t)key);
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.Insert(index_key, rid));
+  }
+
+  // pin every frame
+  std::vector<page_id_t> pinned;
+  while (bpm->NewPage(page_id) != nullptr)
+    pinned.push_back(page_id);
+  EXPECT_EQ(pool_size, (int)pinned.size());
+  index_key.SetFromInteger(scale);
+  EXPECT_FALSE(table.Insert(index_key, rid));
+  EXPECT_FALSE(table.GetValue(index_key, rids));
+  index_key.SetFromInteger(0);
+  EXPECT_FALSE(table.Remove(index_key));
+  EXPECT_FALSE(table.GetValue(index_key, rids));
+
+  // pages are unpinned and table_latch_ released, the table works again
+  for (auto pinned_page_id : pinned)
+    bpm->UnpinPage(pinned_page_id, false);
+  index_key.SetFromInteger(scale);
+  EXPECT_TRUE(table.Insert(index_key, rid));
+  for (int64_t key = 0; key <= scale; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    EXPECT_TRUE(table.GetValue(index_key, rids));
+    EXPECT_TRUE(table.Remove(index_key));
+  }
+  // nothing is left pinned by the failed operations
+  pinned.clear();
+  while (bpm->NewPage(page_id) != nullptr)
+    pinned.push_back(page_id);
+  EXPECT_EQ(pool_size, (int)pinned.size());
+  for (auto pinned_page_id : pinned)
+    bpm->UnpinPage(pinned_page_id, false);
+
+  delete key_schema;
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+TEST(ExtendibleHashTableTest, ConstructIndexTest) {
+  Schema *schema = ParseCreateStatement("a bigint, b varchar");
+  std::string sql = "foo_idx using hash a";
+  IndexMetadata *metadata = ParseIndexStatement(sql, "foo", schema);
+  EXPECT_EQ(IndexType::HashTableIndex, metadata->GetIndexType());
+  EXPECT_EQ(1, metadata->GetIndexColumnCount());
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+  page_id_t page_id;
+  bpm->NewPage(page_id);
+  bpm->UnpinPage(page_id, true);
+
+  Index *index = ConstructIndex(metadata, bpm);
+  using HashIndex =
+      ExtendibleHashTableIndex<GenericKey<8>, RID, GenericComparator<8>>;
+  EXPECT_NE(nullptr, dynamic_cast<HashIndex *>(index));
+
+  sql = "bar_idx a";
+  IndexMetadata *default_metadata = ParseIndexStatement(sql, "foo", schema);
+  EXPECT_EQ(IndexType::BPlusTreeIndex, default_metadata->GetIndexType());
+  delete default_metadata;
+
+  delete index;
+  delete schema;
+  delete bpm;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+} // namespace cmudb
@@ -1,14 +1,29 @@
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <future>
+#include <iostream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
+#include "index/b_plus_tree.h"
 #include "logging/common.h"
 #include "logging/log_recovery.h"
+#include "page/header_page.h"
 #include "vtable/virtual_table.h"
 #include "gtest/gtest.h"
 
 namespace cmudb {
 
+// make data a log record header for the log end scan, | size | LSN |
+static void FrameLogRecord(char *data, int32_t size, lsn_t lsn) {
+  memcpy(data, &size, sizeof(int32_t));
+  memcpy(data + sizeof(int32_t), &lsn, sizeof(lsn_t));
+}
+
 TEST(LogManagerTest, BasicLogging) {
   StorageEngine *storage_engine = new StorageEngine("test.db");
 
@@ -45,7 +60,7 @@ TEST(LogManagerTest, BasicLogging) {
   storage_engine->disk_manager_->ReadLog(buffer, PAGE_SIZE, 0);
   int32_t size = *reinterpret_cast<int32_t *>(buffer);
   LOG_DEBUG("size  = %d", size);
-  size = *reinterpret_cast<int32_t *>(buffer + 20);
+  size = *reinterpret_cast<int32_t *>(buffer + 28);
   LOG_DEBUG("size  = %d", size);
   size = *reinterpret_cast<int32_t *>(buffer + 44);
   LOG_DEBUG("size  = %d", size);
@@ -124,4 +139,861 @@ TEST(LogManagerTest, RedoTestWithOneTxn) {
   remove("test.log");
 }
 
+// appenders reserve log buffer space concurrently, log file must hold every
+// record exactly once and in lsn order
+TEST(LogManagerTest, ConcurrentAppendTest) {
+  DiskManager *disk_manager = new DiskManager("test.db");
+  LogManager *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+
+  const int num_threads = 4;
+  const int per_thread = 1000;
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([log_manager, tid]() {
+      for (int i = 0; i < per_thread; i++) {
+        LogRecord log_record(tid, INVALID_LSN, LogRecordType::BEGIN);
+        log_manager->AppendLogRecord(log_record);
+      }
+    }));
+  }
+  for (auto &t : threads)
+    t.join();
+  log_manager->StopFlushThread();
+  const int record_size = 28;
+  EXPECT_EQ(num_threads * per_thread * record_size - 1,
+            log_manager->GetPersistentLSN());
+
+  std::vector<char> buffer(num_threads * per_thread * record_size);
+  EXPECT_TRUE(disk_manager->ReadLog(buffer.data(), buffer.size(), 0));
+  std::vector<int> per_txn(num_threads, 0);
+  for (int i = 0; i < num_threads * per_thread; i++) {
+    const char *record = buffer.data() + i * record_size;
+    EXPECT_EQ(record_size, *reinterpret_cast<const int32_t *>(record));
+    // lsn is the offset of the record in the log
+    EXPECT_EQ(i * record_size, *reinterpret_cast<const lsn_t *>(record + 4));
+    per_txn[*reinterpret_cast<const txn_id_t *>(record + 12)]++;
+  }
+  for (int tid = 0; tid < num_threads; tid++)
+    EXPECT_EQ(per_thread, per_txn[tid]);
+
+  delete log_manager;
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+}
+
+// one thread keeps many transactions in flight through CommitAsync
+TEST(LogManagerTest, AsyncCommitTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  txn_manager->Commit(txn);
+  delete txn;
+
+  Schema *schema = ParseCreateStatement("a bigint, b smallint");
+  const int num_txns = 20;
+  std::atomic<int> committed(0);
+  std::vector<Transaction *> txns;
+  for (int i = 0; i < num_txns; i++) {
+    txn = txn_manager->Begin();
+    RID rid;
+    EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+    txn_manager->CommitAsync(txn, [&committed, storage_engine](Transaction *t) {
+      EXPECT_GE(storage_engine->log_manager_->GetPersistentLSN(),
+                t->GetPrevLSN());
+      committed++;
+    });
+    txns.push_back(txn);
+  }
+  txn = txn_manager->Begin();
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+  std::future<void> done = txn_manager->CommitAsync(txn);
+  txns.push_back(txn);
+  EXPECT_EQ(std::future_status::ready, done.wait_for(std::chrono::seconds(5)));
+  EXPECT_EQ(num_txns, committed.load());
+  EXPECT_GE(storage_engine->log_manager_->GetPersistentLSN(), txn->GetPrevLSN());
+
+  storage_engine->log_manager_->StopFlushThread();
+  for (auto t : txns)
+    delete t;
+  delete schema;
+  delete test_table;
+  delete storage_engine;
+  remove("test.db");
+  remove("test.log");
+}
+
+// commits are flushed within the latency SLO instead of LOG_TIMEOUT, and
+// concurrent commits share group flushes
+TEST(LogManagerTest, AdaptiveGroupCommitTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  txn_manager->Commit(txn);
+  delete txn;
+  Schema *schema = ParseCreateStatement("a bigint, b smallint");
+
+  const int num_threads = 4;
+  const int per_thread = 25;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int tid = 0; tid < num_threads; tid++) {
+    threads.push_back(std::thread([txn_manager, test_table, schema]() {
+      for (int i = 0; i < per_thread; i++) {
+        Transaction *txn = txn_manager->Begin();
+        RID rid;
+        EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+        txn_manager->Commit(txn);
+        delete txn;
+      }
+    }));
+  }
+  for (auto &t : threads)
+    t.join();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  // with a fixed LOG_TIMEOUT this would take per_thread seconds
+  EXPECT_LT(elapsed, LOG_TIMEOUT * per_thread / 4);
+
+  GroupCommitMetrics metrics =
+      storage_engine->log_manager_->GetGroupCommitMetrics();
+  EXPECT_EQ(num_threads * per_thread + 1, metrics.num_commits);
+  EXPECT_GT(metrics.num_group_flushes, 0);
+  EXPECT_GE(metrics.avg_batch_size, 1);
+  EXPECT_GE(metrics.max_batch_size, 1);
+  EXPECT_LT(metrics.avg_commit_latency_us,
+            std::chrono::duration_cast<std::chrono::microseconds>(LOG_TIMEOUT)
+                .count());
+
+  storage_engine->log_manager_->StopFlushThread();
+  delete schema;
+  delete test_table;
+  delete storage_engine;
+  remove("test.db");
+  remove("test.log");
+}
+
+// transactions that write nothing neither log nor wait for a flush
+TEST(LogManagerTest, ReadOnlyTransactionTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  Schema *schema = ParseCreateStatement("a bigint, b smallint");
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(ConstructTuple(schema), rid, txn));
+  txn_manager->Commit(txn);
+  lsn_t persistent_lsn = storage_engine->log_manager_->GetPersistentLSN();
+  // commit record is the last one on disk
+  EXPECT_LE(txn->GetPrevLSN(), persistent_lsn);
+  EXPECT_EQ(storage_engine->log_manager_->GetNextLSN() - 1, persistent_lsn);
+  delete txn;
+
+  // undeclared transaction that only reads
+  txn = txn_manager->Begin();
+  Tuple tuple;
+  EXPECT_TRUE(test_table->GetTuple(rid, tuple, txn));
+  txn_manager->Commit(txn);
+  EXPECT_EQ(INVALID_LSN, txn->GetPrevLSN());
+  delete txn;
+
+  // declared read-only transaction has no write set and rejects writes
+  txn = txn_manager->Begin(true);
+  EXPECT_TRUE(txn->IsReadOnly());
+  EXPECT_EQ(nullptr, txn->GetWriteSet());
+  EXPECT_TRUE(test_table->GetTuple(rid, tuple, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  txn = txn_manager->Begin(true);
+  EXPECT_FALSE(test_table->MarkDelete(rid, txn));
+  EXPECT_EQ(TransactionState::ABORTED, txn->GetState());
+  txn_manager->Abort(txn);
+  delete txn;
+
+  // nothing was appended by the readers
+  EXPECT_EQ(0, storage_engine->log_manager_->GetWritePosition());
+  EXPECT_EQ(persistent_lsn, storage_engine->log_manager_->GetPersistentLSN());
+
+  storage_engine->log_manager_->StopFlushThread();
+  delete schema;
+  delete test_table;
+  delete storage_engine;
+  remove("test.db");
+  remove("test.log");
+}
+
+
+// UPDATE records keep only the changed bytes, redo and undo rebuild the
+// tuples from the page image and the delta
+TEST(LogManagerTest, UpdateDeltaTest) {
+  Schema *schema = ParseCreateStatement("a bigint, b smallint, c varchar");
+  std::vector<Value> values{Value(TypeId::BIGINT, (int64_t)1),
+                            Value(TypeId::SMALLINT, (int16_t)2),
+                            Value(TypeId::VARCHAR, "delta")};
+  Tuple tuple(values, schema);
+  values[1] = Value(TypeId::SMALLINT, (int16_t)3);
+  Tuple committed_tuple(values, schema);
+  values[2] = Value(TypeId::VARCHAR, "encoded update");
+  Tuple uncommitted_tuple(values, schema);
+
+  // one fixed-size column changed: one range of the changed bytes instead
+  // of both images
+  LogRecord record(0, INVALID_LSN, LogRecordType::UPDATE, RID(0, 0), tuple,
+                   committed_tuple);
+  EXPECT_EQ(28 + (int32_t)sizeof(RID) + 6 * (int32_t)sizeof(int32_t) + 2,
+            record.GetSize());
+  Tuple result;
+  EXPECT_TRUE(record.ApplyUpdateDelta(tuple, result, false));
+  EXPECT_EQ(0, memcmp(result.GetData(), committed_tuple.GetData(),
+                      committed_tuple.GetLength()));
+  EXPECT_TRUE(record.ApplyUpdateDelta(committed_tuple, result, true));
+  EXPECT_EQ(0, memcmp(result.GetData(), tuple.GetData(), tuple.GetLength()));
+  EXPECT_FALSE(record.ApplyUpdateDelta(uncommitted_tuple, result, false));
+
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(tuple, rid, txn));
+  EXPECT_TRUE(test_table->UpdateTuple(committed_tuple, rid, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // varchar grows, the loser's update has to be undone after restart
+  txn = txn_manager->Begin();
+  EXPECT_TRUE(test_table->UpdateTuple(uncommitted_tuple, rid, txn));
+  storage_engine->log_manager_->StopFlushThread();
+  delete txn;
+  delete test_table;
+  delete storage_engine;
+
+  storage_engine = new StorageEngine("test.db");
+  LogRecovery *log_recovery = new LogRecovery(
+      storage_engine->disk_manager_, storage_engine->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                             storage_engine->lock_manager_,
+                             storage_engine->log_manager_, first_page_id);
+  txn = storage_engine->transaction_manager_->Begin();
+  EXPECT_TRUE(test_table->GetTuple(rid, result, txn));
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+  EXPECT_EQ(committed_tuple.GetLength(), result.GetLength());
+  EXPECT_EQ(1, result.GetValue(schema, 1).CompareEquals(values[1]));
+  EXPECT_EQ(1, result.GetValue(schema, 2).CompareEquals(
+                   Value(TypeId::VARCHAR, "delta")));
+
+  delete log_recovery;
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+
+// log is split into preallocated segment files, truncation drops or recycles
+// whole segments and survives a restart
+TEST(LogManagerTest, LogSegmentTest) {
+  int64_t segment_size = LOG_SEGMENT_FILE_SIZE;
+  LOG_SEGMENT_FILE_SIZE = 1024;
+  DiskManager *disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(0, disk_manager->GetLogStartOffset());
+  EXPECT_EQ(0, disk_manager->GetLogEndOffset());
+
+  // two buffers, disk manager expects them to alternate
+  std::vector<char> buffers[2];
+  for (int i = 0; i < 10; i++) {
+    buffers[i % 2].assign(700, static_cast<char>('a' + i));
+    FrameLogRecord(buffers[i % 2].data(), 700, i * 700);
+    disk_manager->WriteLog(buffers[i % 2].data(), 700);
+  }
+  disk_manager->SyncLog();
+  EXPECT_EQ(7000, disk_manager->GetLogEndOffset());
+  // every segment file has its full size from the first append on
+  struct stat stat_buf;
+  for (int segment = 0; segment < 7; segment++) {
+    EXPECT_EQ(0, stat(("test.log." + std::to_string(segment)).c_str(),
+                      &stat_buf));
+    EXPECT_EQ(1024, stat_buf.st_size);
+  }
+
+  // read across a segment boundary
+  char buffer[800];
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 800, 650));
+  EXPECT_EQ('a', buffer[0]);
+  EXPECT_EQ('b', buffer[749]);
+  EXPECT_EQ(1400, *reinterpret_cast<lsn_t *>(buffer + 754));
+  EXPECT_EQ('c', buffer[762]);
+
+  // segments 0-2 lie before offset 3500, segment 7 is prepared already and
+  // one of them is recycled as segment 8
+  disk_manager->TruncateLog(3500);
+  EXPECT_EQ(3500, disk_manager->GetLogStartOffset());
+  EXPECT_FALSE(disk_manager->ReadLog(buffer, 800, 3072));
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 800, 3500));
+  EXPECT_EQ('f', buffer[12]);
+  for (int segment = 0; segment < 3; segment++)
+    EXPECT_NE(0, access(("test.log." + std::to_string(segment)).c_str(),
+                        F_OK));
+  EXPECT_EQ(0, access("test.log.7", F_OK));
+  EXPECT_EQ(0, access("test.log.8", F_OK));
+  EXPECT_NE(0, access("test.log.9", F_OK));
+  delete disk_manager;
+
+  // reopen: start from anchor, end behind the last record even though the
+  // segment is zero-filled and recycled files with old records follow
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(3500, disk_manager->GetLogStartOffset());
+  EXPECT_EQ(7000, disk_manager->GetLogEndOffset());
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 800, 6300));
+  EXPECT_EQ('j', buffer[12]);
+  EXPECT_EQ('j', buffer[699]);
+  EXPECT_EQ(0, buffer[700]);
+  buffers[0].assign(1200, 'k');
+  FrameLogRecord(buffers[0].data(), 1200, 7000);
+  disk_manager->WriteLog(buffers[0].data(), 1200);
+  disk_manager->SyncLog();
+  EXPECT_EQ(8200, disk_manager->GetLogEndOffset());
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 800, 7000));
+  EXPECT_EQ('k', buffer[12]);
+  EXPECT_EQ('k', buffer[799]);
+  delete disk_manager;
+
+  // a record that is not where its lsn says ends the log, like the stale
+  // bytes a crash leaves behind the last durable record
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(8200, disk_manager->GetLogEndOffset());
+  buffers[1].assign(100, 'l');
+  FrameLogRecord(buffers[1].data(), 100, 9000);
+  disk_manager->WriteLog(buffers[1].data(), 100);
+  delete disk_manager;
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(8200, disk_manager->GetLogEndOffset());
+  delete disk_manager;
+
+  // without anchor the old segments are discarded
+  remove("test.log");
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(0, disk_manager->GetLogEndOffset());
+  EXPECT_NE(0, access("test.log.3", F_OK));
+
+  // lsn is the log offset, log manager truncates right at it
+  LogManager *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  lsn_t middle_lsn = INVALID_LSN;
+  for (int i = 0; i < 200; i++) {
+    LogRecord record(i, INVALID_LSN, LogRecordType::BEGIN);
+    lsn_t lsn = log_manager->AppendLogRecord(record);
+    if (i % 20 == 0)
+      log_manager->flushLogToDisk(false);
+    if (i == 150)
+      middle_lsn = lsn;
+  }
+  log_manager->StopFlushThread();
+  EXPECT_EQ(200 * 28, disk_manager->GetLogEndOffset());
+  EXPECT_EQ(150 * 28, middle_lsn);
+  log_manager->TruncateLog(middle_lsn);
+  EXPECT_EQ(middle_lsn, disk_manager->GetLogStartOffset());
+  // record of middle_lsn must still be there
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 28, middle_lsn));
+  EXPECT_EQ(middle_lsn, *reinterpret_cast<lsn_t *>(buffer + 4));
+  delete log_manager;
+  delete disk_manager;
+
+  LOG_SEGMENT_FILE_SIZE = segment_size;
+  for (int segment = 0; segment < 16; segment++)
+    remove(("test.log." + std::to_string(segment)).c_str());
+  remove("test.db");
+  remove("test.log");
+}
+
+
+// the next segment is zero-filled in the background once the current one is
+// LOG_PREALLOCATE_PERCENT full, not when the log first writes into it
+TEST(LogManagerTest, LogPreallocateTest) {
+  int64_t segment_size = LOG_SEGMENT_FILE_SIZE;
+  LOG_SEGMENT_FILE_SIZE = 1000;
+  const int64_t threshold = 1000 * LOG_PREALLOCATE_PERCENT / 100;
+  DiskManager *disk_manager = new DiskManager("test.db");
+  std::vector<char> buffers[2];
+  buffers[0].assign(threshold - 100, 'a');
+  FrameLogRecord(buffers[0].data(), threshold - 100, 0);
+  disk_manager->WriteLog(buffers[0].data(), threshold - 100);
+  buffers[1].assign(100, 'b');
+  FrameLogRecord(buffers[1].data(), 100, threshold - 100);
+  disk_manager->WriteLog(buffers[1].data(), 100);
+  disk_manager->SyncLog();
+  // destructor waits for the preparation
+  delete disk_manager;
+  struct stat stat_buf;
+  EXPECT_EQ(0, stat("test.log.1", &stat_buf));
+  EXPECT_EQ(1000, stat_buf.st_size);
+  EXPECT_NE(0, access("test.log.2", F_OK));
+
+  // logging starts on a reopened log: the segment it ends in has the bytes
+  // behind the log end zeroed in the background
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(threshold, disk_manager->GetLogEndOffset());
+  LogManager *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+  lsn_t lsn = INVALID_LSN;
+  for (int i = 0; i < 150; i++) {
+    LogRecord record(i, INVALID_LSN, LogRecordType::BEGIN);
+    lsn = log_manager->AppendLogRecord(record);
+  }
+  log_manager->flushLogToDisk(true);
+  log_manager->StopFlushThread();
+  EXPECT_EQ(threshold + 149 * 28, lsn);
+  delete log_manager;
+  delete disk_manager;
+  // the log ends past the threshold of its last segment, the one after it
+  // is prepared
+  int64_t end = threshold + 150 * 28;
+  ASSERT_LE(threshold, end % 1000);
+  EXPECT_EQ(0, access(("test.log." + std::to_string(end / 1000 + 1)).c_str(),
+                      F_OK));
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(end, disk_manager->GetLogEndOffset());
+  char buffer[28];
+  EXPECT_TRUE(disk_manager->ReadLog(buffer, 28, lsn));
+  EXPECT_EQ(lsn, *reinterpret_cast<lsn_t *>(buffer + 4));
+  delete disk_manager;
+
+  LOG_SEGMENT_FILE_SIZE = segment_size;
+  for (int segment = 0; segment < 16; segment++)
+    remove(("test.log." + std::to_string(segment)).c_str());
+  remove("test.db");
+  remove("test.log");
+}
+
+// commits per second against the cost of fdatasync when batch_size commit
+// records share one group flush
+TEST(LogManagerTest, GroupSyncBenchmarkTest) {
+  DiskManager *disk_manager = new DiskManager("test.db");
+  // a commit record is a bare header
+  const int record_size = 28;
+  std::vector<char> buffers[2];
+  int current = 0;
+  // zero-fill of the first segment is not part of the measurement
+  buffers[current].assign(record_size, 0);
+  FrameLogRecord(buffers[current].data(), record_size, 0);
+  disk_manager->WriteLog(buffers[current].data(), record_size);
+  disk_manager->SyncLog();
+
+  const int num_commits = 256;
+  for (int batch_size : {1, 4, 16, 64}) {
+    int flushes = disk_manager->GetNumFlushes();
+    std::chrono::duration<double, std::micro> sync_time(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_commits; i += batch_size) {
+      current ^= 1;
+      std::vector<char> &buffer = buffers[current];
+      buffer.assign(batch_size * record_size, 0);
+      lsn_t lsn = disk_manager->GetLogEndOffset();
+      for (int j = 0; j < batch_size; j++)
+        FrameLogRecord(buffer.data() + j * record_size,
+                       record_size,
+                       lsn + j * record_size);
+      disk_manager->WriteLog(buffer.data(), buffer.size());
+      auto sync_start = std::chrono::steady_clock::now();
+      disk_manager->SyncLog();
+      sync_time += std::chrono::steady_clock::now() - sync_start;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    int syncs = disk_manager->GetNumFlushes() - flushes;
+    EXPECT_EQ(num_commits / batch_size, syncs);
+    std::cout << "batch " << batch_size << ": "
+              << num_commits / elapsed.count() << " commits/s, "
+              << sync_time.count() / syncs << " us/fdatasync" << std::endl;
+  }
+  int64_t log_end = disk_manager->GetLogEndOffset();
+  EXPECT_EQ((1 + 4 * num_commits) * record_size, log_end);
+  delete disk_manager;
+
+  // every record is found again behind the zero-filled segment
+  disk_manager = new DiskManager("test.db");
+  EXPECT_EQ(log_end, disk_manager->GetLogEndOffset());
+  delete disk_manager;
+  remove("test.db");
+  remove("test.log");
+  remove("test.log.0");
+}
+
+
+// log reader streams records spanning its chunks and reads them by offset
+TEST(LogManagerTest, LogReaderTest) {
+  int64_t segment_size = LOG_SEGMENT_FILE_SIZE;
+  LOG_SEGMENT_FILE_SIZE = 1000;
+  DiskManager *disk_manager = new DiskManager("test.db");
+  LogManager *log_manager = new LogManager(disk_manager);
+  Schema *schema = ParseCreateStatement("a varchar");
+  log_manager->RunFlushThread();
+  std::vector<lsn_t> lsns;
+  std::vector<int32_t> lengths;
+  for (int i = 0; i < 300; i++) {
+    // record sizes vary from 28 to about 160 bytes
+    std::vector<Value> values{Value(TypeId::VARCHAR, std::string(i % 97, 'x'))};
+    // a valid prev lsn, so no BEGIN is logged in front of it
+    LogRecord record(i, 0, LogRecordType::INSERT, RID(i, i),
+                     Tuple(values, schema));
+    LogRecord begin(i, INVALID_LSN, LogRecordType::BEGIN);
+    lengths.push_back(record.GetInserteTuple().GetLength());
+    lsns.push_back(log_manager->AppendLogRecord(i % 3 ? record : begin));
+  }
+  log_manager->StopFlushThread();
+
+  // chunks much smaller than the log and some records
+  LogReader reader(disk_manager, 64);
+  reader.Seek(disk_manager->GetLogStartOffset());
+  LogRecord record;
+  std::vector<int64_t> offsets;
+  for (int i = 0; i < 300; i++) {
+    ASSERT_TRUE(reader.Next(record));
+    EXPECT_EQ(lsns[i], record.GetLSN());
+    EXPECT_EQ(lsns[i], reader.GetRecordOffset());
+    EXPECT_EQ(i, record.GetTxnId());
+    if (i % 3) {
+      EXPECT_EQ(i, record.GetInsertRID().GetPageId());
+      EXPECT_EQ(lengths[i], record.GetInserteTuple().GetLength());
+    }
+    offsets.push_back(reader.GetRecordOffset());
+  }
+  EXPECT_FALSE(reader.Next(record));
+  EXPECT_EQ(disk_manager->GetLogEndOffset(), reader.GetNextOffset());
+
+  // random access backwards, as undo does
+  for (int i = 299; i >= 0; i -= 7) {
+    ASSERT_TRUE(reader.ReadAt(offsets[i], record));
+    EXPECT_EQ(lsns[i], record.GetLSN());
+  }
+  EXPECT_FALSE(reader.ReadAt(disk_manager->GetLogEndOffset(), record));
+
+  // scan again from the middle
+  reader.Seek(offsets[150]);
+  ASSERT_TRUE(reader.Next(record));
+  EXPECT_EQ(lsns[150], record.GetLSN());
+  // the end of the scan waits for the read ahead, the reader may outlive
+  // the disk manager from here on
+  int remaining = 0;
+  while (reader.Next(record))
+    remaining++;
+  EXPECT_EQ(149, remaining);
+
+  delete schema;
+  delete log_manager;
+  delete disk_manager;
+  LOG_SEGMENT_FILE_SIZE = segment_size;
+  for (int segment = 0; segment < 64; segment++)
+    remove(("test.log." + std::to_string(segment)).c_str());
+  remove("test.db");
+  remove("test.log");
+}
+
+// redo of a table spanning many pages by several workers, pages not written
+// back before the crash are rebuilt from the log
+TEST(LogManagerTest, ParallelRedoTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+  Schema *schema = ParseCreateStatement("a bigint, b varchar");
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  std::vector<RID> rids(201);
+  for (int i = 0; i < 201; i++) {
+    std::vector<Value> values{Value(TypeId::BIGINT, (int64_t)i),
+                              Value(TypeId::VARCHAR, std::string(80, 'a'))};
+    EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  // many more pages than the buffer pool holds
+  EXPECT_GT(rids.back().GetPageId(), 2 * BUFFER_POOL_SIZE);
+
+  // loser shares the last page with a committed tuple
+  Transaction *loser = txn_manager->Begin();
+  RID loser_rid;
+  std::vector<Value> values{Value(TypeId::BIGINT, (int64_t)-1),
+                            Value(TypeId::VARCHAR, std::string(80, 'b'))};
+  EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), loser_rid, loser));
+  EXPECT_EQ(rids.back().GetPageId(), loser_rid.GetPageId());
+  storage_engine->log_manager_->flushLogToDisk(true);
+  delete loser;
+  delete test_table;
+  // crash, dirty pages in the buffer pool are lost
+  delete storage_engine;
+
+  storage_engine = new StorageEngine("test.db");
+  LogRecovery *log_recovery = new LogRecovery(
+      storage_engine->disk_manager_, storage_engine->buffer_pool_manager_, 4);
+  log_recovery->Redo();
+  // pages of upcoming records were read ahead of the workers
+  EXPECT_GT(log_recovery->GetPrefetchCount(), 0);
+  log_recovery->Undo();
+
+  test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                             storage_engine->lock_manager_,
+                             storage_engine->log_manager_, first_page_id);
+  txn = storage_engine->transaction_manager_->Begin();
+  Tuple tuple;
+  for (int i = 0; i < 201; i++) {
+    ASSERT_TRUE(test_table->GetTuple(rids[i], tuple, txn));
+    EXPECT_EQ(i, tuple.GetValue(schema, 0).GetAs<int64_t>());
+  }
+  EXPECT_FALSE(test_table->GetTuple(loser_rid, tuple, txn));
+  delete txn;
+
+  delete log_recovery;
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  remove("test.db");
+  remove("test.log");
+}
+
+// fuzzy checkpoint truncates the log, analysis rebuilds the tables from the
+// checkpoint and redo starts at the minimum recLSN
+TEST(LogManagerTest, FuzzyCheckpointTest) {
+  int64_t segment_size = LOG_SEGMENT_FILE_SIZE;
+  LOG_SEGMENT_FILE_SIZE = 256;
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+  Schema *schema = ParseCreateStatement("a bigint, b varchar");
+
+  Transaction *txn = txn_manager->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        storage_engine->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID rid_a, rid_b, rid_c;
+  std::vector<Value> values{Value(TypeId::BIGINT, (int64_t)1),
+                            Value(TypeId::VARCHAR, "committed before")};
+  // enough history to fill the first log segment
+  for (int i = 0; i < 6; i++)
+    EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), rid_a, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  // page is clean on disk, its history is no longer needed
+  EXPECT_TRUE(storage_engine->buffer_pool_manager_->FlushPage(first_page_id));
+  EXPECT_TRUE(
+      storage_engine->buffer_pool_manager_->GetDirtyPageTable().empty());
+
+  Transaction *loser = txn_manager->Begin();
+  values[0] = Value(TypeId::BIGINT, (int64_t)2);
+  EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), rid_b, loser));
+  lsn_t begin_lsn = storage_engine->checkpoint_manager_->Checkpoint();
+  EXPECT_NE(INVALID_LSN, begin_lsn);
+  lsn_t min_recovery_lsn =
+      storage_engine->checkpoint_manager_->GetMinRecoveryLSN();
+  EXPECT_LE(min_recovery_lsn, loser->GetFirstLSN());
+  // records of the first transaction are gone
+  EXPECT_GT(storage_engine->disk_manager_->GetLogStartOffset(), 0);
+
+  txn = txn_manager->Begin();
+  values[0] = Value(TypeId::BIGINT, (int64_t)3);
+  EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), rid_c, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  storage_engine->log_manager_->StopFlushThread();
+  delete loser;
+  delete test_table;
+  delete storage_engine;
+
+  storage_engine = new StorageEngine("test.db");
+  LogRecovery *log_recovery = new LogRecovery(
+      storage_engine->disk_manager_, storage_engine->buffer_pool_manager_);
+  log_recovery->Redo();
+  EXPECT_EQ(1, log_recovery->GetDirtyPageTable().size());
+  EXPECT_EQ(1, log_recovery->GetDirtyPageTable().count(first_page_id));
+  EXPECT_GE(log_recovery->GetRedoLSN(), min_recovery_lsn);
+  EXPECT_EQ(1, log_recovery->GetActiveTxnTable().size());
+  log_recovery->Undo();
+
+  test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                             storage_engine->lock_manager_,
+                             storage_engine->log_manager_, first_page_id);
+  txn = storage_engine->transaction_manager_->Begin();
+  Tuple tuple;
+  EXPECT_TRUE(test_table->GetTuple(rid_a, tuple, txn));
+  EXPECT_FALSE(test_table->GetTuple(rid_b, tuple, txn));
+  EXPECT_TRUE(test_table->GetTuple(rid_c, tuple, txn));
+  EXPECT_EQ(1, tuple.GetValue(schema, 0).CompareEquals(values[0]));
+  delete txn;
+
+  delete log_recovery;
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  LOG_SEGMENT_FILE_SIZE = segment_size;
+  for (int segment = 0; segment < 64; segment++)
+    remove(("test.log." + std::to_string(segment)).c_str());
+  remove("test.db");
+  remove("test.log");
+}
+
+// the storage engine checkpoints in the background once logging is enabled,
+// an idle log is not checkpointed again
+TEST(LogManagerTest, CheckpointThreadTest) {
+  std::chrono::milliseconds checkpoint_interval = CHECKPOINT_INTERVAL;
+  CHECKPOINT_INTERVAL = std::chrono::milliseconds(20);
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  CheckpointManager *checkpoint_manager = storage_engine->checkpoint_manager_;
+  LogManager *log_manager = storage_engine->log_manager_;
+  // nothing happens before logging is enabled
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(INVALID_LSN, checkpoint_manager->GetMinRecoveryLSN());
+
+  log_manager->RunFlushThread();
+  Schema *schema = ParseCreateStatement("a bigint");
+  Transaction *txn = storage_engine->transaction_manager_->Begin();
+  TableHeap *test_table = new TableHeap(storage_engine->buffer_pool_manager_,
+                                        storage_engine->lock_manager_,
+                                        log_manager, txn);
+  std::vector<Value> values{Value(TypeId::BIGINT, (int64_t)1)};
+  RID rid;
+  EXPECT_TRUE(test_table->InsertTuple(Tuple(values, schema), rid, txn));
+  storage_engine->transaction_manager_->Commit(txn);
+  delete txn;
+
+  for (int i = 0; i < 200 && checkpoint_manager->GetMinRecoveryLSN() ==
+                                 INVALID_LSN; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  // the table page is still dirty since its creation
+  EXPECT_EQ(0, checkpoint_manager->GetMinRecoveryLSN());
+  // END_CHECKPOINT is the last record, no new checkpoint follows it
+  lsn_t next_lsn = log_manager->GetNextLSN();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(next_lsn, log_manager->GetNextLSN());
+
+  delete test_table;
+  delete storage_engine;
+  delete schema;
+  CHECKPOINT_INTERVAL = checkpoint_interval;
+  for (int segment = 0; segment < 16; segment++)
+    remove(("test.log." + std::to_string(segment)).c_str());
+  remove("test.db");
+  remove("test.log");
+}
+
+// b+ tree pages are recovered from the log instead of being rebuilt: splits
+// and merges of committed transactions are redone, leaf changes of the loser
+// are undone through the tree while its split survives
+TEST(LogManagerTest, BPlusTreeRecoveryTest) {
+  StorageEngine *storage_engine = new StorageEngine("test.db");
+  BufferPoolManager *bpm = storage_engine->buffer_pool_manager_;
+  page_id_t header_page_id;
+  static_cast<HeaderPage *>(bpm->NewPage(header_page_id))->Init();
+  bpm->UnpinPage(header_page_id, true);
+  bpm->FlushPage(header_page_id);
+  storage_engine->log_manager_->RunFlushThread();
+  TransactionManager *txn_manager = storage_engine->transaction_manager_;
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+  GenericKey<8> index_key;
+  RID rid;
+
+  auto tree = new BPlusTree<GenericKey<8>, RID, GenericComparator<8>>(
+      "foo_pk", bpm, comparator, INVALID_PAGE_ID,
+      storage_engine->log_manager_);
+  Transaction *txn = txn_manager->Begin();
+  for (int64_t key = 1; key <= 1000; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    EXPECT_TRUE(tree->Insert(index_key, rid, txn));
+  }
+  // leaves fall below half full and merge or borrow
+  for (int64_t key = 1; key <= 200; key++) {
+    index_key.SetFromInteger(key);
+    tree->Remove(index_key, txn);
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  Transaction *loser = txn_manager->Begin();
+  for (int64_t key = 1001; key <= 1300; key++) {
+    index_key.SetFromInteger(key);
+    rid.Set(0, key);
+    EXPECT_TRUE(tree->Insert(index_key, rid, loser));
+  }
+  for (int64_t key = 201; key <= 250; key++) {
+    index_key.SetFromInteger(key);
+    tree->Remove(index_key, loser);
+  }
+  storage_engine->log_manager_->flushLogToDisk(true);
+  delete loser;
+  delete tree;
+  // crash, dirty pages in the buffer pool are lost
+  delete storage_engine;
+
+  storage_engine = new StorageEngine("test.db");
+  bpm = storage_engine->buffer_pool_manager_;
+  LogRecovery *log_recovery =
+      new LogRecovery(storage_engine->disk_manager_, bpm);
+  log_recovery->Redo();
+  EXPECT_EQ(1, log_recovery->GetActiveTxnTable().size());
+  page_id_t root_page_id;
+  auto header_page = static_cast<HeaderPage *>(bpm->FetchPage(HEADER_PAGE_ID));
+  EXPECT_TRUE(header_page->GetRootId("foo_pk", root_page_id));
+  bpm->UnpinPage(HEADER_PAGE_ID, false);
+  tree = new BPlusTree<GenericKey<8>, RID, GenericComparator<8>>(
+      "foo_pk", bpm, comparator, root_page_id);
+  log_recovery->RegisterIndex("foo_pk", [&](const char *entry, bool inserted) {
+    tree->UndoEntry(entry, inserted);
+  });
+  log_recovery->Undo();
+
+  std::vector<RID> rids;
+  for (int64_t key = 1; key <= 1300; key++) {
+    rids.clear();
+    index_key.SetFromInteger(key);
+    bool committed = key > 200 && key <= 1000;
+    EXPECT_EQ(committed, tree->GetValue(index_key, rids)) << key;
+    if (committed) {
+      EXPECT_EQ(key, rids[0].GetSlotNum());
+    }
+  }
+  int64_t current_key = 201;
+  for (auto iterator = tree->Begin(); !iterator.isEnd(); ++iterator) {
+    EXPECT_EQ(current_key, (*iterator).second.GetSlotNum());
+    current_key++;
+  }
+  EXPECT_EQ(1001, current_key);
+
+  delete log_recovery;
+  delete tree;
+  delete storage_engine;
+  delete key_schema;
+  remove("test.db");
+  remove("test.log");
+}
+
 } // namespace cmudb
@@ -4,12 +4,14 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <future>
 #include <iostream>
 #include <string>
 #include <random>
 #include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
 #include "logging/common.h"
 #include "table/table_heap.h"
 #include "table/tuple.h"
@@ -56,6 +58,10 @@ namespace cmudb {
             // std::cout << i++ << std::endl;
             assert(table->MarkDelete(rid_t, transaction) == 1);
         }
+        // a deleted tuple can not be deleted again
+        size_t write_set_size = transaction->GetWriteSet()->size();
+        EXPECT_FALSE(table->MarkDelete(rid_v[0], transaction));
+        EXPECT_EQ(write_set_size, transaction->GetWriteSet()->size());
         remove("test.db"); // remove db file
         remove("test.log");
         delete schema;
@@ -64,4 +70,277 @@ namespace cmudb {
         delete disk_manager;
     }
 
+    // a scan takes one table S lock instead of a lock per tuple
+    TEST(TupleTest, TableScanLockTest) {
+        std::string createStmt = "a varchar, b smallint, c bigint";
+        Schema *schema = ParseCreateStatement(createStmt);
+        Tuple tuple = ConstructTuple(schema);
+
+        DiskManager *disk_manager = new DiskManager("test.db");
+        BufferPoolManager *buffer_pool_manager =
+                new BufferPoolManager(50, disk_manager);
+        LockManager *lock_manager = new LockManager(true);
+        LogManager *log_manager = new LogManager(disk_manager);
+        TransactionManager txn_mgr(lock_manager, log_manager);
+        log_manager->RunFlushThread();
+
+        Transaction *writer = txn_mgr.Begin();
+        TableHeap *table = new TableHeap(buffer_pool_manager, lock_manager,
+                                         log_manager, writer);
+        RID rid, first_rid;
+        const int num_tuples = 500;
+        for (int i = 0; i < num_tuples; ++i) {
+            EXPECT_TRUE(table->InsertTuple(tuple, rid, writer));
+            if (i == 0)
+                first_rid = rid;
+        }
+        // tuples are X locked under IX on the table
+        EXPECT_EQ(1U, writer->GetIntentionExclusiveLockSet()->count(
+                LockManager::TableLockId(table->GetFirstPageId())));
+        txn_mgr.Commit(writer);
+        delete writer;
+
+        Transaction *scanner = txn_mgr.Begin(true);
+        int count = 0;
+        for (auto itr = table->begin(scanner); itr != table->end(); ++itr)
+            count++;
+        EXPECT_EQ(num_tuples, count);
+        EXPECT_EQ(1U, scanner->GetSharedLockSet()->size());
+        EXPECT_TRUE(scanner->GetIntentionSharedLockSet()->empty());
+
+        // writers wait for the scan to finish
+        writer = txn_mgr.Begin();
+        auto update = std::async(std::launch::async, [&] {
+            return table->UpdateTuple(tuple, first_rid, writer);
+        });
+        EXPECT_EQ(std::future_status::timeout,
+                  update.wait_for(std::chrono::milliseconds(50)));
+        txn_mgr.Commit(scanner);
+        EXPECT_TRUE(update.get());
+        txn_mgr.Commit(writer);
+        delete scanner;
+        delete writer;
+
+        log_manager->StopFlushThread();
+        remove("test.db");
+        remove("test.log");
+        delete schema;
+        delete table;
+        delete log_manager;
+        delete lock_manager;
+        delete buffer_pool_manager;
+        delete disk_manager;
+    }
+
+    // the rollback of an update restores the old image under the locks held
+    TEST(TupleTest, AbortUpdateTest) {
+        Schema *schema = ParseCreateStatement("a bigint");
+        Tuple old_tuple(std::vector<Value>{Value(TypeId::BIGINT, (int64_t)1)}, schema);
+        Tuple new_tuple(std::vector<Value>{Value(TypeId::BIGINT, (int64_t)2)}, schema);
+
+        DiskManager *disk_manager = new DiskManager("test.db");
+        BufferPoolManager *buffer_pool_manager =
+                new BufferPoolManager(50, disk_manager);
+        LockManager *lock_manager = new LockManager(true);
+        LogManager *log_manager = new LogManager(disk_manager);
+        TransactionManager txn_mgr(lock_manager, log_manager);
+        log_manager->RunFlushThread();
+
+        Transaction *txn = txn_mgr.Begin();
+        TableHeap *table = new TableHeap(buffer_pool_manager, lock_manager,
+                                         log_manager, txn);
+        RID rid;
+        EXPECT_TRUE(table->InsertTuple(old_tuple, rid, txn));
+        txn_mgr.Commit(txn);
+        delete txn;
+
+        txn = txn_mgr.Begin();
+        EXPECT_TRUE(table->UpdateTuple(new_tuple, rid, txn));
+        Tuple tuple;
+        EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+        EXPECT_EQ(2, tuple.GetValue(schema, 0).GetAs<int64_t>());
+        txn_mgr.Abort(txn);
+        delete txn;
+
+        txn = txn_mgr.Begin();
+        EXPECT_TRUE(table->GetTuple(rid, tuple, txn));
+        EXPECT_EQ(1, tuple.GetValue(schema, 0).GetAs<int64_t>());
+        txn_mgr.Commit(txn);
+        delete txn;
+
+        log_manager->StopFlushThread();
+        remove("test.db");
+        remove("test.log");
+        delete schema;
+        delete table;
+        delete log_manager;
+        delete lock_manager;
+        delete buffer_pool_manager;
+        delete disk_manager;
+    }
+
+    // snapshot reads see the table as of their begin, without locks
+    TEST(TupleTest, SnapshotReadTest) {
+        Schema *schema = ParseCreateStatement("a bigint");
+        auto make_tuple = [schema](int64_t a) {
+            return Tuple({Value(TypeId::BIGINT, a)}, schema);
+        };
+        auto value = [schema](const Tuple &tuple) {
+            return tuple.GetValue(schema, 0).GetAs<int64_t>();
+        };
+
+        DiskManager *disk_manager = new DiskManager("test.db");
+        BufferPoolManager *buffer_pool_manager =
+                new BufferPoolManager(50, disk_manager);
+        LockManager *lock_manager = new LockManager(true);
+        LogManager *log_manager = new LogManager(disk_manager);
+        VersionManager *version_manager =
+                new VersionManager(buffer_pool_manager, log_manager);
+        TransactionManager txn_mgr(lock_manager, log_manager, version_manager);
+        log_manager->RunFlushThread();
+
+        Transaction *writer = txn_mgr.Begin();
+        TableHeap *table = new TableHeap(buffer_pool_manager, lock_manager,
+                                         log_manager, writer, version_manager);
+        RID rid[4];
+        for (int i = 0; i < 3; ++i)
+            EXPECT_TRUE(table->InsertTuple(make_tuple(i), rid[i], writer));
+        txn_mgr.Commit(writer);
+        delete writer;
+
+        // scan the snapshot of txn in another thread, it must not wait for locks
+        auto scan = [&](Transaction *txn) {
+            auto result = std::async(std::launch::async, [&] {
+                std::vector<int64_t> values;
+                for (auto itr = table->begin(txn); itr != table->end(); ++itr)
+                    values.push_back(value(*itr));
+                return values;
+            });
+            EXPECT_EQ(std::future_status::ready,
+                      result.wait_for(std::chrono::seconds(5)));
+            return result.get();
+        };
+
+        Transaction *reader = txn_mgr.Begin(true);
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->UpdateTuple(make_tuple(10), rid[0], writer));
+        EXPECT_TRUE(table->MarkDelete(rid[1], writer));
+        EXPECT_TRUE(table->InsertTuple(make_tuple(3), rid[3], writer));
+        // the writer sees its own writes
+        Tuple tuple;
+        EXPECT_TRUE(table->GetTuple(rid[0], tuple, writer));
+        EXPECT_EQ(10, value(tuple));
+        EXPECT_FALSE(table->GetTuple(rid[1], tuple, writer));
+
+        EXPECT_EQ((std::vector<int64_t>{0, 1, 2}), scan(reader));
+        EXPECT_TRUE(table->GetTuple(rid[1], tuple, reader));
+        EXPECT_EQ(1, value(tuple));
+        EXPECT_FALSE(table->GetTuple(rid[3], tuple, reader));
+        txn_mgr.Commit(writer);
+        delete writer;
+        // the reader keeps its snapshot after the writer commits, also
+        // through a garbage collection
+        version_manager->GarbageCollect();
+        EXPECT_EQ((std::vector<int64_t>{0, 1, 2}), scan(reader));
+        EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+        EXPECT_TRUE(reader->GetIntentionSharedLockSet()->empty());
+
+        Transaction *reader2 = txn_mgr.Begin(true);
+        EXPECT_EQ((std::vector<int64_t>{10, 2, 3}), scan(reader2));
+
+        // first updater wins: the snapshot of txn misses the update of rid 2
+        Transaction *txn = txn_mgr.Begin();
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->UpdateTuple(make_tuple(20), rid[2], writer));
+        txn_mgr.Commit(writer);
+        delete writer;
+        EXPECT_FALSE(table->UpdateTuple(make_tuple(21), rid[2], txn));
+        EXPECT_EQ(TransactionState::ABORTED, txn->GetState());
+        txn_mgr.Abort(txn);
+        delete txn;
+
+        // rolled back writes leave no version behind
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->UpdateTuple(make_tuple(30), rid[0], writer));
+        EXPECT_TRUE(table->UpdateTuple(make_tuple(31), rid[0], writer));
+        EXPECT_TRUE(table->MarkDelete(rid[2], writer));
+        RID inserted;
+        EXPECT_TRUE(table->InsertTuple(make_tuple(4), inserted, writer));
+        txn_mgr.Abort(writer);
+        delete writer;
+        Transaction *reader3 = txn_mgr.Begin(true);
+        EXPECT_EQ((std::vector<int64_t>{10, 20, 3}), scan(reader3));
+        EXPECT_EQ((std::vector<int64_t>{0, 1, 2}), scan(reader));
+        EXPECT_EQ((std::vector<int64_t>{10, 2, 3}), scan(reader2));
+
+        // once the snapshots are gone every version chain is dropped
+        for (Transaction *snapshot : {reader, reader2, reader3}) {
+            txn_mgr.Commit(snapshot);
+            delete snapshot;
+        }
+        EXPECT_NE(0U, version_manager->GetNumVersions());
+        version_manager->RunGCThread();
+        auto start = std::chrono::steady_clock::now();
+        while (version_manager->GetNumVersions() != 0 &&
+               std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+            std::this_thread::sleep_for(VERSION_GC_INTERVAL);
+        EXPECT_EQ(0U, version_manager->GetNumVersions());
+        reader = txn_mgr.Begin(true);
+        EXPECT_EQ((std::vector<int64_t>{10, 20, 3}), scan(reader));
+        txn_mgr.Commit(reader);
+        delete reader;
+
+        // the collection freed the slot of rid 1, fill it and the slot of the
+        // rolled back insert
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->InsertTuple(make_tuple(5), inserted, writer));
+        EXPECT_EQ(rid[1], inserted);
+        EXPECT_TRUE(table->InsertTuple(make_tuple(6), inserted, writer));
+        txn_mgr.Commit(writer);
+        delete writer;
+
+        // the slot of a committed delete is not reused before its version is
+        // stamped, an insert meanwhile goes elsewhere
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->MarkDelete(rid[3], writer));
+        std::future<void> durable = txn_mgr.CommitAsync(writer);
+        txn = txn_mgr.Begin();
+        EXPECT_TRUE(table->InsertTuple(make_tuple(7), inserted, txn));
+        EXPECT_FALSE(inserted == rid[3]);
+        durable.get();
+        delete writer;
+        txn_mgr.Abort(txn);
+        delete txn;
+        reader = txn_mgr.Begin(true);
+        EXPECT_EQ((std::vector<int64_t>{10, 5, 20, 6}), scan(reader));
+        txn_mgr.Commit(reader);
+        delete reader;
+        start = std::chrono::steady_clock::now();
+        while (version_manager->GetNumVersions() != 0 &&
+               std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+            std::this_thread::sleep_for(VERSION_GC_INTERVAL);
+        EXPECT_EQ(0U, version_manager->GetNumVersions());
+        writer = txn_mgr.Begin();
+        EXPECT_TRUE(table->InsertTuple(make_tuple(8), inserted, writer));
+        EXPECT_EQ(rid[3], inserted);
+        txn_mgr.Commit(writer);
+        delete writer;
+        reader = txn_mgr.Begin(true);
+        EXPECT_EQ((std::vector<int64_t>{10, 5, 20, 8, 6}), scan(reader));
+        txn_mgr.Commit(reader);
+        delete reader;
+
+        version_manager->StopGCThread();
+        log_manager->StopFlushThread();
+        remove("test.db");
+        remove("test.log");
+        delete schema;
+        delete table;
+        delete version_manager;
+        delete log_manager;
+        delete lock_manager;
+        delete buffer_pool_manager;
+        delete disk_manager;
+    }
+
 } // namespace cmudb